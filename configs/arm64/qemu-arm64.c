@@ -48,6 +48,7 @@ struct {
 				.gic_version = 3,
 				.gicd_base = 0x08000000,
 				.gicr_base = 0x080a0000,
+				.gits_base = 0x08080000,
 				.maintenance_irq = 25,
 			},
 		},
@@ -32,6 +32,7 @@ struct {
 	struct jailhouse_pci_device pci_devices[4];
 #endif
 	struct jailhouse_pci_capability pci_caps[6];
+	struct jailhouse_msr msr_regions[5];
 } __attribute__((packed)) config = {
 	.cell = {
 		.signature = JAILHOUSE_CELL_DESC_SIGNATURE,
@@ -47,6 +48,7 @@ struct {
 		.num_pio_regions = ARRAY_SIZE(config.pio_regions),
 		.num_pci_devices = ARRAY_SIZE(config.pci_devices),
 		.num_pci_caps = ARRAY_SIZE(config.pci_caps),
+		.num_msr_regions = ARRAY_SIZE(config.msr_regions),
 	},
 
 	.cpus = {
@@ -303,5 +305,16 @@ struct {
 			.len = 4,
 			.flags = 0,
 		},
-	}
+	},
+
+	.msr_regions = {
+		/* Intel PMU: counters, event selects, IA32_PERF_GLOBAL_* */
+		MSR_RANGE(0xc1, 8, JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE),
+		MSR_RANGE(0x186, 8, JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE),
+		MSR_RANGE(0x309, 4, JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE),
+		MSR_RANGE(0x38d, 6, JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE),
+		/* IA32_TSC_AUX */
+		MSR_RANGE(0xc0000103, 1,
+			  JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE),
+	},
 };
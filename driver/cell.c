@@ -418,6 +418,52 @@ int jailhouse_cmd_cell_start(const char __user *arg)
 	return err;
 }
 
+int jailhouse_cmd_cell_stats(struct jailhouse_cell_stats __user *arg)
+{
+	struct jailhouse_cell_cpu_stats cpu_stats;
+	struct jailhouse_cell_stats cell_stats;
+	unsigned int cpu, n = 0;
+	struct cell *cell;
+	int err;
+
+	BUILD_BUG_ON(JAILHOUSE_NUM_CPU_STATS > JAILHOUSE_CELL_STATS_MAX);
+
+	if (copy_from_user(&cell_stats, arg, sizeof(cell_stats)))
+		return -EFAULT;
+
+	err = cell_management_prologue(&cell_stats.cell_id, &cell);
+	if (err)
+		return err;
+
+	for_each_cpu(cpu, &cell->cpus_assigned) {
+		if (n < cell_stats.num_cpus) {
+			memset(&cpu_stats, 0, sizeof(cpu_stats));
+			cpu_stats.cpu = cpu;
+			err = jailhouse_cpu_stats_read(cpu, cpu_stats.stats);
+			if (err < 0)
+				goto unlock_out;
+			cpu_stats.num_stats = err;
+
+			if (copy_to_user(&arg->cpus[n], &cpu_stats,
+					 sizeof(cpu_stats))) {
+				err = -EFAULT;
+				goto unlock_out;
+			}
+		}
+		n++;
+	}
+
+	/* Report the required number of entries if the buffer was short. */
+	err = n > cell_stats.num_cpus ? -ENOSPC : 0;
+	if (put_user(n, &arg->num_cpus))
+		err = -EFAULT;
+
+unlock_out:
+	mutex_unlock(&jailhouse_lock);
+
+	return err;
+}
+
 static int cell_destroy(struct cell *cell)
 {
 	unsigned int cpu;
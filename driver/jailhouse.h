@@ -70,6 +70,21 @@ struct jailhouse_cell_load {
 	struct jailhouse_preload_image image[];
 };
 
+#define JAILHOUSE_CELL_STATS_MAX	16
+
+struct jailhouse_cell_cpu_stats {
+	__u32 cpu;
+	__u32 num_stats;
+	__u64 stats[JAILHOUSE_CELL_STATS_MAX];
+};
+
+struct jailhouse_cell_stats {
+	struct jailhouse_cell_id cell_id;
+	__u32 num_cpus;
+	__u32 padding;
+	struct jailhouse_cell_cpu_stats cpus[];
+};
+
 #define JAILHOUSE_CELL_ID_UNUSED	(-1)
 
 #define JAILHOUSE_ENABLE		_IOW(0, 0, void *)
@@ -78,5 +93,7 @@ struct jailhouse_cell_load {
 #define JAILHOUSE_CELL_LOAD		_IOW(0, 3, struct jailhouse_cell_load)
 #define JAILHOUSE_CELL_START		_IOW(0, 4, struct jailhouse_cell_id)
 #define JAILHOUSE_CELL_DESTROY		_IOW(0, 5, struct jailhouse_cell_id)
+#define JAILHOUSE_TRACE_CONTROL		_IO(0, 6)
+#define JAILHOUSE_CELL_STATS		_IOWR(0, 7, struct jailhouse_cell_stats)
 
 #endif /* !_JAILHOUSE_DRIVER_H */
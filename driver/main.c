@@ -53,6 +53,7 @@
 
 #include <jailhouse/header.h>
 #include <jailhouse/hypercall.h>
+#include <jailhouse/trace.h>
 #include <generated/version.h>
 
 #ifdef CONFIG_X86_32
@@ -76,6 +77,8 @@
 #define JAILHOUSE_FW_NAME	"jailhouse.bin"
 #endif
 
+#define CPU_STATS_READ_RETRIES	1000
+
 MODULE_DESCRIPTION("Management driver for Jailhouse partitioning hypervisor");
 MODULE_LICENSE("GPL");
 #ifdef CONFIG_X86
@@ -99,6 +102,8 @@ void *hypervisor_mem;
 
 static struct device *jailhouse_dev;
 static unsigned long hv_core_and_percpu_size;
+static unsigned int hv_max_cpus;
+static struct jailhouse_cpu_stats *cpu_stats_area;
 static atomic_t call_done;
 static int error_code;
 static struct jailhouse_virt_console* volatile console_page;
@@ -323,6 +328,7 @@ static int __jailhouse_console_dump_delta(struct jailhouse_virt_console
 
 static void jailhouse_firmware_free(void)
 {
+	jailhouse_sysfs_trace_exit(jailhouse_dev);
 	jailhouse_sysfs_core_exit(jailhouse_dev);
 	if (hypervisor_mem_res) {
 		release_mem_region(hypervisor_mem_res->start,
@@ -363,6 +369,79 @@ console_free_out:
 }
 
 /* See Documentation/bootstrap-interface.txt */
+/*
+ * Copy a part of the published statistics of a CPU, retrying while the
+ * hypervisor updates them. Updates are short, so only give up if the entry
+ * stays inconsistent for an unexpectedly long time.
+ */
+static int cpu_stats_copy(unsigned int cpu, void *dst, size_t offset,
+			  size_t size)
+{
+	struct jailhouse_cpu_stats *published;
+	unsigned int retries;
+	u32 seq;
+
+	if (!cpu_stats_area)
+		return -ENODEV;
+	if (cpu >= hv_max_cpus)
+		return -EINVAL;
+
+	published = &cpu_stats_area[cpu];
+	for (retries = 0; retries < CPU_STATS_READ_RETRIES; retries++) {
+		seq = published->seq;
+		if (!(seq & 1)) {
+			smp_rmb();
+			memcpy(dst, (void *)published + offset, size);
+			smp_rmb();
+			if (published->seq == seq)
+				return 0;
+		}
+		cpu_relax();
+	}
+
+	return -EBUSY;
+}
+
+/**
+ * Read a consistent snapshot of the statistic counters of a CPU.
+ * @param cpu	Logical CPU ID.
+ * @param stats	Buffer for JAILHOUSE_NUM_CPU_STATS counters.
+ *
+ * The counters are published by the hypervisor, so no hypercall is needed.
+ *
+ * @return Number of counters read or negative error code.
+ */
+int jailhouse_cpu_stats_read(unsigned int cpu, u64 *stats)
+{
+	int err;
+
+	err = cpu_stats_copy(cpu, stats,
+			     offsetof(struct jailhouse_cpu_stats, stats),
+			     JAILHOUSE_NUM_CPU_STATS * sizeof(u64));
+
+	return err ? err : JAILHOUSE_NUM_CPU_STATS;
+}
+
+/**
+ * Read a consistent snapshot of an exit latency histogram of a CPU.
+ * @param cpu		Logical CPU ID.
+ * @param stat		Statistic counter the histogram belongs to.
+ * @param latency	Buffer for the histogram.
+ *
+ * @return 0 on success or negative error code.
+ */
+int jailhouse_cpu_latency_read(unsigned int cpu, unsigned int stat,
+			       struct jailhouse_cpu_latency *latency)
+{
+	if (stat >= JAILHOUSE_NUM_CPU_STATS)
+		return -EINVAL;
+
+	return cpu_stats_copy(cpu, latency,
+			      offsetof(struct jailhouse_cpu_stats,
+				       latency[stat]),
+			      sizeof(*latency));
+}
+
 static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 {
 	const struct firmware *hypervisor;
@@ -376,6 +455,7 @@ static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 	unsigned int clock_gates;
 	const char *fw_name;
 	long max_cpus;
+	int stats_offset;
 	int err;
 
 	fw_name = jailhouse_get_fw_name();
@@ -495,6 +575,7 @@ static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 
 	header = (struct jailhouse_header *)hypervisor_mem;
 	header->max_cpus = max_cpus;
+	hv_max_cpus = max_cpus;
 
 #if defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	header->arm_linux_hyp_vectors = virt_to_phys(*__hyp_stub_vectors_sym);
@@ -602,6 +683,13 @@ static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 		goto error_free_cell;
 	}
 
+	stats_offset = jailhouse_call_arg1(JAILHOUSE_HC_HYPERVISOR_GET_INFO,
+					   JAILHOUSE_INFO_CPU_STATS_AREA);
+	if (stats_offset > 0)
+		cpu_stats_area = hypervisor_mem + stats_offset;
+	else
+		pr_warn("jailhouse: CPU statistics unavailable\n");
+
 	if (console)
 		iounmap(console);
 
@@ -735,6 +823,7 @@ static int jailhouse_cmd_disable(void)
 	update_last_console();
 
 	jailhouse_cell_delete_root();
+	cpu_stats_area = NULL;
 	jailhouse_enabled = false;
 	module_put(THIS_MODULE);
 
@@ -746,6 +835,41 @@ unlock_out:
 	return err;
 }
 
+static int jailhouse_cmd_trace_control(unsigned long command)
+{
+	int offset, err = 0;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+		return -EINTR;
+
+	if (!jailhouse_enabled) {
+		err = -EINVAL;
+		goto unlock_out;
+	}
+
+	offset = jailhouse_call_arg1(JAILHOUSE_HC_TRACE_CONTROL, command);
+	if (offset < 0) {
+		err = offset;
+		goto unlock_out;
+	}
+
+	/*
+	 * The buffers stay valid after disabling tracing, even after
+	 * disabling the hypervisor, until the firmware is released. The
+	 * header cannot be consulted for max_cpus here: the root cell only
+	 * sees the trace buffers of the hypervisor memory while enabled.
+	 */
+	if (command == JAILHOUSE_TRACE_ENABLE)
+		err = jailhouse_sysfs_trace_init(jailhouse_dev,
+				hypervisor_mem + offset,
+				hv_max_cpus * JAILHOUSE_TRACE_BUFFER_SIZE);
+
+unlock_out:
+	mutex_unlock(&jailhouse_lock);
+
+	return err;
+}
+
 static long jailhouse_ioctl(struct file *file, unsigned int ioctl,
 			    unsigned long arg)
 {
@@ -773,6 +897,13 @@ static long jailhouse_ioctl(struct file *file, unsigned int ioctl,
 	case JAILHOUSE_CELL_DESTROY:
 		err = jailhouse_cmd_cell_destroy((const char __user *)arg);
 		break;
+	case JAILHOUSE_TRACE_CONTROL:
+		err = jailhouse_cmd_trace_control(arg);
+		break;
+	case JAILHOUSE_CELL_STATS:
+		err = jailhouse_cmd_cell_stats(
+			(struct jailhouse_cell_stats __user *)arg);
+		break;
 	default:
 		err = -EINVAL;
 		break;
@@ -17,6 +17,8 @@
 
 #include "cell.h"
 
+struct jailhouse_cpu_latency;
+
 extern struct mutex jailhouse_lock;
 extern bool jailhouse_enabled;
 extern void *hypervisor_mem;
@@ -25,5 +27,8 @@ void *jailhouse_ioremap(phys_addr_t phys, unsigned long virt,
 			unsigned long size);
 int jailhouse_console_dump_delta(char *dst, unsigned int head,
 				 unsigned int *miss);
+int jailhouse_cpu_stats_read(unsigned int cpu, u64 *stats);
+int jailhouse_cpu_latency_read(unsigned int cpu, unsigned int stat,
+			       struct jailhouse_cpu_latency *latency);
 
 #endif /* !_JAILHOUSE_DRIVER_MAIN_H */
@@ -80,20 +80,16 @@ static ssize_t cell_stats_show(struct kobject *kobj,
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell *cell = container_of(kobj, struct cell, stats_kobj);
-	unsigned long sum = 0;
+	u64 stats[JAILHOUSE_NUM_CPU_STATS];
 	unsigned int cpu;
-	int value;
+	u64 sum = 0;
 
-	for_each_cpu(cpu, &cell->cpus_assigned) {
-		value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cpu,
-					    code);
-		if (value > 0)
-			sum += value;
-	}
+	for_each_cpu(cpu, &cell->cpus_assigned)
+		if (jailhouse_cpu_stats_read(cpu, stats) > 0)
+			sum += stats[stats_attr->code];
 
-	return sprintf(buffer, "%lu\n", sum);
+	return sprintf(buffer, "%llu\n", sum);
 }
 
 static ssize_t cpu_stats_show(struct kobject *kobj,
@@ -102,19 +98,40 @@ static ssize_t cpu_stats_show(struct kobject *kobj,
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell_cpu *cell_cpu = container_of(kobj, struct cell_cpu, kobj);
-	int value;
+	u64 stats[JAILHOUSE_NUM_CPU_STATS];
 
-	value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cell_cpu->cpu,
-				    code);
-	if (value < 0)
-		value = 0;
+	if (jailhouse_cpu_stats_read(cell_cpu->cpu, stats) < 0)
+		return sprintf(buffer, "0\n");
 
-	return sprintf(buffer, "%d\n", value);
+	return sprintf(buffer, "%llu\n", stats[stats_attr->code]);
 }
 
-#define JAILHOUSE_CPU_STATS_ATTR(_name, _code) \
+static ssize_t cpu_latency_show(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				char *buffer)
+{
+	struct jailhouse_cpu_stats_attr *stats_attr =
+		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
+	struct cell_cpu *cell_cpu = container_of(kobj, struct cell_cpu, kobj);
+	struct jailhouse_cpu_latency latency;
+	unsigned int bucket;
+	ssize_t written = 0;
+
+	if (jailhouse_cpu_latency_read(cell_cpu->cpu, stats_attr->code,
+				       &latency) < 0)
+		memset(&latency, 0, sizeof(latency));
+
+	for (bucket = 0; bucket < JAILHOUSE_CPU_LATENCY_BUCKETS; bucket++)
+		written += scnprintf(buffer + written, PAGE_SIZE - written,
+				     "%u ", latency.buckets[bucket]);
+	written += scnprintf(buffer + written, PAGE_SIZE - written, "%u\n",
+			     latency.max);
+
+	return written;
+}
+
+#define JAILHOUSE_CPU_COUNTER_ATTR(_name, _code) \
 	static struct jailhouse_cpu_stats_attr _name##_cell_attr = { \
 		.kattr = __ATTR(_name, S_IRUGO, cell_stats_show, NULL), \
 		.code = _code, \
@@ -124,12 +141,26 @@ static ssize_t cpu_stats_show(struct kobject *kobj,
 		.code = _code, \
 	}
 
+#define JAILHOUSE_CPU_STATS_ATTR(_name, _code) \
+	JAILHOUSE_CPU_COUNTER_ATTR(_name, _code); \
+	static struct jailhouse_cpu_stats_attr _name##_latency_attr = { \
+		.kattr = { \
+			.attr = { .name = "latency_" #_name, \
+				  .mode = S_IRUGO }, \
+			.show = cpu_latency_show, \
+		}, \
+		.code = _code, \
+	}
+
 JAILHOUSE_CPU_STATS_ATTR(vmexits_total, JAILHOUSE_CPU_STAT_VMEXITS_TOTAL);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_mmio, JAILHOUSE_CPU_STAT_VMEXITS_MMIO);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_management,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MANAGEMENT);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_hypercall,
 			 JAILHOUSE_CPU_STAT_VMEXITS_HYPERCALL);
+JAILHOUSE_CPU_COUNTER_ATTR(pci_cfg_shadow, JAILHOUSE_CPU_STAT_PCI_CFG_SHADOW);
+JAILHOUSE_CPU_COUNTER_ATTR(pci_cfg_hardware,
+			   JAILHOUSE_CPU_STAT_PCI_CFG_HARDWARE);
 #ifdef CONFIG_X86
 JAILHOUSE_CPU_STATS_ATTR(vmexits_pio, JAILHOUSE_CPU_STAT_VMEXITS_PIO);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_xapic, JAILHOUSE_CPU_STAT_VMEXITS_XAPIC);
@@ -142,6 +173,9 @@ JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_other,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_x2apic_icr,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_X2APIC_ICR);
+JAILHOUSE_CPU_STATS_ATTR(iommu_inv_requests,
+			 JAILHOUSE_CPU_STAT_IOMMU_INV_REQUESTS);
+JAILHOUSE_CPU_STATS_ATTR(iommu_inv_waits, JAILHOUSE_CPU_STAT_IOMMU_INV_WAITS);
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 JAILHOUSE_CPU_STATS_ATTR(vmexits_maintenance,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MAINTENANCE);
@@ -159,6 +193,8 @@ static struct attribute *cell_stats_attrs[] = {
 	&vmexits_mmio_cell_attr.kattr.attr,
 	&vmexits_management_cell_attr.kattr.attr,
 	&vmexits_hypercall_cell_attr.kattr.attr,
+	&pci_cfg_shadow_cell_attr.kattr.attr,
+	&pci_cfg_hardware_cell_attr.kattr.attr,
 #ifdef CONFIG_X86
 	&vmexits_pio_cell_attr.kattr.attr,
 	&vmexits_xapic_cell_attr.kattr.attr,
@@ -168,6 +204,8 @@ static struct attribute *cell_stats_attrs[] = {
 	&vmexits_exception_cell_attr.kattr.attr,
 	&vmexits_msr_other_cell_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cell_attr.kattr.attr,
+	&iommu_inv_requests_cell_attr.kattr.attr,
+	&iommu_inv_waits_cell_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cell_attr.kattr.attr,
 	&vmexits_virt_irq_cell_attr.kattr.attr,
@@ -191,6 +229,8 @@ static struct attribute *cpu_stats_attrs[] = {
 	&vmexits_mmio_cpu_attr.kattr.attr,
 	&vmexits_management_cpu_attr.kattr.attr,
 	&vmexits_hypercall_cpu_attr.kattr.attr,
+	&pci_cfg_shadow_cpu_attr.kattr.attr,
+	&pci_cfg_hardware_cpu_attr.kattr.attr,
 #ifdef CONFIG_X86
 	&vmexits_pio_cpu_attr.kattr.attr,
 	&vmexits_xapic_cpu_attr.kattr.attr,
@@ -200,6 +240,8 @@ static struct attribute *cpu_stats_attrs[] = {
 	&vmexits_exception_cpu_attr.kattr.attr,
 	&vmexits_msr_other_cpu_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cpu_attr.kattr.attr,
+	&iommu_inv_requests_cpu_attr.kattr.attr,
+	&iommu_inv_waits_cpu_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cpu_attr.kattr.attr,
 	&vmexits_virt_irq_cpu_attr.kattr.attr,
@@ -209,6 +251,31 @@ static struct attribute *cpu_stats_attrs[] = {
 #ifdef CONFIG_ARM
 	&vmexits_cp15_cpu_attr.kattr.attr,
 #endif
+#endif
+	&vmexits_total_latency_attr.kattr.attr,
+	&vmexits_mmio_latency_attr.kattr.attr,
+	&vmexits_management_latency_attr.kattr.attr,
+	&vmexits_hypercall_latency_attr.kattr.attr,
+#ifdef CONFIG_X86
+	&vmexits_pio_latency_attr.kattr.attr,
+	&vmexits_xapic_latency_attr.kattr.attr,
+	&vmexits_cr_latency_attr.kattr.attr,
+	&vmexits_cpuid_latency_attr.kattr.attr,
+	&vmexits_xsetbv_latency_attr.kattr.attr,
+	&vmexits_exception_latency_attr.kattr.attr,
+	&vmexits_msr_other_latency_attr.kattr.attr,
+	&vmexits_msr_x2apic_icr_latency_attr.kattr.attr,
+	&iommu_inv_requests_latency_attr.kattr.attr,
+	&iommu_inv_waits_latency_attr.kattr.attr,
+#elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
+	&vmexits_maintenance_latency_attr.kattr.attr,
+	&vmexits_virt_irq_latency_attr.kattr.attr,
+	&vmexits_virt_sgi_latency_attr.kattr.attr,
+	&vmexits_psci_latency_attr.kattr.attr,
+	&vmexits_smccc_latency_attr.kattr.attr,
+#ifdef CONFIG_ARM
+	&vmexits_cp15_latency_attr.kattr.attr,
+#endif
 #endif
 	NULL
 };
@@ -510,6 +577,20 @@ static ssize_t mem_pool_used_show(struct device *dev,
 	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_USED);
 }
 
+static ssize_t mem_pool_free_blocks_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_FREE_BLOCKS);
+}
+
+static ssize_t mem_pool_largest_free_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_MEM_POOL_LARGEST_FREE);
+}
+
 static ssize_t remap_pool_size_show(struct device *dev,
 				    struct device_attribute *attr,
 				    char *buffer)
@@ -524,6 +605,27 @@ static ssize_t remap_pool_used_show(struct device *dev,
 	return info_show(dev, buffer, JAILHOUSE_INFO_REMAP_POOL_USED);
 }
 
+static ssize_t remap_pool_free_blocks_show(struct device *dev,
+					   struct device_attribute *attr,
+					   char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_REMAP_POOL_FREE_BLOCKS);
+}
+
+static ssize_t remap_pool_largest_free_show(struct device *dev,
+					    struct device_attribute *attr,
+					    char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_REMAP_POOL_LARGEST_FREE);
+}
+
+static ssize_t console_dropped_show(struct device *dev,
+				    struct device_attribute *attr,
+				    char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_CONSOLE_DROPPED);
+}
+
 static ssize_t core_show(struct file *filp, struct kobject *kobj,
 			 struct bin_attribute *attr, char *buf, loff_t off,
 			 size_t count)
@@ -532,20 +634,40 @@ static ssize_t core_show(struct file *filp, struct kobject *kobj,
 				       attr->size);
 }
 
+static void *trace_buffers;
+
+static ssize_t trace_show(struct file *filp, struct kobject *kobj,
+			  struct bin_attribute *attr, char *buf, loff_t off,
+			  size_t count)
+{
+	return memory_read_from_buffer(buf, count, &off, trace_buffers,
+				       attr->size);
+}
+
 static DEVICE_ATTR_RO(console);
+static DEVICE_ATTR_RO(console_dropped);
 static DEVICE_ATTR_RO(enabled);
 static DEVICE_ATTR_RO(mem_pool_size);
 static DEVICE_ATTR_RO(mem_pool_used);
+static DEVICE_ATTR_RO(mem_pool_free_blocks);
+static DEVICE_ATTR_RO(mem_pool_largest_free);
 static DEVICE_ATTR_RO(remap_pool_size);
 static DEVICE_ATTR_RO(remap_pool_used);
+static DEVICE_ATTR_RO(remap_pool_free_blocks);
+static DEVICE_ATTR_RO(remap_pool_largest_free);
 
 static struct attribute *jailhouse_sysfs_entries[] = {
 	&dev_attr_console.attr,
+	&dev_attr_console_dropped.attr,
 	&dev_attr_enabled.attr,
 	&dev_attr_mem_pool_size.attr,
 	&dev_attr_mem_pool_used.attr,
+	&dev_attr_mem_pool_free_blocks.attr,
+	&dev_attr_mem_pool_largest_free.attr,
 	&dev_attr_remap_pool_size.attr,
 	&dev_attr_remap_pool_used.attr,
+	&dev_attr_remap_pool_free_blocks.attr,
+	&dev_attr_remap_pool_largest_free.attr,
 	NULL
 };
 
@@ -560,6 +682,12 @@ static struct bin_attribute bin_attr_core = {
 	.read = core_show,
 };
 
+static struct bin_attribute bin_attr_trace = {
+	.attr.name = "trace",
+	.attr.mode = S_IRUSR,
+	.read = trace_show,
+};
+
 int jailhouse_sysfs_core_init(struct device *dev, size_t hypervisor_size)
 {
 	bin_attr_core.size = hypervisor_size;
@@ -571,6 +699,29 @@ void jailhouse_sysfs_core_exit(struct device *dev)
 	sysfs_remove_bin_file(&dev->kobj, &bin_attr_core);
 }
 
+int jailhouse_sysfs_trace_init(struct device *dev, void *buffers, size_t size)
+{
+	int err;
+
+	if (trace_buffers)
+		return 0;
+
+	bin_attr_trace.size = size;
+	err = sysfs_create_bin_file(&dev->kobj, &bin_attr_trace);
+	if (!err)
+		trace_buffers = buffers;
+	return err;
+}
+
+void jailhouse_sysfs_trace_exit(struct device *dev)
+{
+	if (!trace_buffers)
+		return;
+
+	sysfs_remove_bin_file(&dev->kobj, &bin_attr_trace);
+	trace_buffers = NULL;
+}
+
 int jailhouse_sysfs_init(struct device *dev)
 {
 	int err;
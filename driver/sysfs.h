@@ -21,6 +21,8 @@ void jailhouse_sysfs_cell_delete(struct cell *cell);
 
 int jailhouse_sysfs_core_init(struct device *dev, size_t hypervisor_size);
 void jailhouse_sysfs_core_exit(struct device *dev);
+int jailhouse_sysfs_trace_init(struct device *dev, void *buffers, size_t size);
+void jailhouse_sysfs_trace_exit(struct device *dev);
 int jailhouse_sysfs_init(struct device *dev);
 void jailhouse_sysfs_exit(struct device *dev);
 
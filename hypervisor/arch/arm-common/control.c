@@ -15,6 +15,7 @@
 #include <jailhouse/control.h>
 #include <jailhouse/printk.h>
 #include <asm/control.h>
+#include <asm/gic.h>
 #include <asm/iommu.h>
 #include <asm/psci.h>
 #include <asm/smc.h>
@@ -73,8 +74,10 @@ static void check_events(struct public_per_cpu *cpu_public)
 
 		spin_unlock(&cpu_public->control_lock);
 
-		while (cpu_public->suspend_cpu)
+		while (cpu_public->suspend_cpu) {
+			arm_dcaches_flush_help();
 			cpu_relax();
+		}
 
 		spin_lock(&cpu_public->control_lock);
 	}
@@ -149,6 +152,15 @@ bool arch_handle_phys_irq(u32 irqn, unsigned int count_event)
 	}
 
 	cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_VIRQ] += count_event;
+
+	if (is_lpi(irqn)) {
+		/* LPIs have no active state, they are completed right away. */
+		irqn = gicv3_its_virt_lpi(cpu_public, irqn);
+		if (irqn)
+			irqchip_set_pending(cpu_public, irqn);
+		return true;
+	}
+
 	irqchip_set_pending(cpu_public, irqn);
 
 	return false;
@@ -182,6 +194,7 @@ void arch_cell_reset(struct cell *cell)
 		public_per_cpu(cpu)->cpu_on_entry = PSCI_INVALID_ADDRESS;
 
 	arm_cell_dcaches_flush(cell, DCACHE_INVALIDATE);
+	cell->arch.started = true;
 
 	irqchip_cell_reset(cell);
 }
@@ -190,7 +203,12 @@ void arch_cell_destroy(struct cell *cell)
 {
 	unsigned int cpu;
 
-	arm_cell_dcaches_flush(cell, DCACHE_INVALIDATE);
+	/*
+	 * Memory of a cell that never ran was only written by the root cell,
+	 * which owns the resulting cache lines anyway.
+	 */
+	if (cell->arch.started)
+		arm_cell_dcaches_flush(cell, DCACHE_INVALIDATE);
 
 	/* All CPUs are handed back to the root cell in suspended mode. */
 	for_each_cpu(cpu, cell->cpu_set)
@@ -204,6 +222,13 @@ void arch_flush_cell_vcpu_caches(struct cell *cell)
 {
 	unsigned int cpu;
 
+	/*
+	 * The caller's own cell can be invalidated by IPA. Those TLBIs are
+	 * broadcast and match on the VMID loaded on this CPU.
+	 */
+	if (cell == this_cell() && arm_paging_vcpu_flush_dirty_tlbs(cell))
+		return;
+
 	for_each_cpu(cpu, cell->cpu_set)
 		if (cpu == this_cpu_id())
 			arm_paging_vcpu_flush_tlbs();
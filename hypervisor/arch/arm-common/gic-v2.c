@@ -281,26 +281,43 @@ static void gicv2_send_sgi(struct sgi *sgi)
 	mmio_write32(gicd_base + GICD_SGIR, val);
 }
 
+/* Priority as stored in list registers, upper 5 bits only. */
+static u32 gicv2_get_irq_priority(u16 irq_id)
+{
+	/* SGIs and PPIs are banked, we read those of the calling CPU. */
+	return mmio_read8(gicd_base + GICD_IPRIORITYR + irq_id) >> 3;
+}
+
+static u64 gicv2_read_free_lrs(struct per_cpu *cpu_data)
+{
+	if (!cpu_data->lr_free_valid) {
+		cpu_data->lr_free = mmio_read32(gich_base + GICH_ELSR0);
+		if (gic_num_lr > 32)
+			cpu_data->lr_free |=
+				(u64)mmio_read32(gich_base + GICH_ELSR1) << 32;
+		cpu_data->lr_free_valid = true;
+	}
+	return cpu_data->lr_free;
+}
+
 static int gicv2_inject_irq(u16 irq_id, u16 sender)
 {
+	struct per_cpu *cpu_data = this_cpu_data();
+	u64 free_lrs = gicv2_read_free_lrs(cpu_data);
 	unsigned int n;
 	int first_free = -1;
 	u32 lr;
-	unsigned long elsr[2];
 
-	elsr[0] = mmio_read32(gich_base + GICH_ELSR0);
-	elsr[1] = mmio_read32(gich_base + GICH_ELSR1);
 	for (n = 0; n < gic_num_lr; n++) {
-		if (test_bit(n, elsr)) {
+		if ((free_lrs >> n) & 1) {
 			/* Entry is available */
 			if (first_free == -1)
 				first_free = n;
 			continue;
 		}
 
-		/* Check that there is no overlapping */
-		lr = gicv2_read_lr(n);
-		if ((lr & GICH_LR_VIRT_ID_MASK) == irq_id)
+		/* Check that there is no overlapping, using the cached ID */
+		if (cpu_data->lr_irq[n] == irq_id)
 			return -EEXIST;
 	}
 
@@ -310,6 +327,7 @@ static int gicv2_inject_irq(u16 irq_id, u16 sender)
 	/* Inject group 0 interrupt (seen as IRQ by the guest) */
 	lr = irq_id;
 	lr |= GICH_LR_PENDING_BIT;
+	lr |= gicv2_get_irq_priority(irq_id) << GICH_LR_PRIORITY_SHIFT;
 
 	if (is_sgi(irq_id)) {
 		lr |= (sender & 0x7) << GICH_LR_CPUID_SHIFT;
@@ -319,10 +337,52 @@ static int gicv2_inject_irq(u16 irq_id, u16 sender)
 	}
 
 	gicv2_write_lr(first_free, lr);
+	cpu_data->lr_irq[first_free] = irq_id;
+	cpu_data->lr_free &= ~(1ULL << first_free);
 
 	return 0;
 }
 
+/*
+ * Free the list register holding the pending, not yet acknowledged interrupt
+ * with the lowest priority below that of irq_id. Called when all list
+ * registers are in use.
+ */
+static bool gicv2_evict_irq(u16 irq_id, u16 *evicted_id, u16 *evicted_sender)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	u32 lowest_prio = gicv2_get_irq_priority(irq_id);
+	u32 lr, prio, victim_lr = 0;
+	unsigned int n;
+	int victim = -1;
+
+	for (n = 0; n < gic_num_lr; n++) {
+		lr = gicv2_read_lr(n);
+		if ((lr & (GICH_LR_PENDING_BIT | GICH_LR_ACTIVE_BIT)) !=
+		    GICH_LR_PENDING_BIT)
+			continue;
+
+		prio = (lr >> GICH_LR_PRIORITY_SHIFT) & 0x1f;
+		if (prio > lowest_prio) {
+			lowest_prio = prio;
+			victim = n;
+			victim_lr = lr;
+		}
+	}
+
+	if (victim == -1)
+		return false;
+
+	*evicted_id = cpu_data->lr_irq[victim];
+	*evicted_sender = is_sgi(*evicted_id) ?
+		(victim_lr >> GICH_LR_CPUID_SHIFT) & 0x7 : 0;
+
+	gicv2_write_lr(victim, 0);
+	cpu_data->lr_free |= 1ULL << victim;
+
+	return true;
+}
+
 static void gicv2_enable_maint_irq(bool enable)
 {
 	u32 hcr;
@@ -517,6 +577,7 @@ const struct irqchip gicv2_irqchip = {
 
 	.send_sgi = gicv2_send_sgi,
 	.inject_irq = gicv2_inject_irq,
+	.evict_irq = gicv2_evict_irq,
 	.enable_maint_irq = gicv2_enable_maint_irq,
 	.has_pending_irqs = gicv2_has_pending_irqs,
 	.read_iar_irqn = gicv2_read_iar_irqn,
@@ -0,0 +1,1589 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * GICv3 Interrupt Translation Service (ITS) emulation
+ *
+ * The hypervisor owns the physical command queue of the ITS. Each cell gets
+ * a virtual ITS control frame with its own command queue. Commands of the
+ * root cell are validated and forwarded unmodified. Commands of non-root
+ * cells are translated: the ITTs of their devices are allocated by the
+ * hypervisor, their LPIs are backed by physical LPIs from the upper half of
+ * the LPI space, and their collections are mapped on per-CPU collections
+ * reserved by the hypervisor. Physical LPIs are translated back and injected
+ * as virtual LPIs.
+ *
+ * The LPI configuration and pending tables as well as the device and
+ * collection tables of the ITS are still those set up by the root cell before
+ * Jailhouse was enabled. Before the first non-root cell is created, they are
+ * unmapped from the root cell, except for the configuration of the root
+ * cell's own LPIs. The root cell may only place the ITTs of its devices into
+ * its own RAM, and cells cannot be created over them.
+ *
+ * A two-level device table is supported if the ITS accesses it coherently.
+ * Its first-level table is emulated for the root cell as well, and the
+ * second-level tables present at that point are unmapped. Further second-level
+ * tables are allocated by the hypervisor when the root cell or a non-root cell
+ * first needs them. The root cell's view of the first-level table is restored
+ * on shutdown. Other two-level tables cannot be protected, so non-root cells
+ * cannot use the ITS with them.
+ *
+ * Non-root cells receive a virtual view of their redistributor LPI registers.
+ * The ITS device ID of a PCI device is assumed to be its BDF.
+ */
+
+#include <jailhouse/cell.h>
+#include <jailhouse/control.h>
+#include <jailhouse/mmio.h>
+#include <jailhouse/paging.h>
+#include <jailhouse/pci.h>
+#include <jailhouse/printk.h>
+#include <jailhouse/string.h>
+#include <jailhouse/unit.h>
+#include <jailhouse/utils.h>
+#include <asm/gic.h>
+#include <asm/gic_v3.h>
+
+#define ITS_CTRL_SIZE		0x10000
+
+#define ITS_CMD_SIZE		32
+#define ITS_CMDQ_PAGES		1
+#define ITS_CMDQ_ENTRIES	(ITS_CMDQ_PAGES * PAGE_SIZE / ITS_CMD_SIZE)
+
+/* Up to 2048 MSIs per device */
+#define ITS_MAX_EVENT_BITS	11
+
+#define LPI_BASE		8192
+
+/* Ranges of root cell RAM that the ITS uses, see its_add_table */
+#define ITS_MAX_TABLES		(8 + 1 + hypervisor_header.max_cpus + \
+				 its.dev_l1_entries)
+
+#define ITS_ROOT_ITTS		(PAGE_SIZE / sizeof(struct its_root_itt))
+
+#define GITS_CMD_MOVI		0x01
+#define GITS_CMD_INT		0x03
+#define GITS_CMD_CLEAR		0x04
+#define GITS_CMD_SYNC		0x05
+#define GITS_CMD_MAPD		0x08
+#define GITS_CMD_MAPC		0x09
+#define GITS_CMD_MAPTI		0x0a
+#define GITS_CMD_MAPI		0x0b
+#define GITS_CMD_INV		0x0c
+#define GITS_CMD_INVALL		0x0d
+#define GITS_CMD_MOVALL		0x0e
+#define GITS_CMD_DISCARD	0x0f
+
+#define GITS_CMD_VALID		(1ULL << 63)
+#define GITS_CMD_ITT_ADDR_MASK	0x000fffffffffff00ULL
+#define GITS_CMD_RDBASE_MASK	0x000fffffffff0000ULL
+#define GITS_CMD_SIZE_MASK	0x1f
+
+struct its_cmd {
+	u64 raw[4];
+};
+
+struct its_event {
+	/** Virtual LPI, 0 if the event is not mapped. */
+	u16 vlpi;
+	/** Physical LPI backing the virtual one. */
+	u16 plpi;
+	/** Virtual collection the event is mapped to. */
+	u16 vicid;
+};
+
+struct its_device {
+	/** Number of event ID bits, 0 if the device is not mapped. */
+	unsigned int event_bits;
+	/** Interrupt translation table, owned by the ITS. */
+	void *itt;
+	struct its_event *events;
+};
+
+/** Interrupt translation table of a root cell device. */
+struct its_root_itt {
+	u32 devid;
+	unsigned long addr;
+	/** Size of the table, 0 if the slot is unused. */
+	unsigned long size;
+};
+
+static struct {
+	/** Number of LPI ID bits usable by the cells. */
+	unsigned int id_bits;
+	/** First physical LPI reserved for non-root cells. */
+	unsigned int pool_base;
+	/** First collection reserved for the hypervisor, one per CPU. */
+	unsigned int icid_base;
+	unsigned int itt_entry_size;
+	u64 typer;
+
+	/** Physical command queue. */
+	struct its_cmd *cmdq;
+	unsigned int cmdq_prod;
+	unsigned int cmdq_pending;
+	bool cmdq_noncoherent;
+
+	/** Allocation state of the LPI pool. */
+	unsigned long *lpi_bitmap;
+	/** Virtual LPI of each pool LPI, 0 if unused. */
+	u16 *lpi_vmap;
+	/** Mapping of the pool part of the LPI configuration table. */
+	u8 *lpi_config;
+
+	/** Tables of the ITS and the redistributors in root cell RAM. */
+	struct jailhouse_memory *tables;
+	unsigned int num_tables;
+	/** Number of tables known since initialization. */
+	unsigned int num_init_tables;
+	/** True once the tables are unmapped from the root cell. */
+	bool tables_protected;
+	/** True if some table is two-level and cannot be protected. */
+	bool tables_indirect;
+
+	/** First-level device table if it is two-level, otherwise NULL. */
+	u64 *dev_l1;
+	/** First-level device table entries as written by the root cell. */
+	u64 *dev_l1_root;
+	unsigned long dev_l1_phys;
+	unsigned int dev_l1_entries;
+	/** Index of the GITS_BASER register describing the device table. */
+	unsigned int dev_baser;
+	/** Size of a second-level device table. */
+	unsigned long dev_l2_size;
+	/** Number of device IDs covered by a second-level table. */
+	unsigned int dev_l2_ids;
+
+	/** ITTs of the root cell's devices. */
+	struct its_root_itt *root_itts;
+} its;
+
+static void *its_base;
+static spinlock_t its_lock;
+
+static inline u8 its_cmd_opcode(const struct its_cmd *cmd)
+{
+	return cmd->raw[0] & 0xff;
+}
+
+static inline u32 its_cmd_devid(const struct its_cmd *cmd)
+{
+	return cmd->raw[0] >> 32;
+}
+
+static inline u32 its_cmd_event(const struct its_cmd *cmd)
+{
+	return (u32)cmd->raw[1];
+}
+
+static inline u16 its_cmd_icid(const struct its_cmd *cmd)
+{
+	return cmd->raw[2] & 0xffff;
+}
+
+static void *its_map_memory(unsigned long phys, unsigned long size)
+{
+	unsigned long offs = phys & PAGE_OFFS_MASK;
+	void *virt;
+
+	size = PAGE_ALIGN(size + offs);
+	virt = page_alloc(&remap_pool, PAGES(size));
+	if (!virt)
+		return NULL;
+
+	if (paging_create(&hv_paging_structs, phys - offs, size,
+			  (unsigned long)virt, PAGE_DEFAULT_FLAGS,
+			  PAGING_NON_COHERENT | PAGING_HUGE) != 0) {
+		page_free(&remap_pool, virt, PAGES(size));
+		return NULL;
+	}
+
+	return virt + offs;
+}
+
+static int its_cmdq_sync(void)
+{
+	u64 creadr;
+
+	if (its.cmdq_pending == 0)
+		return 0;
+
+	/* Ensure the commands are visible before publishing them. */
+	dsb(ishst);
+	mmio_write64(its_base + GITS_CWRITER, its.cmdq_prod);
+
+	do {
+		creadr = mmio_read64(its_base + GITS_CREADR);
+		if (creadr & GITS_CREADR_Stalled) {
+			printk("ITS: command queue stalled at offset 0x%llx\n",
+			       creadr & GITS_CMDQ_OFFSET_MASK);
+			return -EIO;
+		}
+		cpu_relax();
+	} while ((creadr & GITS_CMDQ_OFFSET_MASK) != its.cmdq_prod);
+
+	its.cmdq_pending = 0;
+
+	return 0;
+}
+
+static int its_cmdq_push(const struct its_cmd *cmd)
+{
+	struct its_cmd *slot;
+	int err;
+
+	/* Drain the queue when there is no free slot left. */
+	if (its.cmdq_pending == ITS_CMDQ_ENTRIES - 1) {
+		err = its_cmdq_sync();
+		if (err)
+			return err;
+	}
+
+	slot = (void *)its.cmdq + its.cmdq_prod;
+	memcpy(slot, cmd, sizeof(*slot));
+	if (its.cmdq_noncoherent)
+		arm_dcaches_flush(slot, sizeof(*slot), DCACHE_CLEAN);
+
+	its.cmdq_prod = (its.cmdq_prod + ITS_CMD_SIZE) %
+		(ITS_CMDQ_ENTRIES * ITS_CMD_SIZE);
+	its.cmdq_pending++;
+
+	return 0;
+}
+
+static u64 its_rdbase(unsigned int cpu)
+{
+	void *gicr = public_per_cpu(cpu)->gicr.base;
+
+	if (its.typer & GITS_TYPER_PTA)
+		return public_per_cpu(cpu)->gicr.phys_addr;
+
+	/* Processor_Number as reported by the redistributor */
+	return ((mmio_read64(gicr + GICR_TYPER) >> 8) & 0xffff) << 16;
+}
+
+static int its_rdbase_to_cpu(struct cell *cell, u64 rdbase)
+{
+	unsigned int cpu;
+
+	rdbase &= GITS_CMD_RDBASE_MASK;
+	for_each_cpu(cpu, cell->cpu_set)
+		if (its_rdbase(cpu) == rdbase)
+			return cpu;
+
+	return -1;
+}
+
+static int its_collection_cpu(struct cell *cell, u16 icid)
+{
+	if (icid >= ARRAY_SIZE(cell->arch.its.collections))
+		return -1;
+
+	return (int)cell->arch.its.collections[icid] - 1;
+}
+
+static bool its_ranges_overlap(unsigned long start1, unsigned long size1,
+			       unsigned long start2, unsigned long size2)
+{
+	return start1 < start2 + size2 && start2 < start1 + size1;
+}
+
+static bool its_tables_overlap(unsigned long addr, unsigned long size)
+{
+	unsigned int n;
+
+	for (n = 0; n < its.num_tables; n++)
+		if (its_ranges_overlap(addr, size, its.tables[n].phys_start,
+				       its.tables[n].size))
+			return true;
+
+	return false;
+}
+
+static bool its_root_itts_overlap(unsigned long addr, unsigned long size)
+{
+	unsigned int n;
+
+	for (n = 0; n < ITS_ROOT_ITTS; n++)
+		if (its.root_itts[n].size &&
+		    its_ranges_overlap(addr, size, its.root_itts[n].addr,
+				       its.root_itts[n].size))
+			return true;
+
+	return false;
+}
+
+/*
+ * Check that the ITS may write to a range on behalf of the root cell: it has
+ * to be RAM of the root cell that is neither used by a non-root cell nor by
+ * the tables of the ITS.
+ */
+static bool its_root_ram(unsigned long addr, unsigned long size)
+{
+	const struct jailhouse_memory *mem;
+	bool in_ram = false;
+	struct cell *cell;
+	unsigned int n;
+
+	for_each_mem_region(mem, root_cell.config, n)
+		if ((mem->flags & (JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE |
+				   JAILHOUSE_MEM_IO)) ==
+		    (JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE) &&
+		    addr >= mem->phys_start &&
+		    addr + size <= mem->phys_start + mem->size)
+			in_ram = true;
+	if (!in_ram)
+		return false;
+
+	for_each_non_root_cell(cell)
+		for_each_mem_region(mem, cell->config, n)
+			if (!(mem->flags & JAILHOUSE_MEM_COMM_REGION) &&
+			    its_ranges_overlap(addr, size, mem->phys_start,
+					       mem->size))
+				return false;
+
+	return !its_tables_overlap(addr, size);
+}
+
+static bool its_dev_l1_valid(u32 devid)
+{
+	unsigned long index = devid / its.dev_l2_ids;
+
+	return index < its.dev_l1_entries &&
+		its.dev_l1[index] & GITS_BASER_Valid;
+}
+
+/*
+ * Back an entry of the first-level device table by a second-level table of
+ * the hypervisor unless it is already valid. Valid entries are never changed
+ * while the ITS is enabled.
+ */
+static int its_dev_l2_alloc(unsigned int index)
+{
+	void *l2;
+
+	if (its.dev_l1[index] & GITS_BASER_Valid)
+		return 0;
+
+	l2 = page_alloc_aligned(&mem_pool, PAGES(its.dev_l2_size));
+	if (!l2)
+		return -ENOMEM;
+	memset(l2, 0, its.dev_l2_size);
+
+	/* The ITS may access the table bypassing our caches. */
+	arm_dcaches_flush(l2, its.dev_l2_size, DCACHE_CLEAN_AND_INVALIDATE);
+
+	its.dev_l1[index] = paging_hvirt2phys(l2) | GITS_BASER_Valid;
+	dsb(ishst);
+
+	return 0;
+}
+
+static bool its_root_owns_device(u32 devid)
+{
+	struct pci_device *device;
+	struct cell *cell;
+
+	if (devid > 0xffff)
+		return true;
+
+	for_each_non_root_cell(cell) {
+		device = pci_get_assigned_device(cell, devid);
+		if (device && device->info->type == JAILHOUSE_PCI_TYPE_DEVICE)
+			return false;
+	}
+
+	return true;
+}
+
+static struct its_device *its_cell_device(struct cell *cell, u32 devid)
+{
+	struct pci_device *device;
+
+	if (devid > 0xffff)
+		return NULL;
+
+	device = pci_get_assigned_device(cell, devid);
+	if (!device || device->info->type != JAILHOUSE_PCI_TYPE_DEVICE)
+		return NULL;
+
+	return &cell->arch.its.devices[device - cell->pci_devices];
+}
+
+static struct its_event *its_cell_event(struct cell *cell,
+					const struct its_cmd *cmd)
+{
+	struct its_device *dev = its_cell_device(cell, its_cmd_devid(cmd));
+	u32 event = its_cmd_event(cmd);
+
+	if (!dev || !dev->events || event >= (1U << dev->event_bits))
+		return NULL;
+
+	return &dev->events[event];
+}
+
+static void its_write_lpi_config(unsigned int plpi, u8 config)
+{
+	u8 *entry = &its.lpi_config[plpi - its.pool_base];
+
+	*entry = config;
+	arm_dcaches_flush(entry, sizeof(*entry), DCACHE_CLEAN);
+}
+
+/*
+ * Copy the configuration of the event's virtual LPI from the cell's property
+ * table to the physical one.
+ */
+static void its_sync_lpi_config(struct cell *cell, struct its_event *ev)
+{
+	u64 propbaser = cell->arch.its.propbaser;
+	unsigned long addr;
+	u8 config = 0;
+	void *page;
+
+	if (propbaser &&
+	    ev->vlpi < (2UL << (propbaser & GICR_PROPBASER_IDbits_MASK))) {
+		addr = (propbaser & GICR_PROPBASER_ADDR_MASK) + ev->vlpi -
+			LPI_BASE;
+		page = paging_get_guest_pages(NULL, addr, 1,
+					      PAGE_READONLY_FLAGS);
+		if (page)
+			config = *(u8 *)(page + (addr & PAGE_OFFS_MASK));
+	}
+
+	its_write_lpi_config(ev->plpi, config);
+}
+
+static int its_alloc_lpi(void)
+{
+	unsigned int pool_size = its.pool_base;
+	unsigned int n, bit;
+
+	for (n = 0; n < pool_size / BITS_PER_LONG; n++) {
+		if (~its.lpi_bitmap[n]) {
+			bit = ffzl(its.lpi_bitmap[n]);
+			set_bit(bit, &its.lpi_bitmap[n]);
+			return its.pool_base + n * BITS_PER_LONG + bit;
+		}
+	}
+
+	printk("ITS: out of LPIs\n");
+	return -ENOMEM;
+}
+
+static void its_free_lpi(struct its_event *ev)
+{
+	unsigned int index = ev->plpi - its.pool_base;
+
+	its.lpi_vmap[index] = 0;
+	its_write_lpi_config(ev->plpi, 0);
+	clear_bit(index, its.lpi_bitmap);
+	ev->vlpi = 0;
+}
+
+static int its_unmap_device(struct its_device *dev, u32 devid)
+{
+	struct its_cmd cmd = {
+		.raw = { GITS_CMD_MAPD | (u64)devid << 32, 0, 0, 0 },
+	};
+	unsigned int n, num_events = 1U << dev->event_bits;
+	int err;
+
+	for (n = 0; n < num_events; n++)
+		if (dev->events[n].vlpi)
+			its_free_lpi(&dev->events[n]);
+
+	/* The ITS must no longer use the ITT when it is released. */
+	err = its_cmdq_push(&cmd);
+	if (!err)
+		err = its_cmdq_sync();
+
+	page_free(&mem_pool, dev->itt,
+		  PAGES(num_events * its.itt_entry_size));
+	page_free(&mem_pool, dev->events,
+		  PAGES(num_events * sizeof(struct its_event)));
+	dev->itt = NULL;
+	dev->events = NULL;
+	dev->event_bits = 0;
+
+	return err;
+}
+
+static int its_map_device(struct cell *cell, struct its_cmd *cmd)
+{
+	struct its_device *dev = its_cell_device(cell, its_cmd_devid(cmd));
+	unsigned int event_bits = (cmd->raw[1] & GITS_CMD_SIZE_MASK) + 1;
+	unsigned int itt_size, num_events;
+	int err;
+
+	if (!dev)
+		return -EINVAL;
+
+	if (dev->events) {
+		err = its_unmap_device(dev, its_cmd_devid(cmd));
+		if (err)
+			return err;
+	}
+
+	if (!(cmd->raw[2] & GITS_CMD_VALID))
+		return 0;
+
+	if (event_bits > ITS_MAX_EVENT_BITS)
+		return -EINVAL;
+
+	if (its.dev_l1) {
+		err = its_dev_l2_alloc(its_cmd_devid(cmd) / its.dev_l2_ids);
+		if (err)
+			return err;
+	}
+
+	num_events = 1U << event_bits;
+	itt_size = num_events * its.itt_entry_size;
+
+	dev->itt = page_alloc(&mem_pool, PAGES(itt_size));
+	dev->events = page_alloc(&mem_pool,
+				 PAGES(num_events * sizeof(struct its_event)));
+	if (!dev->itt || !dev->events) {
+		page_free(&mem_pool, dev->itt, PAGES(itt_size));
+		page_free(&mem_pool, dev->events,
+			  PAGES(num_events * sizeof(struct its_event)));
+		dev->itt = NULL;
+		dev->events = NULL;
+		return -ENOMEM;
+	}
+	dev->event_bits = event_bits;
+
+	/* The ITS may access the table bypassing our caches. */
+	arm_dcaches_flush(dev->itt, itt_size, DCACHE_CLEAN_AND_INVALIDATE);
+
+	cmd->raw[2] = GITS_CMD_VALID | paging_hvirt2phys(dev->itt);
+
+	return its_cmdq_push(cmd);
+}
+
+static int its_map_event(struct cell *cell, struct its_cmd *cmd, u32 vlpi)
+{
+	struct its_event *ev = its_cell_event(cell, cmd);
+	u16 icid = its_cmd_icid(cmd);
+	int cpu = its_collection_cpu(cell, icid);
+	int plpi, err;
+
+	if (!ev || cpu < 0 || vlpi < LPI_BASE || vlpi >= (1U << its.id_bits))
+		return -EINVAL;
+
+	if (ev->vlpi)
+		its_free_lpi(ev);
+
+	plpi = its_alloc_lpi();
+	if (plpi < 0)
+		return plpi;
+
+	ev->vlpi = vlpi;
+	ev->plpi = plpi;
+	ev->vicid = icid;
+	its.lpi_vmap[plpi - its.pool_base] = vlpi;
+	its_sync_lpi_config(cell, ev);
+
+	cmd->raw[0] = GITS_CMD_MAPTI | (u64)its_cmd_devid(cmd) << 32;
+	cmd->raw[1] = its_cmd_event(cmd) | (u64)plpi << 32;
+	cmd->raw[2] = its.icid_base + cpu;
+	err = its_cmdq_push(cmd);
+	if (err)
+		return err;
+
+	/* Redistributors may still cache the configuration of a former user */
+	cmd->raw[0] = GITS_CMD_INV | (u64)its_cmd_devid(cmd) << 32;
+	cmd->raw[2] = 0;
+
+	return its_cmdq_push(cmd);
+}
+
+/*
+ * Apply fn to all mapped events of the cell that belong to collection icid.
+ */
+static int its_for_each_event(struct cell *cell, u16 icid,
+			      int (*fn)(struct cell *cell, unsigned int devid,
+					unsigned int event,
+					struct its_event *ev))
+{
+	const struct jailhouse_pci_device *dev_info =
+		jailhouse_cell_pci_devices(cell->config);
+	struct its_device *dev;
+	unsigned int n, event;
+	int err;
+
+	for (n = 0; n < cell->config->num_pci_devices; n++) {
+		dev = &cell->arch.its.devices[n];
+		if (!dev->events)
+			continue;
+		for (event = 0; event < (1U << dev->event_bits); event++) {
+			if (!dev->events[event].vlpi ||
+			    dev->events[event].vicid != icid)
+				continue;
+			err = fn(cell, dev_info[n].bdf, event,
+				 &dev->events[event]);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+static int its_move_event(struct cell *cell, unsigned int devid,
+			  unsigned int event, struct its_event *ev)
+{
+	struct its_cmd cmd = {
+		.raw = {
+			GITS_CMD_MOVI | (u64)devid << 32, event,
+			its.icid_base + its_collection_cpu(cell, ev->vicid), 0
+		},
+	};
+
+	return its_cmdq_push(&cmd);
+}
+
+static int its_sync_event_config(struct cell *cell, unsigned int devid,
+				 unsigned int event, struct its_event *ev)
+{
+	its_sync_lpi_config(cell, ev);
+	return 0;
+}
+
+static int its_map_collection(struct cell *cell, struct its_cmd *cmd)
+{
+	u16 icid = its_cmd_icid(cmd);
+	int cpu;
+
+	if (icid >= ARRAY_SIZE(cell->arch.its.collections))
+		return -EINVAL;
+
+	if (!(cmd->raw[2] & GITS_CMD_VALID)) {
+		cell->arch.its.collections[icid] = 0;
+		return 0;
+	}
+
+	cpu = its_rdbase_to_cpu(cell, cmd->raw[2]);
+	if (cpu < 0)
+		return -EINVAL;
+
+	cell->arch.its.collections[icid] = cpu + 1;
+
+	/* Retarget events that are already mapped to this collection. */
+	return its_for_each_event(cell, icid, its_move_event);
+}
+
+static int its_translate_cmd(struct cell *cell, struct its_cmd *cmd)
+{
+	struct its_event *ev;
+	u16 icid;
+	int cpu, err;
+
+	switch (its_cmd_opcode(cmd)) {
+	case GITS_CMD_MAPD:
+		return its_map_device(cell, cmd);
+	case GITS_CMD_MAPC:
+		return its_map_collection(cell, cmd);
+	case GITS_CMD_MAPTI:
+		return its_map_event(cell, cmd, cmd->raw[1] >> 32);
+	case GITS_CMD_MAPI:
+		return its_map_event(cell, cmd, its_cmd_event(cmd));
+	case GITS_CMD_MOVI:
+		ev = its_cell_event(cell, cmd);
+		icid = its_cmd_icid(cmd);
+		cpu = its_collection_cpu(cell, icid);
+		if (!ev || !ev->vlpi || cpu < 0)
+			return -EINVAL;
+		ev->vicid = icid;
+		cmd->raw[2] = its.icid_base + cpu;
+		return its_cmdq_push(cmd);
+	case GITS_CMD_INV:
+		ev = its_cell_event(cell, cmd);
+		if (!ev || !ev->vlpi)
+			return -EINVAL;
+		its_sync_lpi_config(cell, ev);
+		return its_cmdq_push(cmd);
+	case GITS_CMD_INVALL:
+		icid = its_cmd_icid(cmd);
+		cpu = its_collection_cpu(cell, icid);
+		if (cpu < 0)
+			return -EINVAL;
+		err = its_for_each_event(cell, icid, its_sync_event_config);
+		if (err)
+			return err;
+		cmd->raw[2] = its.icid_base + cpu;
+		return its_cmdq_push(cmd);
+	case GITS_CMD_DISCARD:
+		ev = its_cell_event(cell, cmd);
+		if (!ev || !ev->vlpi)
+			return -EINVAL;
+		err = its_cmdq_push(cmd);
+		if (!err)
+			its_free_lpi(ev);
+		return err;
+	case GITS_CMD_INT:
+	case GITS_CMD_CLEAR:
+		ev = its_cell_event(cell, cmd);
+		if (!ev || !ev->vlpi)
+			return -EINVAL;
+		return its_cmdq_push(cmd);
+	case GITS_CMD_SYNC:
+		if (its_rdbase_to_cpu(cell, cmd->raw[2]) < 0)
+			return -EINVAL;
+		return its_cmdq_push(cmd);
+	default:
+		/* MOVALL and GICv4 commands are not supported. */
+		return -EINVAL;
+	}
+}
+
+/*
+ * Validate the ITT of a root cell device and keep track of it so that no cell
+ * can be created over it later on.
+ */
+static int its_map_root_itt(const struct its_cmd *cmd)
+{
+	unsigned int event_bits = (cmd->raw[1] & GITS_CMD_SIZE_MASK) + 1;
+	struct its_root_itt *itt = NULL, *slot;
+	u32 devid = its_cmd_devid(cmd);
+	unsigned long addr, size;
+	unsigned int n;
+
+	for (n = 0; n < ITS_ROOT_ITTS; n++) {
+		slot = &its.root_itts[n];
+		if (slot->size && slot->devid == devid) {
+			itt = slot;
+			break;
+		}
+		if (!slot->size && !itt)
+			itt = slot;
+	}
+
+	if (!(cmd->raw[2] & GITS_CMD_VALID)) {
+		if (itt && itt->size && itt->devid == devid)
+			itt->size = 0;
+		return 0;
+	}
+
+	if (event_bits > its.id_bits)
+		return -EINVAL;
+
+	addr = cmd->raw[2] & GITS_CMD_ITT_ADDR_MASK;
+	size = (1UL << event_bits) * its.itt_entry_size;
+	if (!its_root_ram(addr, size))
+		return -EINVAL;
+
+	if (!itt) {
+		printk("ITS: too many devices of the root cell\n");
+		return -ENOMEM;
+	}
+
+	itt->devid = devid;
+	itt->addr = addr;
+	itt->size = size;
+
+	return 0;
+}
+
+static int its_check_root_cmd(const struct its_cmd *cmd)
+{
+	u16 icid = its_cmd_icid(cmd);
+	u32 lpi;
+
+	switch (its_cmd_opcode(cmd)) {
+	case GITS_CMD_MAPD:
+		if (!its_root_owns_device(its_cmd_devid(cmd)))
+			return -EINVAL;
+		/* The ITS cannot store the mapping without a second level. */
+		if (its.dev_l1 && !its_dev_l1_valid(its_cmd_devid(cmd)))
+			return -EINVAL;
+		return its_map_root_itt(cmd);
+	case GITS_CMD_INV:
+	case GITS_CMD_INT:
+	case GITS_CMD_CLEAR:
+	case GITS_CMD_DISCARD:
+		return its_root_owns_device(its_cmd_devid(cmd)) ? 0 : -EINVAL;
+	case GITS_CMD_MAPTI:
+	case GITS_CMD_MAPI:
+		if (its_cmd_opcode(cmd) == GITS_CMD_MAPTI)
+			lpi = cmd->raw[1] >> 32;
+		else
+			lpi = its_cmd_event(cmd);
+		if (lpi < LPI_BASE || lpi >= its.pool_base)
+			return -EINVAL;
+		/* fall through */
+	case GITS_CMD_MOVI:
+		if (!its_root_owns_device(its_cmd_devid(cmd)))
+			return -EINVAL;
+		/* fall through */
+	case GITS_CMD_INVALL:
+		return icid < its.icid_base ? 0 : -EINVAL;
+	case GITS_CMD_MAPC:
+		if (icid >= its.icid_base)
+			return -EINVAL;
+		if ((cmd->raw[2] & GITS_CMD_VALID) &&
+		    its_rdbase_to_cpu(&root_cell, cmd->raw[2]) < 0)
+			return -EINVAL;
+		return 0;
+	case GITS_CMD_SYNC:
+		return 0;
+	case GITS_CMD_MOVALL:
+		if (its_rdbase_to_cpu(&root_cell, cmd->raw[2]) < 0 ||
+		    its_rdbase_to_cpu(&root_cell, cmd->raw[3]) < 0)
+			return -EINVAL;
+		return 0;
+	default:
+		/* GICv4 commands are not supported. */
+		return -EINVAL;
+	}
+}
+
+static unsigned long its_vcmdq_size(struct cell *cell)
+{
+	return ((cell->arch.its.cbaser & GITS_BASER_SIZE_MASK) + 1) *
+		PAGE_SIZE;
+}
+
+static enum mmio_result its_process_cmdq(struct cell *cell)
+{
+	unsigned long base = cell->arch.its.cbaser & GITS_BASER_ADDR_MASK;
+	unsigned long size = its_vcmdq_size(cell);
+	struct its_cmd cmd = { .raw = { 0 } };
+	int err = 0, sync_err;
+	void *page;
+
+	if (!cell->arch.its.enabled ||
+	    !(cell->arch.its.cbaser & GITS_BASER_Valid) ||
+	    cell->arch.its.cwriter >= size)
+		return MMIO_HANDLED;
+
+	spin_lock(&its_lock);
+
+	while (cell->arch.its.creadr != cell->arch.its.cwriter) {
+		page = paging_get_guest_pages(NULL,
+					      base + cell->arch.its.creadr, 1,
+					      PAGE_READONLY_FLAGS);
+		if (!page) {
+			err = -EINVAL;
+			break;
+		}
+		memcpy(&cmd, page + ((base + cell->arch.its.creadr) &
+				     PAGE_OFFS_MASK), sizeof(cmd));
+
+		if (cell == &root_cell) {
+			err = its_check_root_cmd(&cmd);
+			if (!err)
+				err = its_cmdq_push(&cmd);
+		} else {
+			err = its_translate_cmd(cell, &cmd);
+		}
+		if (err)
+			break;
+
+		cell->arch.its.creadr += ITS_CMD_SIZE;
+		if (cell->arch.its.creadr == size)
+			cell->arch.its.creadr = 0;
+	}
+
+	/* Commands are completed before the cell can observe CREADR. */
+	sync_err = its_cmdq_sync();
+
+	spin_unlock(&its_lock);
+
+	if (err || sync_err) {
+		printk("ITS: invalid command 0x%02x of cell \"%s\"\n",
+		       its_cmd_opcode(&cmd), cell->config->name);
+		return MMIO_ERROR;
+	}
+
+	return MMIO_HANDLED;
+}
+
+/* Emulate a 32 or 64-bit access to a 64-bit register. */
+static void its_access_reg64(u64 *reg, struct mmio_access *mmio)
+{
+	unsigned int shift = (mmio->address & 4) * 8;
+	u64 mask = mmio->size == 8 ? ~0ULL : 0xffffffffULL << shift;
+
+	if (mmio->is_write)
+		*reg = (*reg & ~mask) | (((u64)mmio->value << shift) & mask);
+	else
+		mmio->value = (*reg & mask) >> shift;
+}
+
+static enum mmio_result its_handle_access(void *arg, struct mmio_access *mmio)
+{
+	struct cell *cell = this_cell();
+	unsigned int baser;
+	u64 reg;
+
+	switch (mmio->address) {
+	case GITS_CTLR:
+		if (mmio->is_write) {
+			cell->arch.its.enabled =
+				!!(mmio->value & GITS_CTLR_Enabled);
+			return its_process_cmdq(cell);
+		}
+		mmio->value = cell->arch.its.enabled ? GITS_CTLR_Enabled :
+			GITS_CTLR_Quiescent;
+		return MMIO_HANDLED;
+	case GITS_TYPER:
+	case GITS_TYPER + 4:
+		/* No GICv4 support, LPI range limited to what we can back */
+		reg = its.typer & ~(GITS_TYPER_Virtual | GITS_TYPER_IDbits_MASK);
+		reg |= (u64)(its.id_bits - 1) << GITS_TYPER_IDbits_SHIFT;
+		if (!mmio->is_write)
+			its_access_reg64(&reg, mmio);
+		return MMIO_HANDLED;
+	case GITS_CBASER:
+	case GITS_CBASER + 4:
+		if (mmio->is_write && cell->arch.its.enabled)
+			return MMIO_HANDLED;
+		its_access_reg64(&cell->arch.its.cbaser, mmio);
+		if (mmio->is_write) {
+			cell->arch.its.creadr = 0;
+			cell->arch.its.cwriter = 0;
+		}
+		return MMIO_HANDLED;
+	case GITS_CWRITER:
+	case GITS_CWRITER + 4:
+		its_access_reg64(&cell->arch.its.cwriter, mmio);
+		if (!mmio->is_write)
+			return MMIO_HANDLED;
+		cell->arch.its.cwriter &= GITS_CMDQ_OFFSET_MASK;
+		return its_process_cmdq(cell);
+	case GITS_CREADR:
+	case GITS_CREADR + 4:
+		reg = cell->arch.its.creadr;
+		if (!mmio->is_write)
+			its_access_reg64(&reg, mmio);
+		return MMIO_HANDLED;
+	case REG_RANGE(GITS_BASER, 16, 4):
+		/*
+		 * The tables of the physical ITS belong to the root cell.
+		 * Non-root cells may program their own, but they are unused.
+		 */
+		baser = (mmio->address - GITS_BASER) / 8;
+		reg = mmio_read64(its_base + GITS_BASER + baser * 8);
+		if (cell == &root_cell) {
+			if (!mmio->is_write)
+				its_access_reg64(&reg, mmio);
+		} else if (GITS_BASER_TYPE(reg) != 0) {
+			its_access_reg64(&cell->arch.its.baser[baser], mmio);
+			cell->arch.its.baser[baser] &= ~GITS_BASER_RO_MASK;
+			cell->arch.its.baser[baser] |= reg & GITS_BASER_RO_MASK;
+		} else {
+			mmio->value = 0;
+		}
+		return MMIO_HANDLED;
+	case GITS_IIDR:
+	case 0xffd0 ... 0xfffc: /* ID registers */
+		if (!mmio->is_write)
+			mmio_perform_access(its_base, mmio);
+		return MMIO_HANDLED;
+	default:
+		/* RAZ/WI */
+		mmio->value = 0;
+		return MMIO_HANDLED;
+	}
+}
+
+/*
+ * Emulate the first-level device table for the root cell once it is
+ * protected. The root cell sees the entries it wrote, but the ITS uses
+ * second-level tables of the hypervisor for entries that were invalid.
+ */
+static enum mmio_result its_handle_dev_l1_access(void *arg,
+						 struct mmio_access *mmio)
+{
+	unsigned int index = mmio->address / sizeof(u64);
+	int err;
+
+	its_access_reg64(&its.dev_l1_root[index], mmio);
+	if (!mmio->is_write || !(its.dev_l1_root[index] & GITS_BASER_Valid))
+		return MMIO_HANDLED;
+
+	spin_lock(&its_lock);
+	err = its_dev_l2_alloc(index);
+	spin_unlock(&its_lock);
+
+	return err ? MMIO_ERROR : MMIO_HANDLED;
+}
+
+/**
+ * Handle a non-root cell's access to the LPI registers of a redistributor.
+ * @param cpu_public	Public per-CPU data of the redistributor's CPU.
+ * @param mmio		MMIO access description.
+ *
+ * @return True if the access was handled.
+ */
+bool gicv3_its_handle_redist_access(struct public_per_cpu *cpu_public,
+				    struct mmio_access *mmio)
+{
+	struct cell *cell = this_cell();
+	void *gicr = cpu_public->gicr.base;
+
+	if (!its_base || cell == &root_cell || cpu_public->cell != cell)
+		return false;
+
+	switch (mmio->address) {
+	case GICR_CTLR:
+		/* LPIs stay physically enabled, only the cell's view changes */
+		if (mmio->is_write) {
+			cpu_public->gicr.lpis_enabled =
+				!!(mmio->value & GICR_CTLR_EnableLPIs);
+			mmio_write32(gicr + GICR_CTLR,
+				     mmio->value | GICR_CTLR_EnableLPIs);
+		} else {
+			mmio->value = mmio_read32(gicr + GICR_CTLR) &
+				~GICR_CTLR_EnableLPIs;
+			if (cpu_public->gicr.lpis_enabled)
+				mmio->value |= GICR_CTLR_EnableLPIs;
+		}
+		return true;
+	case GICR_PROPBASER:
+	case GICR_PROPBASER + 4:
+		if (!mmio->is_write || !cpu_public->gicr.lpis_enabled)
+			its_access_reg64(&cell->arch.its.propbaser, mmio);
+		return true;
+	case GICR_PENDBASER:
+	case GICR_PENDBASER + 4:
+		if (!mmio->is_write || !cpu_public->gicr.lpis_enabled)
+			its_access_reg64(&cpu_public->gicr.pendbaser, mmio);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Translate a physical LPI into the virtual one of the receiving CPU's cell.
+ * @param cpu_public	Public per-CPU data of the receiving CPU.
+ * @param lpi		Physical LPI.
+ *
+ * @return Virtual LPI to inject, 0 if the LPI shall be dropped.
+ */
+u16 gicv3_its_virt_lpi(struct public_per_cpu *cpu_public, u32 lpi)
+{
+	bool root = cpu_public->cell == &root_cell;
+
+	if (!its_base)
+		return lpi;
+
+	if (lpi >= (1U << its.id_bits))
+		return 0;
+
+	if (lpi < its.pool_base)
+		return root ? lpi : 0;
+
+	if (root || !cpu_public->gicr.lpis_enabled)
+		return 0;
+
+	return its.lpi_vmap[lpi - its.pool_base];
+}
+
+static unsigned long its_baser_page_size(u64 baser)
+{
+	/* 4K, 16K, 64K, 64K */
+	return 0x1000 << (MIN(GITS_BASER_PAGE_SIZE(baser), 2) * 2);
+}
+
+static unsigned long its_baser_table_size(u64 baser)
+{
+	return ((baser & GITS_BASER_SIZE_MASK) + 1) *
+		its_baser_page_size(baser);
+}
+
+static unsigned int its_collection_capacity(void)
+{
+	unsigned int n;
+	u64 baser;
+
+	for (n = 0; n < 8; n++) {
+		baser = mmio_read64(its_base + GITS_BASER + n * 8);
+		if (GITS_BASER_TYPE(baser) != GITS_BASER_TYPE_COLLECTION ||
+		    !(baser & GITS_BASER_Valid) || baser & GITS_BASER_Indirect)
+			continue;
+
+		return GITS_TYPER_HCC(its.typer) + its_baser_table_size(baser) /
+			GITS_BASER_ENTRY_SIZE(baser);
+	}
+
+	return GITS_TYPER_HCC(its.typer);
+}
+
+static void its_add_table(unsigned long phys, unsigned long size)
+{
+	struct jailhouse_memory *mem = &its.tables[its.num_tables++];
+
+	mem->phys_start = phys & PAGE_MASK;
+	mem->virt_start = mem->phys_start;
+	mem->size = PAGE_ALIGN(phys + size) - mem->phys_start;
+	mem->flags = JAILHOUSE_MEM_READ | JAILHOUSE_MEM_WRITE;
+}
+
+/*
+ * Collect the tables in root cell RAM that the ITS and the redistributors
+ * write to or that control the LPIs of non-root cells.
+ */
+static void its_collect_tables(u64 propbaser)
+{
+	unsigned int cpu, n;
+	u64 baser;
+
+	for (n = 0; n < 8; n++) {
+		baser = mmio_read64(its_base + GITS_BASER + n * 8);
+		if (GITS_BASER_TYPE(baser) == 0 || !(baser & GITS_BASER_Valid))
+			continue;
+		/* The root cell adds second-level tables at runtime. */
+		if (baser & GITS_BASER_Indirect && n != its.dev_baser) {
+			its.tables_indirect = true;
+			continue;
+		}
+		its_add_table(baser & GITS_BASER_ADDR_MASK,
+			      its_baser_table_size(baser));
+	}
+
+	its_add_table((propbaser & GICR_PROPBASER_ADDR_MASK) + its.pool_base -
+		      LPI_BASE, (1U << its.id_bits) - its.pool_base);
+
+	for_each_cpu(cpu, root_cell.cpu_set)
+		its_add_table(mmio_read64(public_per_cpu(cpu)->gicr.base +
+					  GICR_PENDBASER) &
+			      GICR_PENDBASER_ADDR_MASK,
+			      (2UL << (propbaser & GICR_PROPBASER_IDbits_MASK)) /
+			      8);
+
+	its.num_init_tables = its.num_tables;
+}
+
+/*
+ * Collect the second-level device tables the root cell has added so far. It
+ * is suspended and cannot add further ones before the tables are protected.
+ */
+static void its_collect_dev_l2(void)
+{
+	unsigned int n;
+
+	its.num_tables = its.num_init_tables;
+	for (n = 0; n < its.dev_l1_entries; n++) {
+		its.dev_l1_root[n] = its.dev_l1[n];
+		if (its.dev_l1[n] & GITS_BASER_Valid)
+			its_add_table(its.dev_l1[n] & GITS_BASER_ADDR_MASK,
+				      its.dev_l2_size);
+	}
+}
+
+/*
+ * Unmap the collected tables from the root cell. They are flushed from its
+ * TLBs by the config_commit() that completes the cell creation.
+ */
+static int its_protect_tables(void)
+{
+	struct jailhouse_memory *mem;
+	unsigned int n;
+	int err;
+
+	if (its.tables_protected)
+		return 0;
+
+	for (n = 0; n < its.num_tables; n++) {
+		mem = &its.tables[n];
+		cell_mark_dirty(&root_cell, mem->virt_start, mem->size);
+		err = arch_unmap_memory_region(&root_cell, mem);
+		if (err)
+			return err;
+	}
+	its.tables_protected = true;
+
+	if (its.dev_l1)
+		mmio_region_register(&root_cell, its.dev_l1_phys,
+				     its.dev_l1_entries * sizeof(u64),
+				     its_handle_dev_l1_access, NULL);
+
+	return 0;
+}
+
+/*
+ * Find a two-level device table that can be emulated. It has to be accessed
+ * coherently because the root cell cannot maintain the caches for the
+ * emulated first-level table.
+ */
+static int its_init_dev_l1(void)
+{
+	unsigned int n;
+	u64 baser;
+
+	/* Not a valid GITS_BASER index */
+	its.dev_baser = 8;
+
+	for (n = 0; n < 8; n++) {
+		baser = mmio_read64(its_base + GITS_BASER + n * 8);
+		if (GITS_BASER_TYPE(baser) != GITS_BASER_TYPE_DEVICE ||
+		    (baser & (GITS_BASER_Valid | GITS_BASER_Indirect)) !=
+		    (GITS_BASER_Valid | GITS_BASER_Indirect) ||
+		    !(baser & GITS_BASER_SHAREABILITY_MASK))
+			continue;
+
+		its.dev_baser = n;
+		its.dev_l1_phys = baser & GITS_BASER_ADDR_MASK;
+		its.dev_l1_entries = its_baser_table_size(baser) / sizeof(u64);
+		its.dev_l2_size = its_baser_page_size(baser);
+		its.dev_l2_ids = its.dev_l2_size / GITS_BASER_ENTRY_SIZE(baser);
+
+		its.dev_l1 = its_map_memory(its.dev_l1_phys,
+					    its_baser_table_size(baser));
+		its.dev_l1_root = page_alloc(&mem_pool,
+			PAGES(its.dev_l1_entries * sizeof(u64)));
+		if (!its.dev_l1 || !its.dev_l1_root)
+			return -ENOMEM;
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Hand the first-level device table back to the root cell while the ITS is
+ * disabled. Second-level tables of the hypervisor are copied to those the
+ * root cell provided.
+ */
+static void its_restore_dev_l1(void)
+{
+	unsigned long root_l2, offs;
+	unsigned int n;
+	void *l2, *page;
+	u64 entry;
+
+	for (n = 0; n < its.dev_l1_entries; n++) {
+		if (its.dev_l1[n] == its.dev_l1_root[n])
+			continue;
+
+		entry = its.dev_l1_root[n];
+		root_l2 = entry & GITS_BASER_ADDR_MASK;
+		if (!(entry & GITS_BASER_Valid) ||
+		    !its_root_ram(root_l2, its.dev_l2_size)) {
+			its.dev_l1[n] = 0;
+			continue;
+		}
+
+		if (its.dev_l1[n] & GITS_BASER_Valid) {
+			l2 = paging_phys2hvirt(its.dev_l1[n] &
+					       GITS_BASER_ADDR_MASK);
+			arm_dcaches_flush(l2, its.dev_l2_size,
+					  DCACHE_CLEAN_AND_INVALIDATE);
+			for (offs = 0; offs < its.dev_l2_size;
+			     offs += PAGE_SIZE) {
+				page = paging_get_guest_pages(NULL,
+							      root_l2 + offs, 1,
+							      PAGE_DEFAULT_FLAGS);
+				if (!page)
+					break;
+				memcpy(page, l2 + offs, PAGE_SIZE);
+				arm_dcaches_flush(page, PAGE_SIZE,
+						  DCACHE_CLEAN);
+			}
+		}
+		its.dev_l1[n] = entry;
+	}
+	dsb(ish);
+
+	/* Make the ITS forget cached first-level entries. */
+	mmio_write64(its_base + GITS_BASER + its.dev_baser * 8,
+		     mmio_read64(its_base + GITS_BASER + its.dev_baser * 8));
+}
+
+static int gicv3_its_cell_init(struct cell *cell)
+{
+	const struct jailhouse_pci_device *dev_info =
+		jailhouse_cell_pci_devices(cell->config);
+	struct its_cmd cmd = { .raw = { GITS_CMD_MAPD, 0, 0, 0 } };
+	const struct jailhouse_memory *mem;
+	unsigned int cpu, n;
+	int err = 0;
+
+	if (!its_base)
+		return 0;
+
+	if (!its.tables_protected)
+		its_collect_dev_l2();
+
+	for_each_mem_region(mem, cell->config, n)
+		if (!(mem->flags & JAILHOUSE_MEM_COMM_REGION) &&
+		    (its_tables_overlap(mem->phys_start, mem->size) ||
+		     its_root_itts_overlap(mem->phys_start, mem->size))) {
+			printk("ITS: memory of cell \"%s\" is in use by the "
+			       "ITS\n", cell->config->name);
+			return trace_error(-EINVAL);
+		}
+
+	for (n = 0; n < cell->config->num_pci_devices; n++) {
+		if (dev_info[n].type != JAILHOUSE_PCI_TYPE_DEVICE)
+			continue;
+		if (its.tables_indirect) {
+			printk("ITS: two-level tables, cannot assign "
+			       "devices to non-root cells\n");
+			return trace_error(-EINVAL);
+		}
+		if (its.dev_l1 &&
+		    dev_info[n].bdf / its.dev_l2_ids >= its.dev_l1_entries) {
+			printk("ITS: device table too small for device "
+			       "%02x:%02x.%x\n", PCI_BDF_PARAMS(dev_info[n].bdf));
+			return trace_error(-EINVAL);
+		}
+	}
+
+	err = its_protect_tables();
+	if (err)
+		return err;
+
+	if (cell->config->num_pci_devices) {
+		cell->arch.its.devices = page_alloc(&mem_pool,
+			PAGES(cell->config->num_pci_devices *
+			      sizeof(struct its_device)));
+		if (!cell->arch.its.devices)
+			return -ENOMEM;
+	}
+
+	for (n = 0; n < ARRAY_SIZE(cell->arch.its.baser); n++)
+		cell->arch.its.baser[n] = GITS_BASER_RO_MASK &
+			mmio_read64(its_base + GITS_BASER + n * 8);
+
+	for_each_cpu(cpu, cell->cpu_set) {
+		public_per_cpu(cpu)->gicr.lpis_enabled = false;
+		public_per_cpu(cpu)->gicr.pendbaser = 0;
+	}
+
+	/* Drop translations the root cell may have left behind. */
+	spin_lock(&its_lock);
+	for (n = 0; n < cell->config->num_pci_devices && !err; n++) {
+		if (dev_info[n].type != JAILHOUSE_PCI_TYPE_DEVICE)
+			continue;
+		/* Without a second level, there is no mapping to drop. */
+		if (its.dev_l1 && !its_dev_l1_valid(dev_info[n].bdf))
+			continue;
+		cmd.raw[0] = GITS_CMD_MAPD | (u64)dev_info[n].bdf << 32;
+		err = its_cmdq_push(&cmd);
+	}
+	if (!err)
+		err = its_cmdq_sync();
+	spin_unlock(&its_lock);
+	if (err)
+		return err;
+
+	mmio_region_register(cell, system_config->platform_info.arm.gits_base,
+			     ITS_CTRL_SIZE, its_handle_access, NULL);
+
+	return 0;
+}
+
+static void gicv3_its_cell_exit(struct cell *cell)
+{
+	const struct jailhouse_pci_device *dev_info =
+		jailhouse_cell_pci_devices(cell->config);
+	unsigned int n;
+
+	if (!its_base || !cell->arch.its.devices)
+		return;
+
+	spin_lock(&its_lock);
+	for (n = 0; n < cell->config->num_pci_devices; n++)
+		if (cell->arch.its.devices[n].events)
+			its_unmap_device(&cell->arch.its.devices[n],
+					 dev_info[n].bdf);
+	spin_unlock(&its_lock);
+
+	page_free(&mem_pool, cell->arch.its.devices,
+		  PAGES(cell->config->num_pci_devices *
+			sizeof(struct its_device)));
+}
+
+static unsigned int gicv3_its_mmio_count_regions(struct cell *cell)
+{
+	if (system_config->platform_info.arm.gic_version < 3 ||
+	    !system_config->platform_info.arm.gits_base)
+		return 0;
+
+	/* The root cell may also need the first-level device table. */
+	return cell == &root_cell ? 2 : 1;
+}
+
+static void its_disable(void)
+{
+	u32 ctlr = mmio_read32(its_base + GITS_CTLR);
+
+	mmio_write32(its_base + GITS_CTLR, ctlr & ~GITS_CTLR_Enabled);
+	while (!(mmio_read32(its_base + GITS_CTLR) & GITS_CTLR_Quiescent))
+		cpu_relax();
+}
+
+static void its_enable(void)
+{
+	u32 ctlr = mmio_read32(its_base + GITS_CTLR);
+
+	mmio_write32(its_base + GITS_CTLR, ctlr | GITS_CTLR_Enabled);
+}
+
+static int gicv3_its_init(void)
+{
+	unsigned long gits_phys = system_config->platform_info.arm.gits_base;
+	struct its_cmd cmd = { .raw = { GITS_CMD_MAPC, 0, 0, 0 } };
+	unsigned int cpu, id_bits, pool_size;
+	u64 propbaser, cbaser, cwriter;
+	int err;
+
+	if (system_config->platform_info.arm.gic_version < 3 || !gits_phys)
+		return 0;
+
+	/*
+	 * The root cell has to have set up LPIs already. Without that, it
+	 * cannot use the ITS, and there is nothing we could share.
+	 */
+	for_each_cpu(cpu, root_cell.cpu_set)
+		if (!(mmio_read32(public_per_cpu(cpu)->gicr.base + GICR_CTLR) &
+		      GICR_CTLR_EnableLPIs)) {
+			printk("WARNING: LPIs not enabled, "
+			       "ITS emulation disabled\n");
+			return 0;
+		}
+	propbaser = mmio_read64(this_cpu_public()->gicr.base + GICR_PROPBASER);
+
+	its_base = paging_map_device(gits_phys, ITS_CTRL_SIZE);
+	if (!its_base)
+		return -ENOMEM;
+
+	its.typer = mmio_read64(its_base + GITS_TYPER);
+	its.itt_entry_size = GITS_TYPER_ITT_ENTRY_SIZE(its.typer);
+
+	id_bits = MIN((propbaser & GICR_PROPBASER_IDbits_MASK) + 1,
+		      GITS_TYPER_IDBITS(its.typer));
+	id_bits = MIN(id_bits,
+		      GICD_TYPER_IDBITS(mmio_read32(gicd_base + GICD_TYPER)));
+	/* Virtual and physical LPIs have to fit into 16 bits. */
+	its.id_bits = MIN(id_bits, 16);
+	if (its.id_bits < 15)
+		return trace_error(-EINVAL);
+
+	its.pool_base = 1U << (its.id_bits - 1);
+	pool_size = (1U << its.id_bits) - its.pool_base;
+
+	its.icid_base = hypervisor_header.max_cpus;
+	if (its_collection_capacity() < its.icid_base * 2)
+		return trace_error(-EINVAL);
+
+	err = its_init_dev_l1();
+	if (err)
+		return err;
+
+	its.lpi_bitmap = page_alloc(&mem_pool, PAGES(pool_size / 8));
+	its.lpi_vmap = page_alloc(&mem_pool, PAGES(pool_size * sizeof(u16)));
+	its.lpi_config = its_map_memory((propbaser & GICR_PROPBASER_ADDR_MASK) +
+					its.pool_base - LPI_BASE, pool_size);
+	its.cmdq = page_alloc(&mem_pool, ITS_CMDQ_PAGES);
+	its.tables = page_alloc(&mem_pool,
+		PAGES(ITS_MAX_TABLES * sizeof(struct jailhouse_memory)));
+	its.root_itts = page_alloc(&mem_pool, 1);
+	if (!its.lpi_bitmap || !its.lpi_vmap || !its.lpi_config ||
+	    !its.cmdq || !its.tables || !its.root_itts)
+		return -ENOMEM;
+
+	its_collect_tables(propbaser);
+
+	/* Wait for the root cell's last commands. */
+	cwriter = mmio_read64(its_base + GITS_CWRITER) & GITS_CMDQ_OFFSET_MASK;
+	while ((mmio_read64(its_base + GITS_CREADR) & GITS_CMDQ_OFFSET_MASK) !=
+	       cwriter)
+		cpu_relax();
+
+	root_cell.arch.its.cbaser = mmio_read64(its_base + GITS_CBASER);
+	root_cell.arch.its.cwriter = cwriter;
+	root_cell.arch.its.creadr = cwriter;
+	root_cell.arch.its.enabled =
+		!!(mmio_read32(its_base + GITS_CTLR) & GITS_CTLR_Enabled);
+
+	/*
+	 * Switch the ITS to our command queue. MSIs arriving while it is
+	 * disabled are lost.
+	 */
+	its_disable();
+
+	cbaser = paging_hvirt2phys(its.cmdq) | GITS_BASER_Valid |
+		GITS_BASER_InnerWaWb | GITS_BASER_InnerShareable |
+		(ITS_CMDQ_PAGES - 1);
+	mmio_write64(its_base + GITS_CBASER, cbaser);
+	its.cmdq_noncoherent = !(mmio_read64(its_base + GITS_CBASER) &
+				 GITS_BASER_SHAREABILITY_MASK);
+	mmio_write64(its_base + GITS_CWRITER, 0);
+
+	its_enable();
+
+	/* Collections for the LPIs of non-root cells, one per CPU */
+	for_each_cpu(cpu, root_cell.cpu_set) {
+		cmd.raw[2] = GITS_CMD_VALID | its_rdbase(cpu) |
+			(its.icid_base + cpu);
+		err = its_cmdq_push(&cmd);
+		if (err)
+			return err;
+	}
+	err = its_cmdq_sync();
+	if (err)
+		return err;
+
+	mmio_region_register(&root_cell, gits_phys, ITS_CTRL_SIZE,
+			     its_handle_access, NULL);
+
+	return 0;
+}
+
+static void gicv3_its_shutdown(void)
+{
+	unsigned long base = root_cell.arch.its.cbaser & GITS_BASER_ADDR_MASK;
+	struct its_cmd cmd = {
+		.raw = { GITS_CMD_SYNC, 0, 0, 0 },
+	};
+	unsigned long offs;
+	void *page;
+
+	if (!its_base)
+		return;
+
+	/*
+	 * Writing CBASER resets CREADR. To continue where the root cell
+	 * stopped, the ITS has to consume the already processed part of its
+	 * queue once more. Replace those commands with SYNCs.
+	 */
+	cmd.raw[2] = its_rdbase(this_cpu_id());
+	for (offs = 0; offs < root_cell.arch.its.cwriter; offs += ITS_CMD_SIZE) {
+		page = paging_get_guest_pages(NULL, base + offs, 1,
+					      PAGE_DEFAULT_FLAGS);
+		if (!page)
+			continue;
+		page += (base + offs) & PAGE_OFFS_MASK;
+		memcpy(page, &cmd, sizeof(cmd));
+		arm_dcaches_flush(page, sizeof(cmd), DCACHE_CLEAN);
+	}
+
+	its_disable();
+
+	if (its.dev_l1 && its.tables_protected)
+		its_restore_dev_l1();
+
+	mmio_write64(its_base + GITS_CBASER, root_cell.arch.its.cbaser);
+	mmio_write64(its_base + GITS_CWRITER, root_cell.arch.its.cwriter);
+
+	if (root_cell.arch.its.enabled) {
+		its_enable();
+		while ((mmio_read64(its_base + GITS_CREADR) &
+			GITS_CMDQ_OFFSET_MASK) != root_cell.arch.its.cwriter)
+			cpu_relax();
+	}
+}
+
+DEFINE_UNIT(gicv3_its, "GICv3 ITS");
@@ -350,6 +350,9 @@ static enum mmio_result gicv3_handle_redist_access(void *arg,
 	struct public_per_cpu *cpu_public = arg;
 	unsigned int mnt_irq = system_config->platform_info.arm.maintenance_irq;
 
+	if (gicv3_its_handle_redist_access(cpu_public, mmio))
+		return MMIO_HANDLED;
+
 	switch (mmio->address) {
 	case GICR_TYPER:
 		mmio_perform_access(cpu_public->gicr.base, mmio);
@@ -534,16 +537,48 @@ static void gicv3_eoi_irq(u32 irq_id, bool deactivate)
 		arm_write_sysreg(ICC_DIR_EL1, irq_id);
 }
 
+static u8 gicv3_get_irq_priority(u16 irq_id)
+{
+	u8 prio;
+
+	if (is_spi(irq_id))
+		prio = mmio_read8(gicd_base + GICD_IPRIORITYR + irq_id);
+	else if (is_sgi(irq_id) || is_ppi(irq_id))
+		prio = mmio_read8(this_cpu_public()->gicr.base +
+				  GICR_SGI_BASE + GICR_IPRIORITYR + irq_id);
+	else
+		/*
+		 * LPI priorities live in a configuration table in cell memory,
+		 * keep injecting those with the highest priority.
+		 */
+		return 0;
+
+	/* Only the upper bits are implemented in the list registers. */
+	return prio & (0xff << (8 - gic_num_priority_bits));
+}
+
+static u64 gicv3_read_free_lrs(struct per_cpu *cpu_data)
+{
+	u32 elsr;
+
+	if (!cpu_data->lr_free_valid) {
+		arm_read_sysreg(ICH_ELSR_EL2, elsr);
+		cpu_data->lr_free = elsr;
+		cpu_data->lr_free_valid = true;
+	}
+	return cpu_data->lr_free;
+}
+
 static int gicv3_inject_irq(u16 irq_id, u16 sender)
 {
+	struct per_cpu *cpu_data = this_cpu_data();
+	u64 free_lrs = gicv3_read_free_lrs(cpu_data);
 	unsigned int n;
 	int free_lr = -1;
-	u32 elsr;
 	u64 lr;
 
-	arm_read_sysreg(ICH_ELSR_EL2, elsr);
 	for (n = 0; n < gic_num_lr; n++) {
-		if ((elsr >> n) & 1) {
+		if ((free_lrs >> n) & 1) {
 			/* Entry is invalid, candidate for injection */
 			if (free_lr == -1)
 				free_lr = n;
@@ -552,15 +587,13 @@ static int gicv3_inject_irq(u16 irq_id, u16 sender)
 
 		/*
 		 * Entry is in use, check that it doesn't match the one we want
-		 * to inject.
-		 */
-		lr = gicv3_read_lr(n);
-
-		/*
+		 * to inject. The cached ID is updated on every write to the
+		 * list register, so there is no need to read it.
+		 *
 		 * A strict phys->virt id mapping is used for SPIs, so this test
 		 * should be sufficient.
 		 */
-		if ((u32)lr == irq_id)
+		if (cpu_data->lr_irq[n] == irq_id)
 			return -EEXIST;
 	}
 
@@ -572,17 +605,62 @@ static int gicv3_inject_irq(u16 irq_id, u16 sender)
 	/* Only group 1 interrupts */
 	lr |= ICH_LR_GROUP_BIT;
 	lr |= ICH_LR_PENDING;
-	if (!is_sgi(irq_id)) {
+	lr |= (u64)gicv3_get_irq_priority(irq_id) << ICH_LR_PRIORITY_SHIFT;
+	/* LPIs have no active state that could be linked to the LR. */
+	if (is_ppi(irq_id) || is_spi(irq_id)) {
 		lr |= ICH_LR_HW_BIT;
 		lr |= (u64)irq_id << ICH_LR_PHYS_ID_SHIFT;
 	}
 	/* GICv3 doesn't support the injection of the calling CPU ID */
 
 	gicv3_write_lr(free_lr, lr);
+	cpu_data->lr_irq[free_lr] = irq_id;
+	cpu_data->lr_free &= ~(1ULL << free_lr);
 
 	return 0;
 }
 
+/*
+ * Free the list register holding the pending, not yet acknowledged interrupt
+ * with the lowest priority below that of irq_id. Called when all list
+ * registers are in use.
+ */
+static bool gicv3_evict_irq(u16 irq_id, u16 *evicted_id, u16 *evicted_sender)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	unsigned int lowest_prio = gicv3_get_irq_priority(irq_id);
+	unsigned int n, prio;
+	int victim = -1;
+	u64 lr;
+
+	for (n = 0; n < gic_num_lr; n++) {
+		lr = gicv3_read_lr(n);
+		if ((lr & ICH_LR_PENDACTIVE) != ICH_LR_PENDING)
+			continue;
+
+		prio = (lr >> ICH_LR_PRIORITY_SHIFT) & 0xff;
+		if (prio > lowest_prio) {
+			lowest_prio = prio;
+			victim = n;
+		}
+	}
+
+	if (victim == -1)
+		return false;
+
+	/*
+	 * Hardware interrupts stay active at the physical distributor until
+	 * they are reinjected and handled by the cell.
+	 */
+	*evicted_id = cpu_data->lr_irq[victim];
+	*evicted_sender = 0;
+
+	gicv3_write_lr(victim, 0);
+	cpu_data->lr_free |= 1ULL << victim;
+
+	return true;
+}
+
 static void gicv3_enable_maint_irq(bool enable)
 {
 	u32 hcr;
@@ -628,7 +706,12 @@ static void gicv3_inject_phys_irq(u16 irq_id)
 	unsigned int offset = (irq_id / 32) * 4;
 	unsigned int mask = 1 << (irq_id % 32);
 
-	if (!is_spi(irq_id)) {
+	if (is_lpi(irq_id)) {
+		/* Only possible if LPIs can be set directly. */
+		gicr = this_cpu_public()->gicr.base;
+		if (mmio_read64(gicr + GICR_TYPER) & GICR_TYPER_DirectLPI)
+			mmio_write64(gicr + GICR_SETLPIR, irq_id);
+	} else if (!is_spi(irq_id)) {
 		/*
 		 * Hardware interrupts are physically active until they are
 		 * processed by the cell. Deactivate them first so that we can
@@ -694,6 +777,7 @@ const struct irqchip gicv3_irqchip = {
 	.adjust_irq_target = gicv3_adjust_irq_target,
 	.send_sgi = gicv3_send_sgi,
 	.inject_irq = gicv3_inject_irq,
+	.evict_irq = gicv3_evict_irq,
 	.enable_maint_irq = gicv3_enable_maint_irq,
 	.has_pending_irqs = gicv3_has_pending_irqs,
 	.get_pending_irq = gicv3_get_pending_irq,
@@ -15,17 +15,38 @@
 
 #include <jailhouse/paging.h>
 
+/* Virtual ITS collections per cell */
+#define ITS_CELL_COLLECTIONS	64
+
 struct pvu_tlb_entry;
+struct its_device;
 
 struct arch_cell {
 	struct paging_structures mm;
 
 	u32 irq_bitmap[1024/32];
 
+	/** Cell was started at least once, its memory may be cached. */
+	bool started;
+
 	struct {
 		u8 ent_count;
 		struct pvu_tlb_entry *entries;
 	} iommu_pvu; /**< ARM PVU specific fields. */
+
+	struct {
+		bool enabled;
+		u64 cbaser;
+		u64 cwriter;
+		u64 creadr;
+		u64 baser[8];
+		/** Only non-root cells: virtual GICR_PROPBASER. */
+		u64 propbaser;
+		/** Only non-root cells: indexed like cell::pci_devices. */
+		struct its_device *devices;
+		/** Target CPU + 1 of each collection, 0 if unmapped. */
+		u16 collections[ITS_CELL_COLLECTIONS];
+	} its; /**< GICv3 ITS emulation state. */
 };
 
 #endif /* !_JAILHOUSE_ASM_CELL_H */
@@ -40,6 +40,7 @@
 #define is_sgi(irqn)			((u32)(irqn) < 16)
 #define is_ppi(irqn)			((irqn) > 15 && (irqn) < 32)
 #define is_spi(irqn)			((irqn) > 31 && (irqn) < 1020)
+#define is_lpi(irqn)			((irqn) > 8191)
 
 #define REG_RANGE(base, n, size)	(base)...((base) + (n - 1) * (size))
 
@@ -51,5 +52,9 @@ extern spinlock_t dist_lock;
 
 void gic_handle_sgir_write(struct sgi *sgi);
 bool gicv3_handle_sgir_write(u64 sgir);
+
+bool gicv3_its_handle_redist_access(struct public_per_cpu *cpu_public,
+				    struct mmio_access *mmio);
+u16 gicv3_its_virt_lpi(struct public_per_cpu *cpu_public, u32 lpi);
 #endif /* !__ASSEMBLY__ */
 #endif /* !_JAILHOUSE_ASM_GIC_COMMON_H */
@@ -21,11 +21,16 @@
 #define GICDv3_PIDR2		0xffe8
 #define GICDv3_PIDR4		0xffd0
 
+#define GICD_TYPER_IDBITS(typer)	((((typer) >> 19) & 0x1f) + 1)
+
 #define GICR_CTLR		0x0000
 #define GICR_IIDR		0x0004
 #define GICR_TYPER		0x0008
 #define GICR_STATUSR		0x0010
 #define GICR_WAKER		0x0014
+#define GICR_SETLPIR		0x0040
+#define GICR_PROPBASER		0x0070
+#define GICR_PENDBASER		0x0078
 #define GICR_SYNCR		0x00c0
 #define GICR_PIDR2		0xffe8
 
@@ -39,9 +44,53 @@
 #define GICR_IPRIORITYR		GICD_IPRIORITYR
 #define GICR_ICFGR		GICD_ICFGR
 
+#define GICR_CTLR_EnableLPIs	(1 << 0)
+
+#define GICR_TYPER_DirectLPI	(1 << 3)
 #define GICR_TYPER_Last		(1 << 4)
 #define GICR_PIDR2_ARCH		GICD_PIDR2_ARCH
 
+#define GICR_PROPBASER_IDbits_MASK	0x1f
+#define GICR_PROPBASER_ADDR_MASK	0x000ffffffffff000ULL
+#define GICR_PENDBASER_ADDR_MASK	0x000fffffffff0000ULL
+
+#define GITS_CTLR		0x0000
+#define GITS_IIDR		0x0004
+#define GITS_TYPER		0x0008
+#define GITS_CBASER		0x0080
+#define GITS_CWRITER		0x0088
+#define GITS_CREADR		0x0090
+#define GITS_BASER		0x0100
+
+#define GITS_CTLR_Enabled	(1 << 0)
+#define GITS_CTLR_Quiescent	(1U << 31)
+
+#define GITS_TYPER_Virtual		(1 << 1)
+#define GITS_TYPER_ITT_ENTRY_SIZE(typer)	((((typer) >> 4) & 0xf) + 1)
+#define GITS_TYPER_IDbits_SHIFT		8
+#define GITS_TYPER_IDbits_MASK		(0x1fULL << GITS_TYPER_IDbits_SHIFT)
+#define GITS_TYPER_IDBITS(typer)	((((typer) >> 8) & 0x1f) + 1)
+#define GITS_TYPER_PTA			(1 << 19)
+#define GITS_TYPER_HCC(typer)		(((typer) >> 24) & 0xff)
+
+/* GITS_CBASER shares the layout of GITS_BASER<n> */
+#define GITS_BASER_Valid		(1ULL << 63)
+#define GITS_BASER_Indirect		(1ULL << 62)
+#define GITS_BASER_InnerWaWb		(7ULL << 59)
+#define GITS_BASER_TYPE(baser)		(((baser) >> 56) & 0x7)
+#define GITS_BASER_TYPE_DEVICE		1
+#define GITS_BASER_TYPE_COLLECTION	4
+#define GITS_BASER_ENTRY_SIZE(baser)	((((baser) >> 48) & 0x1f) + 1)
+#define GITS_BASER_RO_MASK		((0x7ULL << 56) | (0x1fULL << 48))
+#define GITS_BASER_ADDR_MASK		0x000ffffffffff000ULL
+#define GITS_BASER_InnerShareable	(1 << 10)
+#define GITS_BASER_SHAREABILITY_MASK	(3 << 10)
+#define GITS_BASER_PAGE_SIZE(baser)	(((baser) >> 8) & 0x3)
+#define GITS_BASER_SIZE_MASK		0xff
+
+#define GITS_CREADR_Stalled	(1 << 0)
+#define GITS_CMDQ_OFFSET_MASK	0xfffe0
+
 #define ICC_IAR1_EL1		SYSREG_32(0, c12, c12, 0)
 #define ICC_EOIR1_EL1		SYSREG_32(0, c12, c12, 1)
 #define ICC_HPPIR1_EL1		SYSREG_32(0, c12, c12, 2)
@@ -13,8 +13,11 @@
 #ifndef _JAILHOUSE_ASM_IRQCHIP_H
 #define _JAILHOUSE_ASM_IRQCHIP_H
 
+/* must be a power of two */
 #define MAX_PENDING_IRQS	256
 
+#define MAX_LIST_REGS		64
+
 #include <jailhouse/cell.h>
 #include <jailhouse/mmio.h>
 
@@ -50,6 +53,7 @@ struct irqchip {
 	u32	(*read_iar_irqn)(void);
 	void	(*eoi_irq)(u32 irqn, bool deactivate);
 	int	(*inject_irq)(u16 irq_id, u16 sender);
+	bool	(*evict_irq)(u16 irq_id, u16 *evicted_id, u16 *evicted_sender);
 	void	(*enable_maint_irq)(bool enable);
 	bool	(*has_pending_irqs)(void);
 	int	(*get_pending_irq)(void);
@@ -67,14 +71,16 @@ struct irqchip {
 	unsigned long gicd_size;
 };
 
+/*
+ * Lockless multi-producer, single-consumer ring of interrupts to be injected
+ * into the owning CPU. Producers reserve a slot by advancing tail atomically
+ * and then publish the entry; only the owner consumes and advances head.
+ * Both indices are free-running.
+ */
 struct pending_irqs {
-	/* synchronizes parallel insertions of SGIs into the pending ring */
-	spinlock_t lock;
-	u16 irqs[MAX_PENDING_IRQS];
-	/* contains the calling CPU ID in case of a SGI */
-	u16 sender[MAX_PENDING_IRQS];
-	unsigned int head;
-	/* removal from the ring happens lockless, thus tail is volatile */
+	/* IRQ ID, sender CPU in case of a SGI, valid flag; 0 if unpublished */
+	volatile u32 entries[MAX_PENDING_IRQS];
+	volatile unsigned int head;
 	volatile unsigned int tail;
 };
 
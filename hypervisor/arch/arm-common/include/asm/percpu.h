@@ -17,7 +17,17 @@
 
 #define ARM_PERCPU_FIELDS						\
 	int smccc_feat_workaround_1;					\
-	int smccc_feat_workaround_2;
+	int smccc_feat_workaround_2;					\
+									\
+	/** Interrupts waiting for a free list register, encoded like	\
+	 *  pending_irqs entries. */					\
+	u32 deferred_irqs[MAX_LIST_REGS];				\
+	unsigned int num_deferred_irqs;					\
+	/** Cached ELSR, valid for one injection pass. */		\
+	u64 lr_free;							\
+	bool lr_free_valid;						\
+	/** Virtual IRQ ID held by each used list register. */		\
+	u16 lr_irq[MAX_LIST_REGS];
 
 #define ARCH_PUBLIC_PERCPU_FIELDS					\
 	unsigned long mpidr;						\
@@ -32,6 +42,9 @@
 			void *base;					\
 			/** Physical redistributor address. */		\
 			unsigned long phys_addr;			\
+			/** Virtual LPI state of non-root cells. */	\
+			bool lpis_enabled;				\
+			u64 pendbaser;					\
 		} gicr;							\
 	};								\
 									\
@@ -31,4 +31,9 @@ static inline void memory_load_barrier(void)
 	dmb(ish);
 }
 
+static inline void memory_store_barrier(void)
+{
+	dmb(ishst);
+}
+
 #endif /* !__ASSEMBLY__ */
@@ -24,6 +24,10 @@
 #include <asm/irqchip.h>
 #include <asm/smccc.h>
 
+#define PENDING_IRQ_VALID		(1U << 31)
+#define PENDING_IRQ_SENDER_SHIFT	16
+#define PENDING_IRQ_ID_MASK		0xffff
+
 #define for_each_irqchip(chip, config, counter)				\
 	for ((chip) = jailhouse_cell_irqchips(config), (counter) = 0;	\
 	     (counter) < (config)->num_irqchips;			\
@@ -221,85 +225,180 @@ bool irqchip_has_pending_irqs(void)
 	return irqchip.has_pending_irqs();
 }
 
+static bool pending_irqs_push(struct pending_irqs *pending, u32 entry)
+{
+	unsigned int tail;
+
+	do {
+		tail = pending->tail;
+		/* Queue space available? */
+		if (tail - pending->head >= MAX_PENDING_IRQS)
+			return false;
+	} while (atomic_cmpxchg(&pending->tail, tail, tail + 1) != tail);
+
+	/*
+	 * The slot is ours now. Publishing the entry makes it visible to the
+	 * consumer. The barrier of the cmpxchg ensures that we do not write
+	 * before the consumer released the slot.
+	 */
+	pending->entries[tail % MAX_PENDING_IRQS] = entry;
+
+	return true;
+}
+
+/* Returns 0 if the queue is empty or the head entry is not yet published. */
+static u32 pending_irqs_peek(struct pending_irqs *pending)
+{
+	u32 entry;
+
+	if (pending->head == pending->tail)
+		return 0;
+
+	entry = pending->entries[pending->head % MAX_PENDING_IRQS];
+	/* Ensure that the entry content is read after its valid flag. */
+	memory_barrier();
+
+	return entry;
+}
+
+static void pending_irqs_pop(struct pending_irqs *pending)
+{
+	pending->entries[pending->head % MAX_PENDING_IRQS] = 0;
+	/* Ensure that the slot is released before updating the head index. */
+	memory_barrier();
+	pending->head++;
+}
+
+static void pending_irqs_reset(struct pending_irqs *pending)
+{
+	unsigned int n;
+
+	for (n = 0; n < MAX_PENDING_IRQS; n++)
+		pending->entries[n] = 0;
+	pending->head = 0;
+	pending->tail = 0;
+}
+
+static u32 pending_irq_entry(u16 irq_id, u16 sender)
+{
+	return PENDING_IRQ_VALID | (sender << PENDING_IRQ_SENDER_SHIFT) |
+		irq_id;
+}
+
+static bool defer_irq(struct per_cpu *cpu_data, u32 entry)
+{
+	if (cpu_data->num_deferred_irqs >= MAX_LIST_REGS)
+		return false;
+
+	cpu_data->deferred_irqs[cpu_data->num_deferred_irqs++] = entry;
+	return true;
+}
+
+/*
+ * Inject an interrupt into a free list register of the calling CPU. If all
+ * of them are in use, evict a pending interrupt of lower priority to the
+ * deferred list so that high priority interrupts do not have to wait for the
+ * guest to work off less important ones.
+ */
+static int inject_irq(struct per_cpu *cpu_data, u32 entry)
+{
+	u16 irq_id = entry & PENDING_IRQ_ID_MASK;
+	u16 sender = (entry & ~PENDING_IRQ_VALID) >> PENDING_IRQ_SENDER_SHIFT;
+	u16 evicted_id, evicted_sender;
+	int err;
+
+	err = irqchip.inject_irq(irq_id, sender);
+	if (err != -EBUSY)
+		return err;
+
+	if (cpu_data->num_deferred_irqs >= MAX_LIST_REGS ||
+	    !irqchip.evict_irq(irq_id, &evicted_id, &evicted_sender))
+		return -EBUSY;
+
+	defer_irq(cpu_data, pending_irq_entry(evicted_id, evicted_sender));
+
+	return irqchip.inject_irq(irq_id, sender);
+}
+
 void irqchip_set_pending(struct public_per_cpu *cpu_public, u16 irq_id)
 {
-	struct pending_irqs *pending = &cpu_public->pending_irqs;
 	bool local_injection = (this_cpu_public() == cpu_public);
 	const u16 sender = this_cpu_id();
-	unsigned int new_tail;
+	u32 entry = pending_irq_entry(irq_id, sender);
+	struct per_cpu *cpu_data = this_cpu_data();
 
 	if (sdei_available) {
 		irqchip_send_sgi(cpu_public->cpu_id, irq_id);
 		return;
 	}
 
-	if (local_injection && irqchip.inject_irq(irq_id, sender) != -EBUSY)
-		return;
-
-	spin_lock(&pending->lock);
-
-	new_tail = (pending->tail + 1) % MAX_PENDING_IRQS;
+	if (local_injection) {
+		cpu_data->lr_free_valid = false;
+		if (inject_irq(cpu_data, entry) != -EBUSY)
+			return;
 
-	/* Queue space available? */
-	if (new_tail != pending->head) {
-		pending->irqs[pending->tail] = irq_id;
-		pending->sender[pending->tail] = sender;
 		/*
-		 * Make the entry content is visible before updating the tail
-		 * index.
+		 * The list registers are full, trigger maintenance interrupt.
+		 * Deferred interrupts are only touched by this CPU, so the
+		 * shared queue is only needed when that list overflows.
 		 */
-		memory_barrier();
-		pending->tail = new_tail;
+		if (!defer_irq(cpu_data, entry))
+			pending_irqs_push(&cpu_public->pending_irqs, entry);
+		irqchip.enable_maint_irq(true);
+		return;
 	}
 
-	/*
-	 * The unlock has memory barrier semantic on ARM v7 and v8. Therefore
-	 * the change to tail will be visible when sending SGI_INJECT later on.
-	 */
-	spin_unlock(&pending->lock);
+	pending_irqs_push(&cpu_public->pending_irqs, entry);
 
 	/*
-	 * The list registers are full, trigger maintenance interrupt if we are
-	 * on the target CPU. In the other case, send SGI_INJECT to the target
-	 * CPU.
+	 * Make sure the entry is visible when the target CPU receives
+	 * SGI_INJECT. If the target finds an earlier slot still unpublished,
+	 * it stops there and will be kicked again by the producer of that
+	 * slot.
 	 */
-	if (local_injection)
-		irqchip.enable_maint_irq(true);
-	else
-		irqchip_send_sgi(cpu_public->cpu_id, SGI_INJECT);
+	memory_barrier();
+	irqchip_send_sgi(cpu_public->cpu_id, SGI_INJECT);
 }
 
 void irqchip_inject_pending(void)
 {
-	struct pending_irqs *pending = &this_cpu_public()->pending_irqs;
-	u16 irq_id, sender;
-
-	while (pending->head != pending->tail) {
-		irq_id = pending->irqs[pending->head];
-		sender = pending->sender[pending->head];
-
-		if (irqchip.inject_irq(irq_id, sender) == -EBUSY) {
-			/*
-			 * The list registers are full, trigger maintenance
-			 * interrupt and leave.
-			 */
-			irqchip.enable_maint_irq(true);
-			return;
-		}
+	struct per_cpu *cpu_data = this_cpu_data();
+	struct pending_irqs *pending = &cpu_data->public.pending_irqs;
+	unsigned int n, kept = 0;
+	u32 entry;
 
-		/*
-		 * Ensure that the entry was read before updating the head
-		 * index.
-		 */
-		memory_barrier();
-		pending->head = (pending->head + 1) % MAX_PENDING_IRQS;
+	cpu_data->lr_free_valid = false;
+
+	/*
+	 * Retry interrupts that were deferred before and keep their order.
+	 * Evictions are appended during the walk and will be visited as well.
+	 */
+	for (n = 0; n < cpu_data->num_deferred_irqs; n++) {
+		entry = cpu_data->deferred_irqs[n];
+		if (inject_irq(cpu_data, entry) == -EBUSY)
+			cpu_data->deferred_irqs[kept++] = entry;
+	}
+	cpu_data->num_deferred_irqs = kept;
+
+	/*
+	 * Drain the shared queue completely if possible. Interrupts that do not
+	 * find a list register are deferred so that those queued behind them
+	 * still get a chance to evict lower priority ones.
+	 */
+	while ((entry = pending_irqs_peek(pending)) != 0) {
+		if (inject_irq(cpu_data, entry) == -EBUSY &&
+		    !defer_irq(cpu_data, entry))
+			break;
+		pending_irqs_pop(pending);
 	}
 
 	/*
-	 * The software interrupt queue is empty - turn off the maintenance
-	 * interrupt.
+	 * Keep the maintenance interrupt enabled while interrupts are waiting
+	 * for a list register. Otherwise, the software interrupt queue is
+	 * empty - turn it off.
 	 */
-	irqchip.enable_maint_irq(false);
+	irqchip.enable_maint_irq(cpu_data->num_deferred_irqs > 0 ||
+				 pending_irqs_peek(pending) != 0);
 }
 
 void irqchip_trigger_external_irq(u16 irq_id)
@@ -365,15 +464,18 @@ u64 irqchip_get_cluster_target(unsigned int cpu_id)
 
 void irqchip_cpu_reset(struct per_cpu *cpu_data)
 {
-	cpu_data->public.pending_irqs.head = 0;
-	cpu_data->public.pending_irqs.tail = 0;
+	pending_irqs_reset(&cpu_data->public.pending_irqs);
+	cpu_data->num_deferred_irqs = 0;
 
 	irqchip.cpu_reset(cpu_data);
 }
 
 void irqchip_cpu_shutdown(struct public_per_cpu *cpu_public)
 {
+	struct per_cpu *cpu_data = per_cpu(cpu_public->cpu_id);
 	struct pending_irqs *pending = &cpu_public->pending_irqs;
+	unsigned int n;
+	u32 entry;
 	int irq_id;
 
 	/*
@@ -397,17 +499,14 @@ void irqchip_cpu_shutdown(struct public_per_cpu *cpu_public)
 	} while (irq_id >= 0);
 
 	/* Migrate interrupts queued in software. */
-	while (pending->head != pending->tail) {
-		irq_id = pending->irqs[pending->head];
-
-		irqchip.inject_phys_irq(irq_id);
-
-		/*
-		 * Ensure that the entry was read before updating the head
-		 * index.
-		 */
-		memory_barrier();
-		pending->head = (pending->head + 1) % MAX_PENDING_IRQS;
+	for (n = 0; n < cpu_data->num_deferred_irqs; n++)
+		irqchip.inject_phys_irq(cpu_data->deferred_irqs[n] &
+					PENDING_IRQ_ID_MASK);
+	cpu_data->num_deferred_irqs = 0;
+
+	while ((entry = pending_irqs_peek(pending)) != 0) {
+		irqchip.inject_phys_irq(entry & PENDING_IRQ_ID_MASK);
+		pending_irqs_pop(pending);
 	}
 }
 
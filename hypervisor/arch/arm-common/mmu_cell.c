@@ -22,6 +22,11 @@ int arch_map_memory_region(struct cell *cell,
 {
 	u64 phys_start = mem->phys_start;
 	unsigned long access_flags = PTE_FLAG_VALID | PTE_ACCESS_FLAG;
+	/*
+	 * No PAGING_FOLD: replacing a table by a block while the cell may run
+	 * would require break-before-make, including a TLB invalidation for
+	 * the cell's VMID in between.
+	 */
 	unsigned long paging_flags = PAGING_COHERENT | PAGING_HUGE;
 	int err = 0;
 
@@ -73,37 +78,193 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
 	return paging_virt2phys(&this_cell()->arch.mm, gphys, flags);
 }
 
+/* Portion of a flush job claimed by a CPU at a time */
+#define DCACHE_FLUSH_CHUNK_SHIFT	21
+#define DCACHE_FLUSH_CHUNK_SIZE		(1UL << DCACHE_FLUSH_CHUNK_SHIFT)
+
+/*
+ * Flush job shared with the CPUs that are suspended while a cell is
+ * (re)configured. The initiator maps the region into the flush window and
+ * processes chunks of it until all are done, suspended CPUs pick up chunks
+ * from their wait loop in parallel.
+ */
+static struct {
+	/** Serializes flush jobs of concurrent initiators. */
+	spinlock_t lock;
+	void *base;
+	unsigned long size;
+	enum dcache_flush flush;
+	volatile unsigned int next_chunk;
+	volatile unsigned int done_chunks;
+	/** Number of CPUs currently working on the job. */
+	volatile unsigned int helpers;
+	volatile bool active;
+} dcache_job;
+
+static unsigned int dcache_job_add(volatile unsigned int *counter, int value)
+{
+	unsigned int old;
+
+	do {
+		old = *counter;
+	} while (atomic_cmpxchg(counter, old, old + value) != old);
+
+	return old;
+}
+
+static void dcache_job_run(void)
+{
+	unsigned int num_chunks = (dcache_job.size + DCACHE_FLUSH_CHUNK_SIZE -
+				   1) >> DCACHE_FLUSH_CHUNK_SHIFT;
+	unsigned long offset;
+	unsigned int chunk;
+
+	while ((chunk = dcache_job_add(&dcache_job.next_chunk, 1)) <
+	       num_chunks) {
+		offset = (unsigned long)chunk << DCACHE_FLUSH_CHUNK_SHIFT;
+		arm_dcaches_flush(dcache_job.base + offset,
+				  MIN(dcache_job.size - offset,
+				      DCACHE_FLUSH_CHUNK_SIZE),
+				  dcache_job.flush);
+		dcache_job_add(&dcache_job.done_chunks, 1);
+	}
+}
+
+/**
+ * Take over chunks of a running data cache flush job.
+ *
+ * Called by suspended CPUs while they wait for the end of a cell
+ * reconfiguration.
+ */
+void arm_dcaches_flush_help(void)
+{
+	if (!dcache_job.active)
+		return;
+
+	dcache_job_add(&dcache_job.helpers, 1);
+	/* pairs with the barrier after clearing dcache_job.active */
+	memory_barrier();
+	if (dcache_job.active) {
+		/*
+		 * Pairs with the barrier before setting dcache_job.active, do
+		 * not use the parameters of a previous job.
+		 */
+		memory_barrier();
+		dcache_job_run();
+	}
+	dcache_job_add(&dcache_job.helpers, -1);
+}
+
+static int dcache_flush_window(unsigned long phys, unsigned long size,
+			       enum dcache_flush flush)
+{
+	unsigned long virt = DCACHE_FLUSH_WINDOW_BASE +
+		(phys & (DCACHE_FLUSH_WINDOW_ALIGN - 1));
+	unsigned int num_chunks;
+	int err;
+
+	err = paging_create(&hv_paging_structs, phys, size, virt,
+			    PAGE_DEFAULT_FLAGS,
+			    PAGING_NON_COHERENT | PAGING_HUGE);
+	if (err) {
+		paging_destroy(&hv_paging_structs, virt, size,
+			       PAGING_NON_COHERENT);
+		arm_paging_flush_hv_tlbs();
+		return err;
+	}
+	dsb(ish);
+	isb();
+
+	num_chunks = (size + DCACHE_FLUSH_CHUNK_SIZE - 1) >>
+		DCACHE_FLUSH_CHUNK_SHIFT;
+
+	dcache_job.base = (void *)virt;
+	dcache_job.size = size;
+	dcache_job.flush = flush;
+	dcache_job.next_chunk = 0;
+	dcache_job.done_chunks = 0;
+	memory_barrier();
+	dcache_job.active = true;
+
+	dcache_job_run();
+
+	while (dcache_job.done_chunks < num_chunks)
+		cpu_relax();
+
+	dcache_job.active = false;
+	/* pairs with the barrier after registering a helper */
+	memory_barrier();
+	while (dcache_job.helpers > 0)
+		cpu_relax();
+
+	paging_destroy(&hv_paging_structs, virt, size, PAGING_NON_COHERENT);
+	/*
+	 * paging_destroy only invalidated the local TLB, but helpers may still
+	 * cache translations of the window.
+	 */
+	arm_paging_flush_hv_tlbs();
+
+	return 0;
+}
+
+static void dcache_flush_temporary(unsigned long phys, unsigned long size,
+				   enum dcache_flush flush)
+{
+	unsigned long chunk_size;
+
+	while (size > 0) {
+		chunk_size = MIN(size, NUM_TEMPORARY_PAGES * PAGE_SIZE);
+
+		/* cannot fail, mapping area is preallocated */
+		paging_create(&this_cpu_data()->pg_structs, phys, chunk_size,
+			      TEMPORARY_MAPPING_BASE, PAGE_DEFAULT_FLAGS,
+			      PAGING_NON_COHERENT | PAGING_NO_HUGE);
+
+		arm_dcaches_flush((void *)TEMPORARY_MAPPING_BASE, chunk_size,
+				  flush);
+
+		phys += chunk_size;
+		size -= chunk_size;
+	}
+}
+
 void arm_cell_dcaches_flush(struct cell *cell, enum dcache_flush flush)
 {
 	unsigned long region_addr, region_size, size;
 	struct jailhouse_memory const *mem;
 	unsigned int n;
 
+	spin_lock(&dcache_job.lock);
+
 	for_each_mem_region(mem, cell->config, n) {
 		if (mem->flags & (JAILHOUSE_MEM_IO | JAILHOUSE_MEM_COMM_REGION))
 			continue;
+		/*
+		 * The root cell keeps its cacheable mapping of shared regions,
+		 * invalidating them would discard its dirty lines.
+		 */
+		if (flush == DCACHE_INVALIDATE &&
+		    mem->flags & JAILHOUSE_MEM_ROOTSHARED)
+			continue;
 
 		region_addr = mem->phys_start;
 		region_size = mem->size;
 
 		while (region_size > 0) {
-			size = MIN(region_size,
-				   NUM_TEMPORARY_PAGES * PAGE_SIZE);
-
-			/* cannot fail, mapping area is preallocated */
-			paging_create(&this_cpu_data()->pg_structs, region_addr,
-				      size, TEMPORARY_MAPPING_BASE,
-				      PAGE_DEFAULT_FLAGS,
-				      PAGING_NON_COHERENT | PAGING_NO_HUGE);
+			size = MIN(region_size, DCACHE_FLUSH_WINDOW_SIZE -
+				   DCACHE_FLUSH_WINDOW_ALIGN);
 
-			arm_dcaches_flush((void *)TEMPORARY_MAPPING_BASE, size,
-					  flush);
+			if (dcache_flush_window(region_addr, size, flush) != 0)
+				dcache_flush_temporary(region_addr, size,
+						       flush);
 
 			region_addr += size;
 			region_size -= size;
 		}
 	}
 
+	spin_unlock(&dcache_job.lock);
+
 	/* ensure completion of the flush */
 	dmb(ish);
 }
@@ -116,6 +277,8 @@ int arm_paging_cell_init(struct cell *cell)
 	cell->arch.mm.root_paging = cell_paging;
 	cell->arch.mm.root_table =
 		page_alloc_aligned(&mem_pool, CELL_ROOT_PT_PAGES);
+	cell->arch.mm.mappings = cell->mappings;
+	cell->arch.mm.cell = cell;
 
 	if (!cell->arch.mm.root_table)
 		return -ENOMEM;
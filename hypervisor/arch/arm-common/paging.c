@@ -22,8 +22,11 @@ static bool arm_entry_valid(pt_entry_t entry, unsigned long flags)
 
 static unsigned long arm_get_entry_flags(pt_entry_t entry)
 {
-	/* Upper flags (contiguous hint and XN are currently ignored */
-	return *entry & 0xfff;
+	/*
+	 * Upper flags (contiguous hint and XN are currently ignored. The
+	 * terminal flag is level-specific and added by set_terminal.
+	 */
+	return *entry & 0xfff & ~PTE_FLAG_TERMINAL;
 }
 
 static void arm_clear_entry(pt_entry_t entry)
@@ -118,7 +118,7 @@ enum trap_return handle_smc(struct trap_context *ctx)
 {
 	unsigned long *regs = ctx->regs;
 	enum trap_return ret = TRAP_HANDLED;
-	u32 *stats = this_cpu_public()->stats;
+	u64 *stats = this_cpu_public()->stats;
 
 	switch (SMCCC_GET_OWNER(regs[0])) {
 	case ARM_SMCCC_OWNER_ARCH:
@@ -42,3 +42,25 @@ static inline int atomic_test_and_set_bit(int nr, volatile unsigned long *addr)
 
 	return !!(test);
 }
+
+/* Returns the previous value, *addr was updated if that equals old. */
+static inline unsigned int atomic_cmpxchg(volatile unsigned int *addr,
+					  unsigned int old, unsigned int new)
+{
+	unsigned long ret, prev;
+
+	do {
+		asm volatile (
+			"mov	%0, #0\n\t"
+			"ldrex	%1, %2\n\t"
+			"teq	%1, %3\n\t"
+			"it	eq\n\t"
+			"strexeq %0, %4, %2\n\t"
+			: "=&r" (ret), "=&r" (prev), "+Qo" (*addr)
+			: "r" (old), "r" (new)
+			: "cc");
+	} while (ret);
+
+	asm volatile ("dmb ish" : : : "memory");
+	return prev;
+}
@@ -171,6 +171,15 @@
 #define REMAP_BASE		0xf8000000UL
 #define NUM_REMAP_BITMAP_PAGES	4
 
+/**
+ * Shared window for flushing cell memory from the data caches. Regions are
+ * mapped at the offset of their physical address modulo the alignment, so
+ * that 2M blocks can be used.
+ */
+#define DCACHE_FLUSH_WINDOW_BASE	0xc0000000UL
+#define DCACHE_FLUSH_WINDOW_SIZE	0x20000000UL
+#define DCACHE_FLUSH_WINDOW_ALIGN	0x00200000UL
+
 #ifndef __ASSEMBLY__
 
 struct cell;
@@ -197,6 +206,12 @@ static inline void arm_paging_vcpu_flush_tlbs(void)
 	arm_write_sysreg(TLBIALL, 0);
 }
 
+/* No IPA-based invalidation on AArch32, always flush the whole VMID */
+static inline bool arm_paging_vcpu_flush_dirty_tlbs(struct cell *cell)
+{
+	return false;
+}
+
 /* return the bits supported for the physical address range for this
  * machine; in arch_paging_init this value will be kept in
  * cpu_parange for later reference */
@@ -221,6 +236,15 @@ static inline void arch_paging_flush_page_tlbs(unsigned long page_addr)
 	}
 }
 
+/* Invalidate all hypervisor TLB entries on all CPUs */
+static inline void arm_paging_flush_hv_tlbs(void)
+{
+	dsb();
+	arm_write_sysreg(TLBIALLHIS, 0);
+	dsb();
+	isb();
+}
+
 /* Used to clean the PAGING_COHERENT page table changes */
 static inline void arch_paging_flush_cpu_caches(void *addr, long size)
 {
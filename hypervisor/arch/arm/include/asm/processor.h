@@ -52,6 +52,14 @@ static inline bool is_el2(void)
 	return (psr & PSR_MODE_MASK) == PSR_HYP_MODE;
 }
 
+static inline u64 read_timestamp(void)
+{
+	u64 cnt;
+
+	arm_read_sysreg(CNTPCT_EL0, cnt);
+	return cnt;
+}
+
 #endif /* !__ASSEMBLY__ */
 
 #endif /* !_JAILHOUSE_ASM_PROCESSOR_H */
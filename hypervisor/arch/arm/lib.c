@@ -10,7 +10,7 @@
  * the COPYING file in the top-level directory.
  */
 
-#include <jailhouse/types.h>
+#include <jailhouse/string.h>
 
 unsigned long long __aeabi_llsl(unsigned long long val, unsigned int shift);
 unsigned long long __aeabi_llsr(unsigned long long val, unsigned int shift);
@@ -30,3 +30,8 @@ unsigned long long __aeabi_llsr(unsigned long long val, unsigned int shift)
 
 	return ((unsigned long long)hi << 32) | lo;
 }
+
+void arch_string_init(void)
+{
+	/* The generic word-sized memset and memcpy are used on ARMv7. */
+}
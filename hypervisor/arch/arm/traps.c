@@ -16,6 +16,7 @@
 
 #include <jailhouse/control.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/tracing.h>
 #include <asm/control.h>
 #include <asm/gic.h>
 #include <asm/psci.h>
@@ -487,8 +488,13 @@ static void arch_dump_abt(bool is_data)
 
 union registers* arch_handle_exit(union registers *regs)
 {
+	u32 pc;
+
 	this_cpu_public()->stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
 
+	arm_read_banked_reg(ELR_hyp, pc);
+	trace_exit_begin(regs->exit_reason, pc);
+
 	switch (regs->exit_reason) {
 	case EXIT_REASON_IRQ:
 		irqchip_handle_irq();
@@ -519,5 +525,6 @@ union registers* arch_handle_exit(union registers *regs)
 		panic_stop();
 	}
 
+	trace_exit_end();
 	return regs;
 }
@@ -43,3 +43,27 @@ static inline int atomic_test_and_set_bit(int nr, volatile unsigned long *addr)
 	} while (ret);
 	return !!(test);
 }
+
+/* Returns the previous value, *addr was updated if that equals old. */
+static inline unsigned int atomic_cmpxchg(volatile unsigned int *addr,
+					  unsigned int old, unsigned int new)
+{
+	unsigned int prev;
+	u32 ret;
+
+	do {
+		asm volatile (
+			"mov	%w0, #0\n\t"
+			"ldxr	%w1, %2\n\t"
+			"cmp	%w1, %w3\n\t"
+			"b.ne	1f\n\t"
+			"stxr	%w0, %w4, %2\n\t"
+			"1:\n\t"
+			: "=&r" (ret), "=&r" (prev), "+Q" (*addr)
+			: "r" (old), "r" (new)
+			: "cc");
+	} while (ret);
+
+	asm volatile ("dmb ish" : : : "memory");
+	return prev;
+}
@@ -165,6 +165,15 @@
 #define REMAP_BASE		0xff8000000000UL
 #define NUM_REMAP_BITMAP_PAGES	4
 
+/**
+ * Shared window for flushing cell memory from the data caches. Regions are
+ * mapped at the offset of their physical address modulo the alignment, so
+ * that 1G blocks can be used.
+ */
+#define DCACHE_FLUSH_WINDOW_BASE	0xff8040000000UL
+#define DCACHE_FLUSH_WINDOW_SIZE	0x4000000000UL
+#define DCACHE_FLUSH_WINDOW_ALIGN	0x40000000UL
+
 #ifndef __ASSEMBLY__
 
 struct cell;
@@ -173,6 +182,7 @@ struct paging_structures;
 typedef u64 *pt_entry_t;
 
 extern unsigned int cpu_parange, cpu_parange_encoded;
+extern bool tlbi_range_available;
 
 unsigned int get_cpu_parange(void);
 
@@ -199,6 +209,7 @@ int arm_paging_cell_init(struct cell *cell);
 void arm_paging_cell_destroy(struct cell *cell);
 
 void arm_paging_vcpu_init(struct paging_structures *pg_structs);
+bool arm_paging_vcpu_flush_dirty_tlbs(struct cell *cell);
 
 static inline void arm_paging_vcpu_flush_tlbs(void)
 {
@@ -220,6 +231,16 @@ static inline void arch_paging_flush_page_tlbs(unsigned long page_addr)
 		: : "r" (page_addr >> PAGE_SHIFT));
 }
 
+/* Invalidate all hypervisor TLB entries on all CPUs */
+static inline void arm_paging_flush_hv_tlbs(void)
+{
+	asm volatile(
+		"dsb ish\n\t"
+		"tlbi alle2is\n\t"
+		"dsb ish\n\t"
+		"isb\n\t");
+}
+
 /* Used to clean the PAGE_MAP_COHERENT page table changes */
 static inline void arch_paging_flush_cpu_caches(void *addr, long size)
 {
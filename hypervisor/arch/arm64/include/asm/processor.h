@@ -38,6 +38,14 @@ union registers {
 	};
 };
 
+static inline u64 read_timestamp(void)
+{
+	u64 cnt;
+
+	asm volatile("mrs %0, cntpct_el0" : "=r" (cnt));
+	return cnt;
+}
+
 #endif /* !__ASSEMBLY__ */
 
 #endif /* !_JAILHOUSE_ASM_PROCESSOR_H */
@@ -49,6 +49,9 @@
 #define MPIDR_AFFINITY_LEVEL(mpidr, level) \
 	(((mpidr) >> MPIDR_LEVEL_SHIFT(level)) & MPIDR_LEVEL_MASK)
 
+#define ID_AA64ISAR0_TLB(isar0)	(((isar0) >> 56) & 0xf)
+#define  ID_AA64ISAR0_TLB_RANGE	0x2
+
 #define SCTLR_M_BIT	(1 << 0)
 #define SCTLR_A_BIT	(1 << 1)
 #define SCTLR_C_BIT	(1 << 2)
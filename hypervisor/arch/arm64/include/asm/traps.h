@@ -24,6 +24,7 @@ struct trap_context {
 };
 
 void arch_handle_trap(union registers *guest_regs);
+void arch_handle_irq(union registers *guest_regs);
 void arch_el2_abt(union registers *regs);
 
 /* now include from arm-common */
@@ -0,0 +1,106 @@
+/*
+ * Jailhouse AArch64 support
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/string.h>
+#include <asm/sysregs.h>
+
+#define DCZID_BS_MASK		0xf
+#define DCZID_DZP		(1 << 4)
+
+#define PAIR_SIZE		16
+#define PAIR_ALIGNED(p)		(((unsigned long)(p) & (PAIR_SIZE - 1)) == 0)
+
+/* Size of the block zeroed by DC ZVA, 0 if prohibited */
+static unsigned long zva_block_size;
+
+static void *arm64_memset(void *s, int c, size_t n)
+{
+	u64 pattern = (u8)c * 0x0101010101010101UL;
+	u8 *p = s;
+
+	while (n > 0 && !PAIR_ALIGNED(p)) {
+		*p++ = c;
+		n--;
+	}
+
+	if (c == 0 && zva_block_size > 0 && n >= 2 * zva_block_size) {
+		while ((unsigned long)p & (zva_block_size - 1)) {
+			asm volatile("stp %1, %1, [%0]"
+				: : "r" (p), "r" (0UL) : "memory");
+			p += PAIR_SIZE;
+			n -= PAIR_SIZE;
+		}
+		while (n >= zva_block_size) {
+			asm volatile("dc zva, %0" : : "r" (p) : "memory");
+			p += zva_block_size;
+			n -= zva_block_size;
+		}
+	}
+
+	while (n >= PAIR_SIZE) {
+		asm volatile("stp %1, %1, [%0]"
+			: : "r" (p), "r" (pattern) : "memory");
+		p += PAIR_SIZE;
+		n -= PAIR_SIZE;
+	}
+
+	while (n-- > 0)
+		*p++ = c;
+	return s;
+}
+
+static void *arm64_memcpy(void *dest, const void *src, size_t n)
+{
+	const u8 *s = src;
+	u8 *d = dest;
+	u64 lo, hi;
+
+	/* Pairs are only loaded from doubleword-aligned sources. */
+	if (((unsigned long)s ^ (unsigned long)d) & 7)
+		goto copy_bytes;
+
+	while (n > 0 && !PAIR_ALIGNED(d)) {
+		*d++ = *s++;
+		n--;
+	}
+
+	while (n >= PAIR_SIZE) {
+		asm volatile("ldp %0, %1, [%2]"
+			: "=&r" (lo), "=&r" (hi) : "r" (s) : "memory");
+		asm volatile("stp %0, %1, [%2]"
+			: : "r" (lo), "r" (hi), "r" (d) : "memory");
+		s += PAIR_SIZE;
+		d += PAIR_SIZE;
+		n -= PAIR_SIZE;
+	}
+
+copy_bytes:
+	while (n-- > 0)
+		*d++ = *s++;
+	return dest;
+}
+
+static const struct string_ops arm64_string_ops = {
+	.memset = arm64_memset,
+	.memcpy = arm64_memcpy,
+};
+
+void arch_string_init(void)
+{
+	unsigned long dczid;
+
+	arm_read_sysreg(DCZID_EL0, dczid);
+	if (!(dczid & DCZID_DZP))
+		zva_block_size = 4UL << (dczid & DCZID_BS_MASK);
+
+	arch_string_ops = &arm64_string_ops;
+}
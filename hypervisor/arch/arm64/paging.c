@@ -12,10 +12,30 @@
 
 #include <jailhouse/control.h>
 #include <jailhouse/percpu.h>
+#include <jailhouse/utils.h>
 #include <asm/paging.h>
 
+/* Per-page invalidations before falling back to flushing the whole VMID */
+#define TLBI_MAX_PAGE_REQUESTS	512
+
+/* Pages covered by a RIPAS2E1IS sequence with SCALE 0..3 */
+#define TLBI_RANGE_MAX_PAGES	(32UL << 16)
+
+/*
+ * RIPAS2E1IS operand: TG[47:46], SCALE[45:44], NUM[43:39], TTL[38:37] (0, no
+ * level hint) and BaseADDR[36:0], i.e. IPA[48:12] for the 4K granule. It
+ * covers (NUM + 1) * 2^(5 * SCALE + 1) pages from BaseADDR on.
+ */
+#define TLBI_RANGE_TG_4K	(1UL << 46)
+#define TLBI_RANGE_SCALE(scale)	((unsigned long)(scale) << 44)
+#define TLBI_RANGE_NUM(num)	((unsigned long)(num) << 39)
+#define TLBI_RANGE_BASE(ipa)	(((ipa) >> PAGE_SHIFT) & BIT_MASK(36, 0))
+
 unsigned int cpu_parange_encoded;
 
+/** FEAT_TLBIRANGE is implemented by all CPUs. */
+bool tlbi_range_available;
+
 /**
  * Return the physical address bits.
  *
@@ -46,3 +66,80 @@ unsigned int get_cpu_parange(void)
 	return cpu_parange_encoded < ARRAY_SIZE(pa_bits) ?
 		pa_bits[cpu_parange_encoded] : 0;
 }
+
+static void tlbi_ipas2_range(unsigned long ipa, unsigned long pages)
+{
+	unsigned int scale = 0;
+	int num;
+
+	while (pages > 0) {
+		/* range operations only cover even numbers of pages */
+		if (!tlbi_range_available || pages % 2) {
+			asm volatile("tlbi ipas2e1is, %0"
+				: : "r" (ipa >> PAGE_SHIFT));
+			ipa += PAGE_SIZE;
+			pages--;
+			continue;
+		}
+
+		num = ((pages >> (5 * scale + 1)) & 0x1f) - 1;
+		if (num >= 0) {
+			asm volatile("sys #4, c8, c0, #2, %0" /* RIPAS2E1IS */
+				: : "r" (TLBI_RANGE_TG_4K |
+					 TLBI_RANGE_SCALE(scale) |
+					 TLBI_RANGE_NUM(num) |
+					 TLBI_RANGE_BASE(ipa)));
+			ipa += (unsigned long)(num + 1) <<
+				(5 * scale + 1 + PAGE_SHIFT);
+			pages -= (unsigned long)(num + 1) << (5 * scale + 1);
+		}
+		scale++;
+	}
+}
+
+/**
+ * Invalidate the TLB entries of the guest-physical ranges recorded via
+ * cell_mark_dirty() on all CPUs.
+ * @param cell		Cell whose VMID is loaded on the calling CPU.
+ *
+ * @return False if the caller has to flush the whole VMID instead.
+ */
+bool arm_paging_vcpu_flush_dirty_tlbs(struct cell *cell)
+{
+	const struct cell_dirty_range *range;
+	unsigned long pages = 0;
+	unsigned int n;
+
+	if (cell->dirty_overflow || cell->num_dirty_ranges == 0)
+		return false;
+
+	for (n = 0; n < cell->num_dirty_ranges; n++) {
+		range = &cell->dirty_ranges[n];
+		if (tlbi_range_available) {
+			if (range->size >> PAGE_SHIFT >= TLBI_RANGE_MAX_PAGES)
+				return false;
+		} else {
+			pages += range->size >> PAGE_SHIFT;
+			if (pages > TLBI_MAX_PAGE_REQUESTS)
+				return false;
+		}
+	}
+
+	dsb(ishst);
+	for (n = 0; n < cell->num_dirty_ranges; n++) {
+		range = &cell->dirty_ranges[n];
+		tlbi_ipas2_range(range->start, range->size >> PAGE_SHIFT);
+	}
+
+	/*
+	 * Stage-2 invalidation by IPA leaves combined stage-1 and 2 entries
+	 * alone, drop them for the VMID without touching stage-2 walks.
+	 */
+	asm volatile(
+		"dsb ish\n\t"
+		"tlbi vmalle1is\n\t"
+		"dsb ish\n\t"
+		"isb\n\t");
+
+	return true;
+}
@@ -41,6 +41,9 @@ int arch_init_early(void)
 	if (err)
 		return err;
 
+	/* cleared again by arch_cpu_init on CPUs lacking support */
+	tlbi_range_available = true;
+
 	return arm_init_early();
 }
 
@@ -48,6 +51,7 @@ int arch_cpu_init(struct per_cpu *cpu_data)
 {
 	unsigned long hcr = HCR_VM_BIT | HCR_IMO_BIT | HCR_FMO_BIT
 				| HCR_TSC_BIT | HCR_TAC_BIT | HCR_RW_BIT;
+	unsigned long isar0;
 	int err;
 
 	/* link to ID-mapping of trampoline page */
@@ -63,6 +67,10 @@ int arch_cpu_init(struct per_cpu *cpu_data)
 	if (err)
 		return err;
 
+	arm_read_sysreg(ID_AA64ISAR0_EL1, isar0);
+	if (ID_AA64ISAR0_TLB(isar0) < ID_AA64ISAR0_TLB_RANGE)
+		tlbi_range_available = false;
+
 	if (sdei_available) {
 		if (smc_arg5(SDEI_EVENT_REGISTER, 0,
 			     (unsigned long)sdei_handler, LOCAL_CPU_BASE,
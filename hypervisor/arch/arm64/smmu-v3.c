@@ -211,6 +211,7 @@
 #define CMDQ_ENT_DWORDS			2
 #define CMDQ_ENT_SIZE			(CMDQ_ENT_DWORDS << 3)
 #define CMDQ_MAX_SZ_SHIFT		8
+#define CMDQ_BATCH_ENTRIES		16
 
 #define CMDQ_CONS_ERR			BIT_MASK(30, 24)
 #define CMDQ_ERR_CERROR_NONE_IDX	0
@@ -256,6 +257,7 @@
 #define EVTQ_0_ID			BIT_MASK(7, 0)
 
 #define ARM_SMMU_SYNC_TIMEOUT		1000000
+#define ARM_SMMU_POLL_SPIN_COUNT	64
 
 #define FIELD_PREP(mask, val)	\
 			(((u64)(val) << (__builtin_ffsl((mask)) - 1)) & (mask))
@@ -276,6 +278,7 @@
 #define CMDQ_OP_TLBI_NSNH_ALL	0x30
 #define CMDQ_OP_CMD_SYNC	0x46
 #define ARM_SMMU_FEAT_2_LVL_STRTAB	(1 << 0)
+#define ARM_SMMU_FEAT_MSI_POLL		(1 << 2)
 
 /* High-level queue structures */
 struct arm_smmu_cmdq_ent {
@@ -331,6 +334,12 @@ struct arm_smmu_cmdq {
 	spinlock_t			lock;
 };
 
+struct arm_smmu_cmdq_batch {
+	u64				cmds[CMDQ_BATCH_ENTRIES *
+					     CMDQ_ENT_DWORDS];
+	unsigned int			num;
+};
+
 struct arm_smmu_evtq {
 	struct arm_smmu_queue		q;
 };
@@ -400,6 +409,12 @@ static void queue_inc_prod(struct arm_smmu_queue *q)
 	u32 prod = (Q_WRP(q->prod, shift) | Q_IDX(q->prod, shift)) + 1;
 
 	q->prod = Q_OVF(q->prod) | Q_WRP(prod, shift) | Q_IDX(prod, shift);
+}
+
+static void queue_publish_prod(struct arm_smmu_queue *q)
+{
+	/* Make the new entries visible before the SMMU can consume them. */
+	dsb(ishst);
 	mmio_write32(q->prod_reg, q->prod);
 }
 
@@ -409,7 +424,6 @@ static void queue_write(u64 *dst, u64 *src, u32 n_dwords)
 
 	for (n = 0; n < n_dwords; ++n)
 		*dst++ = *src++;
-	dsb(ishst);
 }
 
 static u64 *queue_entry(struct arm_smmu_queue *q, u32 reg)
@@ -493,6 +507,7 @@ static void arm_smmu_cmdq_skip_err(struct arm_smmu_device *smmu)
 	 */
 	arm_smmu_cmdq_build_cmd(cmd, &cmd_sync);
 	queue_write(queue_entry(q, q->cons), cmd, q->ent_dwords);
+	dsb(ishst);
 
 	gerrorn = mmio_read32(smmu->base + ARM_SMMU_GERRORN);
 
@@ -500,48 +515,120 @@ static void arm_smmu_cmdq_skip_err(struct arm_smmu_device *smmu)
 	mmio_write32(smmu->base + ARM_SMMU_GERRORN, gerrorn);
 }
 
-static void arm_smmu_cmdq_insert_cmd(struct arm_smmu_device *smmu, u64 *cmd)
+static void arm_smmu_cmdq_wait_cons(struct arm_smmu_device *smmu)
 {
 	struct arm_smmu_queue *q = &smmu->cmdq.q;
 
-	while (queue_full(q))
-		queue_sync_cons(q);
-
-	queue_write(queue_entry(q, q->prod), cmd, q->ent_dwords);
-	queue_inc_prod(q);
-	while (!queue_empty(q)) {
-		queue_sync_cons(q);
-		if (queue_error(smmu, q))
-			arm_smmu_cmdq_skip_err(smmu);
-	}
+	queue_sync_cons(q);
+	if (queue_error(smmu, q))
+		arm_smmu_cmdq_skip_err(smmu);
 }
 
-static void arm_smmu_cmdq_issue_cmd(struct arm_smmu_device *smmu,
-				    struct arm_smmu_cmdq_ent *ent)
+static void arm_smmu_cmdq_poll_sync(struct arm_smmu_device *smmu, u32 *sync)
 {
-	u64 cmd[CMDQ_ENT_DWORDS];
+	volatile u32 *msi_word = sync;
+	unsigned int n;
 
-	if (arm_smmu_cmdq_build_cmd(cmd, ent))
-		/* Ignore any unknown command */
+	if (!(smmu->features & ARM_SMMU_FEAT_MSI_POLL)) {
+		/* No completion write, wait for the queue to drain. */
+		do
+			arm_smmu_cmdq_wait_cons(smmu);
+		while (!queue_empty(&smmu->cmdq.q));
 		return;
+	}
 
-	spin_lock(&smmu->cmdq.lock);
-	arm_smmu_cmdq_insert_cmd(smmu, cmd);
-	spin_unlock(&smmu->cmdq.lock);
+	/*
+	 * The SMMU overwrites the first word of the CMD_SYNC entry with
+	 * MSIDATA (zero) once all preceding commands have completed. Spin on
+	 * that cached word and only fall back to MMIO to catch command errors
+	 * that would otherwise stall the queue.
+	 *
+	 * CONS only moves past a CMD_SYNC once it completed. Checking it as
+	 * well ends the wait if the CMD_SYNC itself faulted and was replaced by
+	 * arm_smmu_cmdq_skip_err(), which leaves no completion write behind.
+	 */
+	for (n = 1; *msi_word != 0; n++) {
+		if (n % ARM_SMMU_POLL_SPIN_COUNT == 0) {
+			arm_smmu_cmdq_wait_cons(smmu);
+			if (queue_empty(&smmu->cmdq.q))
+				break;
+		}
+		cpu_relax();
+	}
 }
 
-static void arm_smmu_cmdq_issue_sync(struct arm_smmu_device *smmu)
+/*
+ * Write a list of commands to the queue, optionally followed by a CMD_SYNC
+ * that is waited for. The producer index is published once for the whole
+ * list unless the queue runs full in between.
+ */
+static void arm_smmu_cmdq_issue_cmdlist(struct arm_smmu_device *smmu,
+					u64 *cmds, unsigned int num, bool sync)
 {
+	struct arm_smmu_queue *q = &smmu->cmdq.q;
 	struct arm_smmu_cmdq_ent ent = { .opcode = CMDQ_OP_CMD_SYNC };
 	u64 cmd[CMDQ_ENT_DWORDS];
-
-	arm_smmu_cmdq_build_cmd(cmd, &ent);
+	u64 *sync_entry = NULL;
+	unsigned int n;
 
 	spin_lock(&smmu->cmdq.lock);
-	arm_smmu_cmdq_insert_cmd(smmu, cmd);
+
+	for (n = 0; n < num + (sync ? 1 : 0); n++) {
+		if (queue_full(q)) {
+			queue_publish_prod(q);
+			do
+				arm_smmu_cmdq_wait_cons(smmu);
+			while (queue_full(q));
+		}
+
+		if (n < num) {
+			queue_write(queue_entry(q, q->prod),
+				    &cmds[n * CMDQ_ENT_DWORDS], q->ent_dwords);
+		} else {
+			sync_entry = queue_entry(q, q->prod);
+			if (smmu->features & ARM_SMMU_FEAT_MSI_POLL)
+				ent.sync.msiaddr = q->base_dma +
+					Q_IDX(q->prod, q->max_n_shift) *
+					CMDQ_ENT_SIZE;
+			arm_smmu_cmdq_build_cmd(cmd, &ent);
+			queue_write(sync_entry, cmd, q->ent_dwords);
+		}
+		queue_inc_prod(q);
+	}
+	queue_publish_prod(q);
+
+	if (sync_entry)
+		arm_smmu_cmdq_poll_sync(smmu, (u32 *)sync_entry);
+
 	spin_unlock(&smmu->cmdq.lock);
 }
 
+static void arm_smmu_cmdq_batch_add(struct arm_smmu_device *smmu,
+				    struct arm_smmu_cmdq_batch *batch,
+				    struct arm_smmu_cmdq_ent *ent)
+{
+	if (batch->num == CMDQ_BATCH_ENTRIES) {
+		arm_smmu_cmdq_issue_cmdlist(smmu, batch->cmds, batch->num,
+					    false);
+		batch->num = 0;
+	}
+
+	if (arm_smmu_cmdq_build_cmd(&batch->cmds[batch->num * CMDQ_ENT_DWORDS],
+				    ent))
+		/* Ignore any unknown command */
+		return;
+
+	batch->num++;
+}
+
+/* Issue all batched commands and wait for their completion. */
+static void arm_smmu_cmdq_batch_submit(struct arm_smmu_device *smmu,
+				       struct arm_smmu_cmdq_batch *batch)
+{
+	arm_smmu_cmdq_issue_cmdlist(smmu, batch->cmds, batch->num, true);
+	batch->num = 0;
+}
+
 /* Stream table manipulation functions */
 static void
 arm_smmu_write_strtab_l1_desc(u64 *dst, struct arm_smmu_strtab_l1_desc *desc)
@@ -556,7 +643,9 @@ arm_smmu_write_strtab_l1_desc(u64 *dst, struct arm_smmu_strtab_l1_desc *desc)
 	dsb(ishst);
 }
 
-static void arm_smmu_sync_ste_for_sid(struct arm_smmu_device *smmu, u32 sid)
+static void arm_smmu_sync_ste_for_sid(struct arm_smmu_device *smmu,
+				      struct arm_smmu_cmdq_batch *batch,
+				      u32 sid)
 {
 	struct arm_smmu_cmdq_ent cmd = {
 		.opcode	= CMDQ_OP_CFGI_STE,
@@ -566,19 +655,23 @@ static void arm_smmu_sync_ste_for_sid(struct arm_smmu_device *smmu, u32 sid)
 		},
 	};
 
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-	arm_smmu_cmdq_issue_sync(smmu);
+	arm_smmu_cmdq_batch_add(smmu, batch, &cmd);
 }
 
-static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
-				      u64 *guest_ste, u64 *dst, bool bypass,
-				      u32 vmid)
+/*
+ * Write all words of an STE except the first one. For translating STEs, the
+ * entry is switched over by arm_smmu_enable_strtab_ent() after the batch was
+ * submitted, i.e. after the SMMU dropped any copy of the old configuration.
+ */
+static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu,
+				      struct arm_smmu_cmdq_batch *batch,
+				      u32 sid, u64 *guest_ste, u64 *dst,
+				      bool bypass, struct cell *cell)
 {
-	struct paging_structures *pg_structs = &this_cell()->arch.mm;
+	struct paging_structures *pg_structs = &cell->arch.mm;
+	u32 vmid = cell->config->id;
 	u64 val, vttbr;
 
-	val = 0;
-
 	/* Bypass */
 	if (bypass) {
 		val = STRTAB_STE_0_V;
@@ -589,7 +682,7 @@ static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
 		dst[0] = val;
 		dsb(ishst);
 		if (smmu)
-			arm_smmu_sync_ste_for_sid(smmu, sid);
+			arm_smmu_sync_ste_for_sid(smmu, batch, sid);
 		return;
 	}
 
@@ -600,14 +693,23 @@ static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
 
 	vttbr = paging_hvirt2phys(pg_structs->root_table);
 	dst[3] = vttbr & STRTAB_STE_3_S2TTB_MASK;
+	dsb(ishst);
+
+	arm_smmu_sync_ste_for_sid(smmu, batch, sid);
+}
+
+static void arm_smmu_enable_strtab_ent(struct arm_smmu_device *smmu,
+				       struct arm_smmu_cmdq_batch *batch,
+				       u32 sid, u64 *dst)
+{
+	u64 val = 0;
 
 	val |= FIELD_PREP(STRTAB_STE_0_CFG, STRTAB_STE_0_CFG_S2_TRANS);
 	val |= STRTAB_STE_0_V;
 
-	arm_smmu_sync_ste_for_sid(smmu, sid);
 	dst[0] = val;
 	dsb(ishst);
-	arm_smmu_sync_ste_for_sid(smmu, sid);
+	arm_smmu_sync_ste_for_sid(smmu, batch, sid);
 }
 
 static void arm_smmu_init_bypass_stes(u64 *strtab, unsigned int nent)
@@ -615,8 +717,8 @@ static void arm_smmu_init_bypass_stes(u64 *strtab, unsigned int nent)
 	unsigned int n;
 
 	for (n = 0; n < nent; ++n) {
-		arm_smmu_write_strtab_ent(NULL, -1, NULL, strtab, true,
-					  (u32)this_cell()->config->id);
+		arm_smmu_write_strtab_ent(NULL, NULL, -1, NULL, strtab, true,
+					  this_cell());
 		strtab += STRTAB_STE_DWORDS;
 	}
 }
@@ -808,6 +910,7 @@ static int arm_smmu_write_reg_sync(struct arm_smmu_device *smmu, u32 val,
 
 static int arm_smmu_device_reset(struct arm_smmu_device *smmu)
 {
+	struct arm_smmu_cmdq_batch batch = { .num = 0 };
 	int ret;
 	u32 reg, enables;
 	struct arm_smmu_cmdq_ent cmd;
@@ -845,16 +948,14 @@ static int arm_smmu_device_reset(struct arm_smmu_device *smmu)
 
 	/* Invalidate any cached configuration */
 	cmd.opcode = CMDQ_OP_CFGI_ALL;
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-	arm_smmu_cmdq_issue_sync(smmu);
-
-	cmd.opcode = CMDQ_OP_TLBI_NSNH_ALL;
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
+	arm_smmu_cmdq_batch_add(smmu, &batch, &cmd);
 
 	/* Invalidate any stale TLB entries */
+	cmd.opcode = CMDQ_OP_TLBI_NSNH_ALL;
+	arm_smmu_cmdq_batch_add(smmu, &batch, &cmd);
 	cmd.opcode = CMDQ_OP_TLBI_EL2_ALL;
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-	arm_smmu_cmdq_issue_sync(smmu);
+	arm_smmu_cmdq_batch_add(smmu, &batch, &cmd);
+	arm_smmu_cmdq_batch_submit(smmu, &batch);
 
 	/* Event queue */
 	mmio_write64(smmu->base + ARM_SMMU_EVTQ_BASE, smmu->evtq.q.q_base);
@@ -891,6 +992,13 @@ static int arm_smmu_device_init_features(struct arm_smmu_device *smmu)
 	if (!(reg & IDR0_S2P))
 		return trace_error(-ENODEV);
 
+	/*
+	 * Let CMD_SYNC signal completion by writing to the queue memory if
+	 * that write is coherent with the CPU caches.
+	 */
+	if ((reg & IDR0_MSI) && (reg & IDR0_COHACC))
+		smmu->features |= ARM_SMMU_FEAT_MSI_POLL;
+
 	if (FIELD_GET(IDR0_S1P, reg))
 		smmu->features |= IDR0_S1P;
 
@@ -924,7 +1032,8 @@ static int arm_smmu_device_init_features(struct arm_smmu_device *smmu)
 	return 0;
 }
 
-static int arm_smmu_init_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
+static int arm_smmu_init_l2_strtab(struct arm_smmu_device *smmu,
+				   struct arm_smmu_cmdq_batch *batch, u32 sid)
 {
 	struct arm_smmu_strtab_cfg *cfg = &smmu->strtab_cfg;
 	struct arm_smmu_strtab_l1_desc *desc;
@@ -955,17 +1064,19 @@ static int arm_smmu_init_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
 	cmd.opcode = CMDQ_OP_CFGI_STE;
 	cmd.cfgi.sid = sid;
 	cmd.cfgi.leaf = false;
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
+	arm_smmu_cmdq_batch_add(smmu, batch, &cmd);
 
 	return 0;
 }
 
-static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
+static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu,
+				      struct arm_smmu_cmdq_batch *batch,
+				      u32 sid)
 {
 	struct arm_smmu_strtab_cfg *cfg = &smmu->strtab_cfg;
 	struct arm_smmu_strtab_l1_desc *desc;
 	struct arm_smmu_cmdq_ent cmd;
-	void *strtab;
+	void *strtab, *l2ptr;
 	u32 size;
 
 	desc = &cfg->l1_desc[sid >> STRTAB_SPLIT];
@@ -974,20 +1085,25 @@ static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
 	if (desc->active_stes)
 		return;
 
+	l2ptr = desc->l2ptr;
 	desc->l2ptr = NULL;
 	desc->l2ptr_dma = 0;
 	desc->span = 0;
 	strtab = &cfg->strtab[(sid >> STRTAB_SPLIT) * STRTAB_L1_DESC_DWORDS];
 	arm_smmu_write_strtab_l1_desc(strtab, desc);
 
-	/* Invalidate cached L1 descriptors. */
+	/*
+	 * Invalidate cached L1 descriptors. The L2 table may only be released
+	 * once the SMMU has completed this.
+	 */
 	cmd.opcode = CMDQ_OP_CFGI_STE;
 	cmd.cfgi.sid = sid;
 	cmd.cfgi.leaf = false;
-	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
+	arm_smmu_cmdq_batch_add(smmu, batch, &cmd);
+	arm_smmu_cmdq_batch_submit(smmu, batch);
 
 	size = 1 << (STRTAB_SPLIT + STRTAB_STE_DWORDS_BITS + 3);
-	page_free(&mem_pool, desc->l2ptr, PAGES(size));
+	page_free(&mem_pool, l2ptr, PAGES(size));
 }
 
 static u64 *arm_smmu_get_step_for_sid(struct arm_smmu_device *smmu, u32 sid)
@@ -1012,37 +1128,42 @@ static u64 *arm_smmu_get_step_for_sid(struct arm_smmu_device *smmu, u32 sid)
 	return step;
 }
 
-static int arm_smmu_init_ste(struct arm_smmu_device *smmu, u32 sid, u32 vmid)
+static int arm_smmu_init_ste(struct arm_smmu_device *smmu,
+			     struct arm_smmu_cmdq_batch *batch, u32 sid,
+			     struct cell *cell)
 {
 	int ret = 0;
 	u64 *step;
 
 	if (smmu->features & ARM_SMMU_FEAT_2_LVL_STRTAB) {
-		ret = arm_smmu_init_l2_strtab(smmu, sid);
+		ret = arm_smmu_init_l2_strtab(smmu, batch, sid);
 		if (ret)
 			return ret;
 	}
 
 	step = arm_smmu_get_step_for_sid(smmu, sid);
-	arm_smmu_write_strtab_ent(smmu, sid, NULL, step, false, vmid);
+	arm_smmu_write_strtab_ent(smmu, batch, sid, NULL, step, false, cell);
 
 	return 0;
 }
 
-static void arm_smmu_uninit_ste(struct arm_smmu_device *smmu, u32 sid, u32 vmid)
+static void arm_smmu_uninit_ste(struct arm_smmu_device *smmu,
+				struct arm_smmu_cmdq_batch *batch, u32 sid,
+				struct cell *cell)
 {
 	u64 *step;
 
 	step = arm_smmu_get_step_for_sid(smmu, sid);
-	arm_smmu_write_strtab_ent(smmu, sid, NULL, step, true, vmid);
+	arm_smmu_write_strtab_ent(smmu, batch, sid, NULL, step, true, cell);
 
 	if (smmu->features & ARM_SMMU_FEAT_2_LVL_STRTAB)
-		arm_smmu_uninit_l2_strtab(smmu, sid);
+		arm_smmu_uninit_l2_strtab(smmu, batch, sid);
 }
 
 static int arm_smmuv3_cell_init(struct cell *cell)
 {
 	struct arm_smmu_device *smmu = &smmu_devices[0];
+	struct arm_smmu_cmdq_batch batch = { .num = 0 };
 	struct jailhouse_iommu *iommu;
 	struct arm_smmu_cmdq_ent cmd;
 	union jailhouse_stream_id sid;
@@ -1057,16 +1178,27 @@ static int arm_smmuv3_cell_init(struct cell *cell)
 		if (iommu->type != JAILHOUSE_IOMMU_SMMUV3)
 			continue;
 
+		/*
+		 * Prepare all STEs of the cell first and switch them over
+		 * together, so that only two CMD_SYNCs are needed per SMMU.
+		 */
 		for_each_stream_id(sid, cell->config, s) {
-			ret = arm_smmu_init_ste(smmu, sid.id, cell->config->id);
-			if (ret)
+			ret = arm_smmu_init_ste(smmu, &batch, sid.id, cell);
+			if (ret) {
+				arm_smmu_cmdq_batch_submit(smmu, &batch);
 				return ret;
+			}
 		}
+		arm_smmu_cmdq_batch_submit(smmu, &batch);
+
+		for_each_stream_id(sid, cell->config, s)
+			arm_smmu_enable_strtab_ent(smmu, &batch, sid.id,
+				arm_smmu_get_step_for_sid(smmu, sid.id));
 
 		cmd.opcode	= CMDQ_OP_TLBI_S12_VMALL;
 		cmd.tlbi.vmid	= cell->config->id;
-		arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-		arm_smmu_cmdq_issue_sync(smmu);
+		arm_smmu_cmdq_batch_add(smmu, &batch, &cmd);
+		arm_smmu_cmdq_batch_submit(smmu, &batch);
 	}
 
 	return 0;
@@ -1075,6 +1207,7 @@ static int arm_smmuv3_cell_init(struct cell *cell)
 static void arm_smmuv3_cell_exit(struct cell *cell)
 {
 	struct arm_smmu_device *smmu = &smmu_devices[0];
+	struct arm_smmu_cmdq_batch batch = { .num = 0 };
 	struct jailhouse_iommu *iommu;
 	struct arm_smmu_cmdq_ent cmd;
 	union jailhouse_stream_id sid;
@@ -1089,13 +1222,13 @@ static void arm_smmuv3_cell_exit(struct cell *cell)
 			continue;
 
 		for_each_stream_id(sid, cell->config, s) {
-			arm_smmu_uninit_ste(smmu, sid.id, cell->config->id);
+			arm_smmu_uninit_ste(smmu, &batch, sid.id, cell);
 		}
 
 		cmd.opcode	= CMDQ_OP_TLBI_S12_VMALL;
 		cmd.tlbi.vmid	= cell->config->id;
-		arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-		arm_smmu_cmdq_issue_sync(smmu);
+		arm_smmu_cmdq_batch_add(smmu, &batch, &cmd);
+		arm_smmu_cmdq_batch_submit(smmu, &batch);
 	}
 }
 
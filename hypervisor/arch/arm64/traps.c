@@ -13,6 +13,7 @@
 
 #include <jailhouse/control.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/tracing.h>
 #include <asm/control.h>
 #include <asm/entry.h>
 #include <asm/gic.h>
@@ -177,6 +178,7 @@ void arch_handle_trap(union registers *guest_regs)
 	int ret = TRAP_UNHANDLED;
 
 	fill_trap_context(&ctx, guest_regs);
+	trace_exit_begin(ESR_EC(ctx.esr), ctx.elr);
 
 	handler = trap_handlers[ESR_EC(ctx.esr)];
 	if (handler)
@@ -191,6 +193,17 @@ void arch_handle_trap(union registers *guest_regs)
 		dump_regs(&ctx);
 		panic_park();
 	}
+	trace_exit_end();
+}
+
+void arch_handle_irq(union registers *guest_regs)
+{
+	u64 pc;
+
+	arm_read_sysreg(ELR_EL2, pc);
+	trace_exit_begin(JAILHOUSE_TRACE_REASON_ARM64_IRQ, pc);
+	irqchip_handle_irq();
+	trace_exit_end();
 }
 
 void arch_el2_abt(union registers *regs)
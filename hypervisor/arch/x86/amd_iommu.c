@@ -406,6 +406,42 @@ static void amd_iommu_invalidate_pages(struct amd_iommu *iommu,
 	amd_iommu_submit_command(iommu, &invalidate_pages, false);
 }
 
+static void amd_iommu_invalidate_range(struct amd_iommu *iommu,
+				       u16 domain_id, unsigned long start,
+				       unsigned long size)
+{
+	unsigned long end = start + size, addr, chunk;
+	union buf_entry invalidate_pages;
+
+	while (start < end) {
+		/* Largest naturally aligned power-of-two chunk that fits. */
+		for (chunk = PAGE_SIZE;
+		     (start & (2 * chunk - 1)) == 0 && start + 2 * chunk <= end;
+		     chunk *= 2)
+			; /* empty loop */
+
+		memset(&invalidate_pages, 0, sizeof(invalidate_pages));
+		invalidate_pages.raw32[1] = domain_id;
+
+		/*
+		 * With the S bit set, the first clear address bit above bit 12
+		 * encodes the size of the range (see Sect. 2.2.3).
+		 */
+		addr = start;
+		if (chunk > PAGE_SIZE)
+			addr |= (chunk / 2 - 1) & PAGE_MASK;
+		invalidate_pages.raw32[2] = (addr & 0xfffff000) |
+			(chunk > PAGE_SIZE ? CMD_INV_IOMMU_PAGES_SIZE : 0) |
+			CMD_INV_IOMMU_PAGES_PDE;
+		invalidate_pages.raw32[3] = addr >> 32;
+		invalidate_pages.type = CMD_INV_IOMMU_PAGES;
+
+		amd_iommu_submit_command(iommu, &invalidate_pages, false);
+
+		start += chunk;
+	}
+}
+
 static void amd_iommu_completion_wait(struct amd_iommu *iommu)
 {
 	long addr = paging_hvirt2phys(&per_cpu(this_cpu_id())->amd_iommu_sem);
@@ -475,6 +511,7 @@ static void amd_iommu_init_fault_nmi(void)
 void iommu_config_commit(struct cell *cell_added_removed)
 {
 	struct amd_iommu *iommu;
+	unsigned int n;
 
 	// HACK for QEMU
 	if (iommu_units_count == 0)
@@ -491,6 +528,15 @@ void iommu_config_commit(struct cell *cell_added_removed)
 					cell_added_removed->config->id & 0xffff);
 			amd_iommu_invalidate_pages(iommu,
 					root_cell.config->id & 0xffff);
+		} else if (root_cell.dirty_overflow) {
+			amd_iommu_invalidate_pages(iommu,
+					root_cell.config->id & 0xffff);
+		} else {
+			for (n = 0; n < root_cell.num_dirty_ranges; n++)
+				amd_iommu_invalidate_range(iommu,
+					root_cell.config->id & 0xffff,
+					root_cell.dirty_ranges[n].start,
+					root_cell.dirty_ranges[n].size);
 		}
 		/* Execute all commands in the buffer */
 		amd_iommu_completion_wait(iommu);
@@ -15,6 +15,7 @@
 #include <jailhouse/processor.h>
 #include <jailhouse/paging.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/string.h>
 #include <jailhouse/control.h>
 #include <jailhouse/mmio.h>
 #include <asm/apic.h>
@@ -22,6 +23,10 @@
 
 #define XAPIC_REG(x2apic_reg)		((x2apic_reg) << 4)
 
+#if (APIC_MAX_PHYS_ID >> X2APIC_CLUSTER_ID_SHIFT) >= X2APIC_MAX_CLUSTERS
+#error X2APIC_MAX_CLUSTERS too small
+#endif
+
  /**
   * Modern x86 processors are equipped with a local APIC that handles delivery
   * of external interrupts. The APIC can work in two modes:
@@ -140,6 +145,12 @@ unsigned long phys_processor_id(void)
 	return apic_ops.read_id();
 }
 
+static void apic_add_logical_dest(struct cell *cell, unsigned int apic_id)
+{
+	cell->arch.x2apic_logical_dest[apic_id >> X2APIC_CLUSTER_ID_SHIFT] |=
+		1 << (apic_id & ((1 << X2APIC_CLUSTER_ID_SHIFT) - 1));
+}
+
 int apic_cpu_init(struct per_cpu *cpu_data)
 {
 	unsigned int xlc = MAX((apic_ext_features() >> 16) & 0xff,
@@ -165,6 +176,8 @@ int apic_cpu_init(struct per_cpu *cpu_data)
 
 	apic_to_cpu_id[apic_id] = cpu_id;
 	cpu_data->public.apic_id = apic_id;
+	/* all CPUs start in the root cell */
+	apic_add_logical_dest(&root_cell, apic_id);
 
 	cpu_data->public.sipi_vector = -1;
 
@@ -353,13 +366,17 @@ void apic_clear(void)
 	apic_ops.write(APIC_REG_SVR, 0xff);
 }
 
+static void apic_invalid_ipi_dest(u32 orig_icr_hi)
+{
+	printk("WARNING: CPU %d specified IPI destination outside "
+	       "cell boundaries, ICR.hi=%x\n", this_cpu_id(), orig_icr_hi);
+}
+
 static void apic_send_ipi(unsigned int target_cpu_id, u32 orig_icr_hi,
 			  u32 icr_lo)
 {
 	if (!cell_owns_cpu(this_cell(), target_cpu_id)) {
-		printk("WARNING: CPU %d specified IPI destination outside "
-		       "cell boundaries, ICR.hi=%x\n",
-		       this_cpu_id(), orig_icr_hi);
+		apic_invalid_ipi_dest(orig_icr_hi);
 		return;
 	}
 
@@ -386,13 +403,18 @@ static void apic_send_ipi(unsigned int target_cpu_id, u32 orig_icr_hi,
 
 static void apic_send_logical_dest_ipi(u32 lo_val, u32 hi_val)
 {
-	unsigned int target_cpu_id = CPU_ID_INVALID;
 	unsigned long dest = hi_val;
+	unsigned int target_cpu_id;
 	unsigned int logical_id;
 	unsigned int cluster_id;
 	unsigned int apic_id;
 
 	if (using_x2apic) {
+		/* only the cell's own CPUs remain after filtering */
+		dest = x2apic_filter_logical_dest(this_cell(), hi_val);
+		if (dest != hi_val)
+			apic_invalid_ipi_dest(hi_val);
+
 		cluster_id = (dest & X2APIC_DEST_CLUSTER_ID_MASK) >>
 			X2APIC_DEST_CLUSTER_ID_SHIFT;
 		dest &= X2APIC_DEST_LOGICAL_ID_MASK;
@@ -401,8 +423,7 @@ static void apic_send_logical_dest_ipi(u32 lo_val, u32 hi_val)
 			dest &= ~(1UL << logical_id);
 			apic_id = logical_id |
 				(cluster_id << X2APIC_CLUSTER_ID_SHIFT);
-			if (apic_id <= APIC_MAX_PHYS_ID)
-				target_cpu_id = apic_to_cpu_id[apic_id];
+			target_cpu_id = apic_to_cpu_id[apic_id];
 			apic_send_ipi(target_cpu_id, hi_val, lo_val);
 		}
 	} else
@@ -514,7 +535,8 @@ unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 		return 0;
 	}
 
-	inst = x86_mmio_parse(pg_structs, is_write);
+	inst = x86_mmio_parse(pg_structs, XAPIC_BASE + XAPIC_REG(reg),
+			      is_write);
 	if (inst.inst_len == 0)
 		return 0;
 	if (inst.access_size != 4) {
@@ -559,7 +581,7 @@ unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 bool x2apic_handle_write(void)
 {
 	union registers *guest_regs = &this_cpu_data()->guest_regs;
-	u32 *stats = this_cpu_public()->stats;
+	u64 *stats = this_cpu_public()->stats;
 	u32 reg = guest_regs->rcx - MSR_X2APIC_BASE;
 	u32 val = guest_regs->rax;
 
@@ -589,7 +611,7 @@ void x2apic_handle_read(void)
 {
 	union registers *guest_regs = &this_cpu_data()->guest_regs;
 	u32 reg = guest_regs->rcx - MSR_X2APIC_BASE;
-	u32 *stats = this_cpu_public()->stats;
+	u64 *stats = this_cpu_public()->stats;
 
 	if (reg == APIC_REG_ID)
 		guest_regs->rax = apic_ops.read_id();
@@ -614,19 +636,45 @@ void x2apic_handle_read(void)
  */
 u32 x2apic_filter_logical_dest(struct cell *cell, u32 destination)
 {
-	unsigned int apic_id, logical_id, cluster_id;
-	u32 dest;
-
-	cluster_id = (destination & X2APIC_DEST_CLUSTER_ID_MASK) >>
+	unsigned int cluster_id = (destination & X2APIC_DEST_CLUSTER_ID_MASK) >>
 		X2APIC_DEST_CLUSTER_ID_SHIFT;
-	dest = destination & X2APIC_DEST_LOGICAL_ID_MASK;
-	while (dest != 0) {
-		logical_id = ffsl(dest);
-		dest &= ~(1UL << logical_id);
-		apic_id = logical_id | (cluster_id << X2APIC_CLUSTER_ID_SHIFT);
-		if (apic_id > APIC_MAX_PHYS_ID ||
-		    !cell_owns_cpu(cell, apic_to_cpu_id[apic_id]))
-			destination &= ~(1UL << logical_id);
-	}
-	return destination;
+
+	if (cluster_id >= X2APIC_MAX_CLUSTERS)
+		return destination & X2APIC_DEST_CLUSTER_ID_MASK;
+
+	return destination & (X2APIC_DEST_CLUSTER_ID_MASK |
+			      cell->arch.x2apic_logical_dest[cluster_id]);
+}
+
+/**
+ * Rebuild the logical destination masks of a cell from its CPU set.
+ * @param cell		Cell to be updated.
+ *
+ * @see x2apic_filter_logical_dest
+ */
+void apic_update_logical_dest(struct cell *cell)
+{
+	unsigned int cpu;
+
+	memset(cell->arch.x2apic_logical_dest, 0,
+	       sizeof(cell->arch.x2apic_logical_dest));
+
+	for_each_cpu(cpu, cell->cpu_set)
+		apic_add_logical_dest(cell, public_per_cpu(cpu)->apic_id);
+}
+
+/**
+ * Update the logical destination masks after CPUs changed their cell.
+ * @param cell_added_removed	Cell that was added or removed to/from the
+ * 				system or NULL.
+ *
+ * Only the root cell's CPU set changes on cell creation and destruction. New
+ * cells obtain their masks on creation.
+ *
+ * @see apic_update_logical_dest
+ */
+void apic_config_commit(struct cell *cell_added_removed)
+{
+	if (cell_added_removed)
+		apic_update_logical_dest(&root_cell);
 }
@@ -38,6 +38,9 @@ int arch_cell_create(struct cell *cell)
 	if (err)
 		return err;
 
+	/* required before interrupt destinations of the cell are validated */
+	apic_update_logical_dest(cell);
+
 	return 0;
 }
 
@@ -104,6 +107,7 @@ void arch_cell_reset(struct cell *cell)
 
 void arch_config_commit(struct cell *cell_added_removed)
 {
+	apic_config_commit(cell_added_removed);
 	iommu_config_commit(cell_added_removed);
 	ioapic_config_commit(cell_added_removed);
 }
@@ -170,5 +170,8 @@ void x2apic_handle_read(void);
 
 u32 x2apic_filter_logical_dest(struct cell *cell, u32 destination);
 
+void apic_update_logical_dest(struct cell *cell);
+void apic_config_commit(struct cell *cell_added_removed);
+
 /** @} */
 #endif /* !_JAILHOUSE_ASM_APIC_H */
@@ -58,6 +58,19 @@ static inline int atomic_test_and_set_bit(int nr, volatile unsigned long *addr)
 	return oldbit;
 }
 
+/* Returns the previous value, *addr was updated if that equals old. */
+static inline unsigned int atomic_cmpxchg(volatile unsigned int *addr,
+					  unsigned int old, unsigned int new)
+{
+	unsigned int prev;
+
+	asm volatile("lock cmpxchgl %2,%1"
+		     : "=a" (prev), "+m" (*addr)
+		     : "r" (new), "0" (old) : "memory");
+
+	return prev;
+}
+
 static inline unsigned long ffzl(unsigned long word)
 {
 	asm("rep; bsf %1,%0"
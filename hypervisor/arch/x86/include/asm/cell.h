@@ -17,6 +17,9 @@
 
 #include <jailhouse/paging.h>
 
+/** Number of x2APIC clusters covering all supported physical APIC IDs. */
+#define X2APIC_MAX_CLUSTERS	16
+
 struct cell_ioapic;
 
 /** x86-specific cell states. */
@@ -29,6 +32,9 @@ struct arch_cell {
 	/* Intel: PIO access bitmap.
 	 * AMD: I/O Permissions Map. */
 	u8 *io_bitmap;
+	/* Intel: MSR bitmap.
+	 * AMD: MSR Permissions Map. */
+	u8 *msr_bitmap;
 	union {
 		struct {
 			/** Paging structures used for cell CPUs. */
@@ -47,6 +53,12 @@ struct arch_cell {
 			/** True if interrupt remapping support is emulated for this
 			 * cell. */
 			bool ir_emulation;
+			/** True if context entries of this cell were changed
+			 * since the last config commit. */
+			bool contexts_changed;
+			/** True if DMA requests are translated by the EPT
+			 * of the cell instead of a private table. */
+			bool ept_shared;
 		} vtd; /**< Intel VT-d specific fields. */
 	};
 
@@ -58,6 +70,10 @@ struct arch_cell {
 	/** Number of assigned IOAPICs. */
 	unsigned int num_ioapics;
 
+	/** Logical x2APIC destination masks of the cell's CPUs per cluster,
+	 * updated on config commit. */
+	u16 x2apic_logical_dest[X2APIC_MAX_CLUSTERS];
+
 	/** Class Of Service for cache allocation (Intel only). */
 	u32 cos;
 	/** Allocated L3 cache region (Intel only). */
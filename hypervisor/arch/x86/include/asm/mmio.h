@@ -10,6 +10,9 @@
  * the COPYING file in the top-level directory.
  */
 
+#ifndef _JAILHOUSE_ASM_MMIO_H
+#define _JAILHOUSE_ASM_MMIO_H
+
 #include <jailhouse/paging.h>
 
 /**
@@ -37,15 +40,57 @@ struct mmio_instruction {
 	unsigned long reg_preserve_mask;
 };
 
+/** Number of decoded MMIO instructions cached per CPU. */
+#define MMIO_INST_CACHE_SIZE	4
+
+/** Cached decoding result of an MMIO instruction. */
+struct mmio_inst_cache_entry {
+	/** Guest instruction pointer. */
+	u64 rip;
+	/** Guest paging mode, see guest_paging_structures::root_paging. */
+	const struct paging *root_paging;
+	/** Guest page table root, see
+	 * guest_paging_structures::root_table_gphys. */
+	unsigned long root_table_gphys;
+	/** Guest-physical address of the access. */
+	u64 phys_addr;
+	/** Guest CS attributes, defining default operand and address size. */
+	u16 cs_attr;
+	/** True if write access. */
+	bool is_write;
+	/** True if mmio_instruction::out_val is an immediate value. */
+	bool out_imm;
+	/** Number of the register providing the output value if not an
+	 * immediate. */
+	unsigned int out_reg_num;
+	/** Decoded instruction, inst_len is 0 for unused entries. */
+	struct mmio_instruction inst;
+};
+
 /**
  * Parse instruction causing an intercepted MMIO access on a cell CPU.
  * @param pg_structs	Currently active guest (cell) paging structures.
+ * @param phys_addr	Guest-physical address of the access.
  * @param is_write	True if write access, false for read.
  *
+ * Decoding results are cached per CPU, keyed by the guest instruction
+ * pointer, page table root and accessed address, so that repeated accesses
+ * from the same instruction do not walk the guest page tables again.
+ *
  * @return MMIO instruction information. mmio_instruction::inst_len is 0 on
  * 	   invalid or unsupported access.
+ *
+ * @see x86_mmio_flush_inst_cache
  */
 struct mmio_instruction
-x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write);
+x86_mmio_parse(const struct guest_paging_structures *pg_structs, u64 phys_addr,
+	       bool is_write);
+
+/**
+ * Invalidate the decoded MMIO instructions cached for the calling CPU.
+ */
+void x86_mmio_flush_inst_cache(void);
 
 /** @} */
+
+#endif /* !_JAILHOUSE_ASM_MMIO_H */
@@ -13,6 +13,7 @@
  */
 
 #include <jailhouse/cell.h>
+#include <asm/mmio.h>
 #include <asm/svm.h>
 #include <asm/vmx.h>
 
@@ -20,6 +21,15 @@
 
 #define STACK_SIZE			PAGE_SIZE
 
+#ifdef CONFIG_SVM_CHECK_CLEAN_BITS
+#define SVM_VMCB_SHADOW_FIELD						\
+	/** VMCB as seen after the last VM exit, see			\
+	 *  svm_check_clean_bits(). */					\
+	struct vmcb vmcb_shadow;
+#else
+#define SVM_VMCB_SHADOW_FIELD
+#endif
+
 #define ARCH_PUBLIC_PERCPU_FIELDS					\
 	/** Physical APIC ID. */					\
 	u32 apic_id;							\
@@ -81,7 +91,8 @@
 									\
 	/* IOMMU request completion flags */				\
 	union {								\
-		volatile u32 vtd_iq_completed;				\
+		/** One per DMAR unit for parallel submission. */	\
+		volatile u32 vtd_iq_completed[JAILHOUSE_MAX_IOMMU_UNITS]; \
 		volatile u64 amd_iommu_sem;				\
 	};								\
 									\
@@ -97,6 +108,12 @@
 	/** Number of iterations to clear pending APIC IRQs. */		\
 	unsigned int num_clear_apic_irqs;				\
 									\
+	/** Cache of decoded MMIO instructions. */			\
+	struct mmio_inst_cache_entry					\
+		mmio_inst_cache[MMIO_INST_CACHE_SIZE];			\
+	/** Next mmio_inst_cache entry to be replaced. */		\
+	unsigned int mmio_inst_cache_next;				\
+									\
 	union {								\
 		struct {						\
 			/** VMXON region, required by VMX. */		\
@@ -113,5 +130,6 @@
 			/** SVM Host save area; opaque to us. */	\
 			u8 host_state[PAGE_SIZE]			\
 				__attribute__((aligned(PAGE_SIZE)));	\
+			SVM_VMCB_SHADOW_FIELD				\
 		};							\
 	};
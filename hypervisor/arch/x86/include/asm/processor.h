@@ -29,6 +29,7 @@
 #define X86_FEATURE_HYPERVISOR				(1 << 31)
 
 /* leaf 0x07, subleaf 0, EBX */
+#define X86_FEATURE_ERMS				(1 << 9)
 #define X86_FEATURE_INVPCID				(1 << 10)
 #define X86_FEATURE_CAT					(1 << 15)
 
@@ -72,12 +73,17 @@
 
 #define MSR_IA32_APICBASE				0x0000001b
 #define MSR_IA32_FEATURE_CONTROL			0x0000003a
+#define MSR_IA32_PMC0					0x000000c1
+#define MSR_IA32_PERFEVTSEL0				0x00000186
 #define MSR_IA32_PAT					0x00000277
 #define MSR_IA32_MTRR_DEF_TYPE				0x000002ff
 #define MSR_IA32_SYSENTER_CS				0x00000174
 #define MSR_IA32_SYSENTER_ESP				0x00000175
 #define MSR_IA32_SYSENTER_EIP				0x00000176
+#define MSR_IA32_FIXED_CTR0				0x00000309
+#define MSR_IA32_FIXED_CTR_CTRL				0x0000038d
 #define MSR_IA32_PERF_GLOBAL_CTRL			0x0000038f
+#define MSR_IA32_PERF_GLOBAL_INUSE			0x00000392
 #define MSR_IA32_VMX_BASIC				0x00000480
 #define MSR_IA32_VMX_PINBASED_CTLS			0x00000481
 #define MSR_IA32_VMX_PROCBASED_CTLS			0x00000482
@@ -91,6 +97,7 @@
 #define MSR_IA32_VMX_PROCBASED_CTLS2			0x0000048b
 #define MSR_IA32_VMX_EPT_VPID_CAP			0x0000048c
 #define MSR_IA32_VMX_TRUE_PROCBASED_CTLS		0x0000048e
+#define MSR_IA32_A_PMC0					0x000004c1
 #define MSR_X2APIC_BASE					0x00000800
 #define MSR_X2APIC_ICR					0x00000830
 #define MSR_X2APIC_END					0x0000083f
@@ -104,6 +111,13 @@
 #define MSR_FS_BASE					0xc0000100
 #define MSR_GS_BASE					0xc0000101
 #define MSR_KERNGS_BASE					0xc0000102
+#define MSR_TSC_AUX					0xc0000103
+#define MSR_AMD64_PERF_CNTR_GLOBAL_STATUS		0xc0000300
+#define MSR_AMD64_PERF_CNTR_GLOBAL_STATUS_CLR		0xc0000302
+#define MSR_AMD_PERF_CTL0				0xc0010000
+#define MSR_AMD_PERF_CTR3				0xc0010007
+#define MSR_AMD_F15H_PERF_CTL0				0xc0010200
+#define MSR_AMD_F15H_PERF_CTR5				0xc001020b
 
 #define FEATURE_CONTROL_LOCKED				(1 << 0)
 #define FEATURE_CONTROL_VMXON_ENABLED_OUTSIDE_SMX	(1 << 2)
@@ -233,6 +247,20 @@ static inline void memory_load_barrier(void)
 	asm volatile("lfence" : : : "memory");
 }
 
+/* Stores are not reordered against other stores on x86. */
+static inline void memory_store_barrier(void)
+{
+	asm volatile("" : : : "memory");
+}
+
+static inline u64 read_timestamp(void)
+{
+	u32 lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return lo | ((u64)hi << 32);
+}
+
 static inline void cpuid(unsigned int *eax, unsigned int *ebx,
 			 unsigned int *ecx, unsigned int *edx)
 {
@@ -35,6 +35,7 @@
 #define SVM_MSRPM_C001		2
 #define SVM_MSRPM_RESV		3
 
+#define SVM_TLB_FLUSH_NONE	0x00
 #define SVM_TLB_FLUSH_ALL	0x01
 #define SVM_TLB_FLUSH_GUEST	0x03
 
@@ -25,6 +25,11 @@
 	 X86_CR0_MP | X86_CR0_PE)
 #define X86_CR4_HOST_STATE	X86_CR4_PAE
 
+#define for_each_msr_region(msr, config, counter)			\
+	for ((msr) = jailhouse_cell_msr_regions(config), (counter) = 0;	\
+	     (counter) < (config)->num_msr_regions;			\
+	     (msr)++, (counter)++)
+
 struct vcpu_io_intercept {
 	u16 port;
 	unsigned int size;
@@ -225,6 +225,7 @@ enum vmx_state { VMXOFF = 0, VMXON, VMCS_READY };
 #define SECONDARY_EXEC_VIRTUALIZE_APIC_ACCESSES	(1UL << 0)
 #define SECONDARY_EXEC_ENABLE_EPT		(1UL << 1)
 #define SECONDARY_EXEC_RDTSCP			(1UL << 3)
+#define SECONDARY_EXEC_ENABLE_VPID		(1UL << 5)
 #define SECONDARY_EXEC_UNRESTRICTED_GUEST	(1UL << 7)
 #define SECONDARY_EXEC_INVPCID			(1UL << 12)
 #define SECONDARY_EXEC_XSAVES			(1UL << 20)
@@ -317,9 +318,16 @@ enum vmx_state { VMXOFF = 0, VMXON, VMCS_READY };
 #define EPT_MANDATORY_FEATURES			(EPT_PAGE_WALK_4 | EPTP_WB | \
 						 EPT_INVEPT)
 
+#define VPID_INVVPID				(1UL << 32)
+#define VPID_INVVPID_SINGLE			(1UL << 41)
+#define VPID_INVVPID_GLOBAL			(1UL << 42)
+
 #define VMX_INVEPT_SINGLE			1
 #define VMX_INVEPT_GLOBAL			2
 
+#define VMX_INVVPID_SINGLE			1
+#define VMX_INVVPID_GLOBAL			2
+
 #define APIC_ACCESS_OFFSET_MASK			0x00000fff
 #define APIC_ACCESS_TYPE_MASK			0x0000f000
 #define APIC_ACCESS_TYPE_LINEAR_READ		0x00000000
@@ -0,0 +1,48 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/string.h>
+#include <asm/processor.h>
+
+static void *erms_memset(void *s, int c, size_t n)
+{
+	void *d = s;
+
+	asm volatile("rep stosb"
+		: "+D" (d), "+c" (n) : "a" (c) : "memory");
+	return s;
+}
+
+static void *erms_memcpy(void *dest, const void *src, size_t n)
+{
+	void *d = dest;
+
+	asm volatile("rep movsb"
+		: "+D" (d), "+S" (src), "+c" (n) : : "memory");
+	return dest;
+}
+
+static const struct string_ops erms_string_ops = {
+	.memset = erms_memset,
+	.memcpy = erms_memcpy,
+};
+
+void arch_string_init(void)
+{
+	/*
+	 * With Enhanced REP MOVSB/STOSB, the byte-granular string instructions
+	 * internally operate on full cache lines and beat any loop we could
+	 * write without SSE.
+	 */
+	if (cpuid_ebx(7, 0) & X86_FEATURE_ERMS)
+		arch_string_ops = &erms_string_ops;
+}
@@ -105,8 +105,9 @@ static void parse_widths(struct parse_context *ctx,
 	}
 }
 
-struct mmio_instruction
-x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write)
+static struct mmio_instruction
+parse_inst(const struct guest_paging_structures *pg_structs, bool is_write,
+	   struct mmio_inst_cache_entry *entry)
 {
 	struct parse_context ctx = { .remaining = X86_MAX_INST_LEN,
 				     .count = 1 };
@@ -182,6 +183,7 @@ restart:
 	case X86_OP_MOV_AX_TO_MEM:
 		parse_widths(&ctx, &inst, true);
 		inst.out_val = guest_regs->by_index[15];
+		entry->out_reg_num = 15;
 		ctx.does_write = true;
 		goto final;
 	default:
@@ -276,10 +278,13 @@ restart:
 		/* sign-extend immediate if the target is 64-bit */
 		if (ctx.has_rex_w)
 			inst.out_val = (s64)(s32)inst.out_val;
+		entry->out_imm = true;
 	} else {
 		inst.inst_len += skip_len;
-		if (ctx.does_write)
+		if (ctx.does_write) {
 			inst.out_val = guest_regs->by_index[inst.in_reg_num];
+			entry->out_reg_num = inst.in_reg_num;
+		}
 	}
 
 final:
@@ -307,3 +312,60 @@ error:
 	inst.inst_len = 0;
 	return inst;
 }
+
+struct mmio_instruction
+x86_mmio_parse(const struct guest_paging_structures *pg_structs, u64 phys_addr,
+	       bool is_write)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	struct mmio_inst_cache_entry *entry;
+	struct mmio_instruction inst;
+	u16 cs_attr = vcpu_vendor_get_cs_attr();
+	u64 rip = vcpu_vendor_get_rip();
+	unsigned int n;
+
+	for (n = 0; n < MMIO_INST_CACHE_SIZE; n++) {
+		entry = &cpu_data->mmio_inst_cache[n];
+		if (entry->inst.inst_len != 0 && entry->rip == rip &&
+		    entry->phys_addr == phys_addr &&
+		    entry->is_write == is_write &&
+		    entry->root_paging == pg_structs->root_paging &&
+		    entry->root_table_gphys == pg_structs->root_table_gphys &&
+		    entry->cs_attr == cs_attr) {
+			inst = entry->inst;
+			if (is_write && !entry->out_imm)
+				inst.out_val = cpu_data->guest_regs.by_index
+					[entry->out_reg_num];
+			return inst;
+		}
+	}
+
+	entry = &cpu_data->mmio_inst_cache[cpu_data->mmio_inst_cache_next];
+	entry->inst.inst_len = 0;
+	entry->out_imm = false;
+
+	inst = parse_inst(pg_structs, is_write, entry);
+	if (inst.inst_len == 0)
+		return inst;
+
+	entry->rip = rip;
+	entry->root_paging = pg_structs->root_paging;
+	entry->root_table_gphys = pg_structs->root_table_gphys;
+	entry->phys_addr = phys_addr;
+	entry->cs_attr = cs_attr;
+	entry->is_write = is_write;
+	entry->inst = inst;
+	cpu_data->mmio_inst_cache_next =
+		(cpu_data->mmio_inst_cache_next + 1) % MMIO_INST_CACHE_SIZE;
+
+	return inst;
+}
+
+void x86_mmio_flush_inst_cache(void)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	unsigned int n;
+
+	for (n = 0; n < MMIO_INST_CACHE_SIZE; n++)
+		cpu_data->mmio_inst_cache[n].inst.inst_len = 0;
+}
@@ -22,6 +22,7 @@
 #include <jailhouse/printk.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/string.h>
+#include <jailhouse/tracing.h>
 #include <jailhouse/utils.h>
 #include <asm/amd_iommu.h>
 #include <asm/apic.h>
@@ -51,7 +52,7 @@ static const struct segment invalid_seg;
 
 static struct paging npt_iommu_paging[NPT_IOMMU_PAGE_DIR_LEVELS];
 
-/* bit cleared: direct access allowed */
+/* template of the per-cell MSR permission maps, bit cleared: direct access allowed */
 // TODO: convert to whitelist
 static u8 __attribute__((aligned(PAGE_SIZE))) msrpm[][0x2000/4] = {
 	[ SVM_MSRPM_0000 ] = {
@@ -138,10 +139,86 @@ static void set_svm_segment_from_segment(struct svm_segment *svm_segment,
 static void svm_set_cell_config(struct cell *cell, struct vmcb *vmcb)
 {
 	vmcb->iopm_base_pa = paging_hvirt2phys(cell->arch.io_bitmap);
+	vmcb->msrpm_base_pa = paging_hvirt2phys(cell->arch.msr_bitmap);
 	vmcb->n_cr3 =
 		paging_hvirt2phys(cell->arch.svm.npt_iommu_structs.root_table);
+	vmcb->clean_bits &= ~(CLEAN_BITS_IOPM | CLEAN_BITS_NP);
 }
 
+#ifdef CONFIG_SVM_CHECK_CLEAN_BITS
+#define VMCB_CLEAN_FIELDS(bit, first, last)				\
+	{ bit, __builtin_offsetof(struct vmcb, first),			\
+	  __builtin_offsetof(struct vmcb, last) +			\
+	  sizeof(((struct vmcb *)0)->last) -				\
+	  __builtin_offsetof(struct vmcb, first) }
+
+/* VMCB fields the CPU may cache across VMRUN, see APMv2, Sect. 15.15.3 */
+static const struct {
+	u32 bit;
+	unsigned int offset;
+	unsigned int size;
+} vmcb_clean_fields[] = {
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_I, cr_intercepts, general2_intercepts),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_I, pause_filter_count,
+			  pause_filter_count),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_I, tsc_offset, tsc_offset),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_IOPM, iopm_base_pa, msrpm_base_pa),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_ASID, guest_asid, guest_asid),
+	/* V_TPR only, the other vintr bits are always reloaded */
+	{ CLEAN_BITS_TPR, __builtin_offsetof(struct vmcb, vintr), 1 },
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_NP, np_enable, np_enable),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_NP, n_cr3, n_cr3),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_NP, g_pat, g_pat),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_CRX, efer, efer),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_CRX, cr4, cr0),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_DRX, dr7, dr6),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_DT, gdtr, gdtr),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_DT, idtr, idtr),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_SEG, es, ds),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_SEG, cpl, cpl),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_CR2, cr2, cr2),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_LBR, lbr_control, lbr_control),
+	VMCB_CLEAN_FIELDS(CLEAN_BITS_LBR, debugctlmsr, lastinttoip),
+};
+
+static void svm_save_clean_state(struct per_cpu *cpu_data)
+{
+	memcpy(&cpu_data->vmcb_shadow, &cpu_data->vmcb, sizeof(struct vmcb));
+}
+
+/*
+ * Debug check, run before resuming the guest: Any VMCB field that differs
+ * from its state after the VM exit must have its clean bit cleared. Report
+ * violations and fix them up so that the guest continues correctly.
+ */
+static void svm_check_clean_bits(struct per_cpu *cpu_data)
+{
+	const u8 *vmcb = (const u8 *)&cpu_data->vmcb;
+	const u8 *shadow = (const u8 *)&cpu_data->vmcb_shadow;
+	unsigned int n, offs, end;
+
+	for (n = 0; n < ARRAY_SIZE(vmcb_clean_fields); n++) {
+		if (!(cpu_data->vmcb.clean_bits & vmcb_clean_fields[n].bit))
+			continue;
+
+		offs = vmcb_clean_fields[n].offset;
+		end = offs + vmcb_clean_fields[n].size;
+		while (offs < end && vmcb[offs] == shadow[offs])
+			offs++;
+		if (offs == end)
+			continue;
+
+		printk("WARNING: CPU %d: VMCB offset 0x%x modified while clean "
+		       "bit 0x%x is set, exit code %lld\n", this_cpu_id(),
+		       offs, vmcb_clean_fields[n].bit, cpu_data->vmcb.exitcode);
+		cpu_data->vmcb.clean_bits &= ~vmcb_clean_fields[n].bit;
+	}
+}
+#else /* !CONFIG_SVM_CHECK_CLEAN_BITS */
+static inline void svm_save_clean_state(struct per_cpu *cpu_data) {}
+static inline void svm_check_clean_bits(struct per_cpu *cpu_data) {}
+#endif /* !CONFIG_SVM_CHECK_CLEAN_BITS */
+
 static void vmcb_setup(struct per_cpu *cpu_data)
 {
 	struct vmcb *vmcb = &cpu_data->vmcb;
@@ -212,8 +289,6 @@ static void vmcb_setup(struct per_cpu *cpu_data)
 	 */
 	vmcb->exception_intercepts |= (1 << DB_VECTOR) | (1 << AC_VECTOR);
 
-	vmcb->msrpm_base_pa = paging_hvirt2phys(msrpm);
-
 	vmcb->np_enable = 1;
 	/* No more than one guest owns the CPU */
 	vmcb->guest_asid = 1;
@@ -318,30 +393,90 @@ int vcpu_vendor_early_init(void)
 	return vcpu_cell_init(&root_cell);
 }
 
+/*
+ * Derive the cell's MSR permission map from the global template and open up
+ * the MSR ranges the cell configuration grants direct access to.
+ */
+static int svm_msrpm_init(struct cell *cell)
+{
+	u8 (*bitmap)[0x2000/4];
+	const struct jailhouse_msr *msr;
+	unsigned int n, map;
+	u32 offs, last;
+
+	cell->arch.msr_bitmap = page_alloc(&mem_pool, PAGES(sizeof(msrpm)));
+	if (!cell->arch.msr_bitmap)
+		return -ENOMEM;
+
+	memcpy(cell->arch.msr_bitmap, msrpm, sizeof(msrpm));
+	bitmap = (void *)cell->arch.msr_bitmap;
+
+	for_each_msr_region(msr, cell->config, n) {
+		last = msr->base + msr->length - 1;
+		if (last <= 0x1fff) {
+			map = SVM_MSRPM_0000;
+		} else if (msr->base >= 0xc0000000 && last <= 0xc0001fff) {
+			map = SVM_MSRPM_C000;
+		} else if (msr->base >= 0xc0010000 && last <= 0xc0011fff) {
+			map = SVM_MSRPM_C001;
+		} else {
+			/* not covered by the map, always intercepted */
+			page_free(&mem_pool, cell->arch.msr_bitmap,
+				  PAGES(sizeof(msrpm)));
+			return trace_error(-EINVAL);
+		}
+
+		/* two bits per MSR: read intercept, write intercept */
+		for (offs = msr->base & 0x1fff; offs <= (last & 0x1fff);
+		     offs++) {
+			if (msr->flags & JAILHOUSE_MSR_READ)
+				bitmap[map][offs / 4] &=
+					~(1 << ((offs % 4) * 2));
+			if (msr->flags & JAILHOUSE_MSR_WRITE)
+				bitmap[map][offs / 4] &=
+					~(2 << ((offs % 4) * 2));
+		}
+	}
+
+	return 0;
+}
+
 int vcpu_vendor_cell_init(struct cell *cell)
 {
 	u64 flags;
+	int err;
+
+	err = svm_msrpm_init(cell);
+	if (err)
+		return err;
 
 	/* build root NPT of cell */
 	cell->arch.svm.npt_iommu_structs.root_paging = npt_iommu_paging;
 	cell->arch.svm.npt_iommu_structs.root_table =
 		(page_table_t)cell->arch.root_table_page;
+	cell->arch.svm.npt_iommu_structs.mappings = cell->mappings;
+	cell->arch.svm.npt_iommu_structs.cell = cell;
 
 	if (!has_avic) {
 		/*
 		 * Map xAPIC as is; reads are passed, writes are trapped.
 		 */
 		flags = PAGE_READONLY_FLAGS | PAGE_FLAG_US | PAGE_FLAG_DEVICE;
-		return paging_create(&cell->arch.svm.npt_iommu_structs,
-				     XAPIC_BASE, PAGE_SIZE, XAPIC_BASE, flags,
-				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+		err = paging_create(&cell->arch.svm.npt_iommu_structs,
+				    XAPIC_BASE, PAGE_SIZE, XAPIC_BASE, flags,
+				    PAGING_NON_COHERENT | PAGING_NO_HUGE);
 	} else {
 		flags = PAGE_DEFAULT_FLAGS | PAGE_FLAG_DEVICE;
-		return paging_create(&cell->arch.svm.npt_iommu_structs,
-				     paging_hvirt2phys(avic_page),
-				     PAGE_SIZE, XAPIC_BASE, flags,
-				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+		err = paging_create(&cell->arch.svm.npt_iommu_structs,
+				    paging_hvirt2phys(avic_page),
+				    PAGE_SIZE, XAPIC_BASE, flags,
+				    PAGING_NON_COHERENT | PAGING_NO_HUGE);
 	}
+	if (err)
+		page_free(&mem_pool, cell->arch.msr_bitmap,
+			  PAGES(sizeof(msrpm)));
+
+	return err;
 }
 
 int vcpu_map_memory_region(struct cell *cell,
@@ -349,7 +484,7 @@ int vcpu_map_memory_region(struct cell *cell,
 {
 	u64 phys_start = mem->phys_start;
 	u64 access_flags = PAGE_FLAG_US; /* See APMv2, Section 15.25.5 */
-	u64 paging_flags = PAGING_COHERENT | PAGING_HUGE;
+	u64 paging_flags = PAGING_COHERENT | PAGING_HUGE | PAGING_FOLD;
 
 	if (mem->flags & JAILHOUSE_MEM_READ)
 		access_flags |= PAGE_FLAG_PRESENT;
@@ -384,6 +519,8 @@ void vcpu_vendor_cell_exit(struct cell *cell)
 {
 	paging_destroy(&cell->arch.svm.npt_iommu_structs, XAPIC_BASE,
 		       PAGE_SIZE, PAGING_NON_COHERENT);
+
+	page_free(&mem_pool, cell->arch.msr_bitmap, PAGES(sizeof(msrpm)));
 }
 
 int vcpu_init(struct per_cpu *cpu_data)
@@ -609,10 +746,17 @@ void vcpu_vendor_reset(unsigned int sipi_vector)
 
 	vmcb->eventinj = 0;
 
-	/* Almost all of the guest state changed */
-	vmcb->clean_bits = 0;
+	/*
+	 * Control registers, segments, descriptor tables and debug registers
+	 * were reset. Intercepts and ASID are unchanged, and the cell-specific
+	 * IOPM/MSRPM and NPT root are marked by svm_set_cell_config().
+	 */
+	vmcb->clean_bits &= ~(CLEAN_BITS_CRX | CLEAN_BITS_SEG | CLEAN_BITS_DT |
+			      CLEAN_BITS_DRX);
 
 	svm_set_cell_config(cpu_data->public.cell, vmcb);
+	/* the guest may now run on behalf of a different cell */
+	vcpu_tlb_flush();
 
 	vmcb_pa = paging_hvirt2phys(&per_cpu(this_cpu_id())->vmcb);
 	asm volatile("vmload %%rax" : : "a" (vmcb_pa) : "memory");
@@ -878,11 +1022,15 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	write_msr(MSR_GS_BASE, (unsigned long)cpu_data);
 
 	cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
+	trace_exit_begin(vmcb->exitcode, vmcb->rip);
 	/*
 	 * All guest state is marked unmodified; individual handlers must clear
 	 * the bits as needed.
 	 */
 	vmcb->clean_bits = 0xffffffff;
+	/* TLB_CONTROL is not cleared by the CPU, only flush on request */
+	vmcb->tlb_control = SVM_TLB_FLUSH_NONE;
+	svm_save_clean_state(cpu_data);
 
 	switch (vmcb->exitcode) {
 	case VMEXIT_INVALID:
@@ -956,6 +1104,8 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	panic_park();
 
 vmentry:
+	svm_check_clean_bits(cpu_data);
+	trace_exit_end();
 	write_msr(MSR_GS_BASE, vmcb->gs.base);
 }
 
@@ -968,11 +1118,9 @@ void vcpu_park(void)
 	}
 #endif
 	vcpu_vendor_reset(0);
-	/* No need to clear VMCB Clean bit: vcpu_vendor_reset() already does
-	 * this. */
 	this_cpu_data()->vmcb.n_cr3 = paging_hvirt2phys(parking_pt.root_table);
-
-	vcpu_tlb_flush();
+	this_cpu_data()->vmcb.clean_bits &= ~CLEAN_BITS_NP;
+	/* vcpu_vendor_reset() already requested the TLB flush */
 }
 
 void vcpu_nmi_handler(void)
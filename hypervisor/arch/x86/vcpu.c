@@ -92,6 +92,55 @@ static void pio_allow_access(u8 *bm, const struct jailhouse_pio *pio,
 		access_method(start_bit, (unsigned long*)bm);
 }
 
+/*
+ * MSRs a cell may be granted direct access to. They only affect the CPU they
+ * are accessed on and are neither used nor emulated by the hypervisor. All
+ * other MSRs stay intercepted, whatever the cell configuration says.
+ */
+static const struct {
+	u32 first, last;
+} passthrough_msrs[] = {
+	/* general-purpose counters, event selects, full-width counters */
+	{ MSR_IA32_PMC0, MSR_IA32_PMC0 + 7 },
+	{ MSR_IA32_PERFEVTSEL0, MSR_IA32_PERFEVTSEL0 + 7 },
+	{ MSR_IA32_A_PMC0, MSR_IA32_A_PMC0 + 7 },
+	/* fixed-function counters, their control and IA32_PERF_GLOBAL_* */
+	{ MSR_IA32_FIXED_CTR0, MSR_IA32_FIXED_CTR0 + 3 },
+	{ MSR_IA32_FIXED_CTR_CTRL, MSR_IA32_PERF_GLOBAL_INUSE },
+	{ MSR_TSC_AUX, MSR_TSC_AUX },
+	/* AMD counters, event selects and global control */
+	{ MSR_AMD64_PERF_CNTR_GLOBAL_STATUS,
+	  MSR_AMD64_PERF_CNTR_GLOBAL_STATUS_CLR },
+	{ MSR_AMD_PERF_CTL0, MSR_AMD_PERF_CTR3 },
+	{ MSR_AMD_F15H_PERF_CTL0, MSR_AMD_F15H_PERF_CTR5 },
+};
+
+static int msr_regions_check(const struct jailhouse_cell_desc *config)
+{
+	const struct jailhouse_msr *msr;
+	unsigned int n, m;
+	u32 last;
+
+	for_each_msr_region(msr, config, n) {
+		if (msr->length == 0 ||
+		    msr->flags & ~(JAILHOUSE_MSR_READ | JAILHOUSE_MSR_WRITE))
+			return trace_error(-EINVAL);
+
+		last = msr->base + msr->length - 1;
+		if (last < msr->base)
+			return trace_error(-EINVAL);
+
+		for (m = 0; m < ARRAY_SIZE(passthrough_msrs); m++)
+			if (msr->base >= passthrough_msrs[m].first &&
+			    last <= passthrough_msrs[m].last)
+				break;
+		if (m == ARRAY_SIZE(passthrough_msrs))
+			return trace_error(-EPERM);
+	}
+
+	return 0;
+}
+
 int vcpu_cell_init(struct cell *cell)
 {
 	const unsigned int io_bitmap_pages = vcpu_vendor_get_io_bitmap_pages();
@@ -99,6 +148,10 @@ int vcpu_cell_init(struct cell *cell)
 	unsigned int n, pm_timer_addr;
 	int err;
 
+	err = msr_regions_check(cell->config);
+	if (err)
+		return err;
+
 	cell->arch.io_bitmap = page_alloc(&mem_pool, io_bitmap_pages);
 	if (!cell->arch.io_bitmap)
 		return -ENOMEM;
@@ -263,7 +316,8 @@ bool vcpu_handle_mmio_access(void)
 
 	vcpu_get_guest_paging_structs(&pg_structs);
 
-	inst = x86_mmio_parse(&pg_structs, intercept.is_write);
+	inst = x86_mmio_parse(&pg_structs, intercept.phys_addr,
+			      intercept.is_write);
 	if (!inst.inst_len)
 		goto invalid_access;
 
@@ -428,6 +482,9 @@ void vcpu_reset(unsigned int sipi_vector)
 
 	memset(&cpu_data->guest_regs, 0, sizeof(cpu_data->guest_regs));
 
+	/* the cell may have been reloaded with different code */
+	x86_mmio_flush_inst_cache();
+
 	if (sipi_vector == APIC_BSP_PSEUDO_SIPI) {
 		cpu_data->pat = PAT_RESET_VALUE;
 		cpu_data->mtrr_def_type &= ~MTRR_ENABLE;
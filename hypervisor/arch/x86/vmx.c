@@ -17,6 +17,7 @@
 #include <jailhouse/processor.h>
 #include <jailhouse/printk.h>
 #include <jailhouse/string.h>
+#include <jailhouse/tracing.h>
 #include <jailhouse/control.h>
 #include <jailhouse/hypercall.h>
 #include <asm/apic.h>
@@ -34,7 +35,7 @@ static const struct segment invalid_seg = {
 	.access_rights = 0x10000
 };
 
-/* bit cleared: direct access allowed */
+/* template of the per-cell MSR bitmaps, bit cleared: direct access allowed */
 // TODO: convert to whitelist
 static u8 __attribute__((aligned(PAGE_SIZE))) msr_bitmap[][0x2000/8] = {
 	[ VMX_MSR_BMP_0000_READ ] = {
@@ -79,7 +80,16 @@ static u8 __attribute__((aligned(PAGE_SIZE))) msr_bitmap[][0x2000/8] = {
 	},
 };
 
-/* Special access page to trap guest's attempts of accessing APIC in xAPIC mode */
+/*
+ * Special access page to trap guest's attempts of accessing APIC in xAPIC mode
+ *
+ * Cells program the physical local APIC, and external interrupts as well as
+ * IPIs are delivered to them without VM exits. APIC-register virtualization,
+ * virtual-interrupt delivery and posted interrupts operate on a virtual APIC
+ * instead, e.g. virtualized EOIs would never reach the physical APIC. These
+ * features are therefore left disabled. Cells that suffer from xAPIC access
+ * exits should use x2APIC mode where only ICR writes are intercepted.
+ */
 static u8 __attribute__((aligned(PAGE_SIZE))) apic_access_page[PAGE_SIZE];
 static struct paging ept_paging[EPT_PAGE_DIR_LEVELS];
 static u32 secondary_exec_addon;
@@ -247,6 +257,15 @@ static int vmx_check_features(void)
 	if ((vmx_proc_ctrl2 & secondary_exec_addon) != secondary_exec_addon)
 		return trace_error(-EIO);
 
+	/*
+	 * Tag guest TLB entries with VPIDs if possible. Otherwise, every VM
+	 * entry and exit will flush them.
+	 */
+	if (vmx_proc_ctrl2 & SECONDARY_EXEC_ENABLE_VPID &&
+	    ept_cap & VPID_INVVPID &&
+	    ept_cap & (VPID_INVVPID_SINGLE | VPID_INVVPID_GLOBAL))
+		secondary_exec_addon |= SECONDARY_EXEC_ENABLE_VPID;
+
 	/* require PAT and EFER save/restore */
 	vmx_entry_ctrl = read_msr(MSR_IA32_VMX_ENTRY_CTLS) >> 32;
 	vmx_exit_ctrl = read_msr(MSR_IA32_VMX_EXIT_CTLS) >> 32;
@@ -332,20 +351,80 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
 				flags);
 }
 
+/*
+ * Derive the cell's MSR bitmap from the global template and open up the MSR
+ * ranges the cell configuration grants direct access to.
+ */
+static int vmx_msr_bitmap_init(struct cell *cell)
+{
+	u8 (*bitmap)[0x2000/8];
+	const struct jailhouse_msr *msr;
+	unsigned int n, read_bmp, write_bmp;
+	u32 offs, last;
+
+	cell->arch.msr_bitmap = page_alloc(&mem_pool,
+					   PAGES(sizeof(msr_bitmap)));
+	if (!cell->arch.msr_bitmap)
+		return -ENOMEM;
+
+	memcpy(cell->arch.msr_bitmap, msr_bitmap, sizeof(msr_bitmap));
+	bitmap = (void *)cell->arch.msr_bitmap;
+
+	for_each_msr_region(msr, cell->config, n) {
+		last = msr->base + msr->length - 1;
+		if (last <= 0x1fff) {
+			read_bmp = VMX_MSR_BMP_0000_READ;
+			write_bmp = VMX_MSR_BMP_0000_WRITE;
+		} else if (msr->base >= 0xc0000000 && last <= 0xc0001fff) {
+			read_bmp = VMX_MSR_BMP_C000_READ;
+			write_bmp = VMX_MSR_BMP_C000_WRITE;
+		} else {
+			/* not covered by the bitmap, always intercepted */
+			page_free(&mem_pool, cell->arch.msr_bitmap,
+				  PAGES(sizeof(msr_bitmap)));
+			return trace_error(-EINVAL);
+		}
+
+		for (offs = msr->base & 0x1fff; offs <= (last & 0x1fff);
+		     offs++) {
+			if (msr->flags & JAILHOUSE_MSR_READ)
+				bitmap[read_bmp][offs / 8] &= ~(1 << (offs % 8));
+			if (msr->flags & JAILHOUSE_MSR_WRITE)
+				bitmap[write_bmp][offs / 8] &=
+					~(1 << (offs % 8));
+		}
+	}
+
+	return 0;
+}
+
 int vcpu_vendor_cell_init(struct cell *cell)
 {
+	int err;
+
+	err = vmx_msr_bitmap_init(cell);
+	if (err)
+		return err;
+
 	/* build root EPT of cell */
 	cell->arch.vmx.ept_structs.root_paging = ept_paging;
 	cell->arch.vmx.ept_structs.root_table =
 		(page_table_t)cell->arch.root_table_page;
+	cell->arch.vmx.ept_structs.mappings = cell->mappings;
+	cell->arch.vmx.ept_structs.cell = cell;
 
 	/* Map the special APIC access page into the guest's physical address
 	 * space at the default address (XAPIC_BASE) */
-	return paging_create(&cell->arch.vmx.ept_structs,
-			     paging_hvirt2phys(apic_access_page),
-			     PAGE_SIZE, XAPIC_BASE,
-			     EPT_FLAG_READ | EPT_FLAG_WRITE | EPT_FLAG_WB_TYPE,
-			     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+	err = paging_create(&cell->arch.vmx.ept_structs,
+			    paging_hvirt2phys(apic_access_page),
+			    PAGE_SIZE, XAPIC_BASE,
+			    EPT_FLAG_READ | EPT_FLAG_WRITE | EPT_FLAG_WB_TYPE,
+			    PAGING_NON_COHERENT | PAGING_NO_HUGE);
+	if (err)
+		page_free(&mem_pool, cell->arch.msr_bitmap,
+			  PAGES(sizeof(msr_bitmap)));
+
+	return err;
 }
 
 int vcpu_map_memory_region(struct cell *cell,
@@ -353,7 +432,8 @@ int vcpu_map_memory_region(struct cell *cell,
 {
 	u64 phys_start = mem->phys_start;
 	unsigned long access_flags = EPT_FLAG_WB_TYPE;
-	unsigned long paging_flags = PAGING_NON_COHERENT | PAGING_HUGE;
+	unsigned long paging_flags =
+		PAGING_NON_COHERENT | PAGING_HUGE | PAGING_FOLD;
 
 	if (mem->flags & JAILHOUSE_MEM_READ)
 		access_flags |= EPT_FLAG_READ;
@@ -381,8 +461,63 @@ void vcpu_vendor_cell_exit(struct cell *cell)
 {
 	paging_destroy(&cell->arch.vmx.ept_structs, XAPIC_BASE, PAGE_SIZE,
 		       PAGING_NON_COHERENT);
+
+	page_free(&mem_pool, cell->arch.msr_bitmap, PAGES(sizeof(msr_bitmap)));
 }
 
+/*
+ * Each CPU runs exactly one vCPU, so we can derive a stable VPID from the CPU
+ * ID. VPID 0 is reserved for VMX root operation.
+ */
+static inline u16 vmx_vpid(void)
+{
+	return this_cpu_id() + 1;
+}
+
+/*
+ * Drop all TLB entries tagged with the VPID of this CPU. Required whenever the
+ * vCPU starts over with a new state or on behalf of a different cell.
+ */
+static void vmx_vpid_flush(void)
+{
+	unsigned long vpid_cap = read_msr(MSR_IA32_VMX_EPT_VPID_CAP);
+	struct {
+		u64 vpid;
+		u64 linear_address;
+	} descriptor;
+	u64 type;
+	u8 ok;
+
+	if (!(secondary_exec_addon & SECONDARY_EXEC_ENABLE_VPID))
+		return;
+
+	descriptor.linear_address = 0;
+	if (vpid_cap & VPID_INVVPID_SINGLE) {
+		type = VMX_INVVPID_SINGLE;
+		descriptor.vpid = vmx_vpid();
+	} else {
+		type = VMX_INVVPID_GLOBAL;
+		descriptor.vpid = 0;
+	}
+	asm volatile(
+		"invvpid (%1),%2\n\t"
+		"seta %0\n\t"
+		: "=qm" (ok)
+		: "r" (&descriptor), "r" (type)
+		: "memory", "cc");
+
+	if (!ok) {
+		panic_printk("FATAL: invvpid failed, error %d\n",
+			     vmcs_read32(VM_INSTRUCTION_ERROR));
+		panic_stop();
+	}
+}
+
+/*
+ * With EPT enabled, the TLB only holds guest-physical and combined mappings.
+ * INVEPT invalidates them regardless of the VPID they are tagged with, so no
+ * additional INVVPID is needed when only the EPT changed.
+ */
 void vcpu_tlb_flush(void)
 {
 	unsigned long ept_cap = read_msr(MSR_IA32_VMX_EPT_VPID_CAP);
@@ -450,6 +585,9 @@ static bool vmx_set_cell_config(void)
 	ok &= vmcs_write64(IO_BITMAP_B,
 			   paging_hvirt2phys(io_bitmap + PAGE_SIZE));
 
+	ok &= vmcs_write64(MSR_BITMAP,
+			   paging_hvirt2phys(cell->arch.msr_bitmap));
+
 	ok &= vmcs_write64(EPT_POINTER,
 		paging_hvirt2phys(cell->arch.vmx.ept_structs.root_table) |
 		EPT_TYPE_WRITEBACK | EPT_PAGE_WALK_LEN);
@@ -567,14 +705,15 @@ static bool vmcs_setup(void)
 	val &= ~(CPU_BASED_CR3_LOAD_EXITING | CPU_BASED_CR3_STORE_EXITING);
 	ok &= vmcs_write32(CPU_BASED_VM_EXEC_CONTROL, val);
 
-	ok &= vmcs_write64(MSR_BITMAP, paging_hvirt2phys(msr_bitmap));
-
 	val = read_msr(MSR_IA32_VMX_PROCBASED_CTLS2);
 	val |= SECONDARY_EXEC_VIRTUALIZE_APIC_ACCESSES |
 		SECONDARY_EXEC_ENABLE_EPT | SECONDARY_EXEC_UNRESTRICTED_GUEST |
 		secondary_exec_addon;
 	ok &= vmcs_write32(SECONDARY_VM_EXEC_CONTROL, val);
 
+	if (secondary_exec_addon & SECONDARY_EXEC_ENABLE_VPID)
+		ok &= vmcs_write16(VIRTUAL_PROCESSOR_ID, vmx_vpid());
+
 	ok &= vmcs_write64(APIC_ACCESS_ADDR,
 			   paging_hvirt2phys(apic_access_page));
 
@@ -673,6 +812,9 @@ int vcpu_init(struct per_cpu *cpu_data)
 	if (!vmcs_clear() || !vmcs_load() || !vmcs_setup())
 		return trace_error(-EIO);
 
+	/* discard guest entries left over from a previous VMX session */
+	vmx_vpid_flush();
+
 	cpu_data->vmx_state = VMCS_READY;
 
 	return 0;
@@ -874,6 +1016,8 @@ void vcpu_vendor_reset(unsigned int sipi_vector)
 		panic_printk("FATAL: CPU reset failed\n");
 		panic_stop();
 	}
+
+	vmx_vpid_flush();
 }
 
 static void vmx_preemption_timer_set_enable(bool enable)
@@ -981,6 +1125,11 @@ static bool vmx_handle_cr(void)
 			vmx_set_guest_cr(cr ? CR4_IDX : CR0_IDX, val);
 			if (cr == 0 && val & X86_CR0_PG)
 				update_efer();
+			/*
+			 * An emulated write may affect paging, but the VM entry
+			 * no longer flushes the TLB when VPIDs are in use.
+			 */
+			vmx_vpid_flush();
 			return true;
 		}
 		break;
@@ -1143,10 +1292,9 @@ void vcpu_vendor_get_mmio_intercept(struct vcpu_mmio_intercept *mmio)
 	mmio->is_write = !!(exitq & 0x2);
 }
 
-void vcpu_handle_exit(struct per_cpu *cpu_data)
+static void vmx_handle_exit(struct per_cpu *cpu_data, u32 reason)
 {
-	u32 reason = vmcs_read32(VM_EXIT_REASON);
-	u32 *stats = cpu_data->public.stats;
+	u64 *stats = cpu_data->public.stats;
 
 	stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
 
@@ -1215,6 +1363,15 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	panic_park();
 }
 
+void vcpu_handle_exit(struct per_cpu *cpu_data)
+{
+	u32 reason = vmcs_read32(VM_EXIT_REASON);
+
+	trace_exit_begin((u16)reason, vmcs_read64(GUEST_RIP));
+	vmx_handle_exit(cpu_data, reason);
+	trace_exit_end();
+}
+
 void vmx_entry_failure(void)
 {
 	panic_printk("FATAL: vmresume failed, error %d\n",
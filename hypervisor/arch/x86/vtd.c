@@ -57,8 +57,12 @@ struct vtd_entry {
 # define VTD_CAP_SLLPS2M		(1UL << 34)
 # define VTD_CAP_SLLPS1G		(1UL << 35)
 # define VTD_CAP_FRO_MASK		BIT_MASK(33, 24)
+# define VTD_CAP_PSI			(1UL << 39)
 # define VTD_CAP_NFR_MASK		BIT_MASK(47, 40)
+# define VTD_CAP_MAMV_MASK		BIT_MASK(53, 48)
+# define VTD_CAP_MAMV_SHIFT		48
 #define VTD_ECAP_REG			0x10
+# define VTD_ECAP_C			(1UL << 0)
 # define VTD_ECAP_QI			(1UL << 1)
 # define VTD_ECAP_IR			(1UL << 3)
 # define VTD_ECAP_EIM			(1UL << 4)
@@ -106,9 +110,11 @@ struct vtd_entry {
 #define VTD_REQ_INV_IOTLB		0x02
 # define VTD_INV_IOTLB_GLOBAL		(1UL << 4)
 # define VTD_INV_IOTLB_DOMAIN		(2UL << 4)
+# define VTD_INV_IOTLB_PAGE		(3UL << 4)
 # define VTD_INV_IOTLB_DW		(1UL << 6)
 # define VTD_INV_IOTLB_DR		(1UL << 7)
 # define VTD_INV_IOTLB_DOMAIN_SHIFT	16
+# define VTD_INV_IOTLB_AM_MASK		BIT_MASK(5, 0)
 
 #define VTD_REQ_INV_INT			0x04
 # define VTD_INV_INT_GLOBAL		(0UL << 4)
@@ -124,6 +130,15 @@ struct vtd_entry {
 #define  VTD_INV_WAIT_FN		(1UL << 6)
 #define  VTD_INV_WAIT_SDATA_SHIFT	32
 
+/*
+ * Upper bound of page-selective IOTLB requests per invalidated domain before
+ * falling back to a domain-selective flush.
+ */
+#define VTD_MAX_PSI_REQUESTS		32
+
+/* Invalidation requests collected before a queue submission has to wait. */
+#define VTD_INV_BATCH_SIZE		16
+
 #define VTD_FRCD_LO_REG			0x0
 #define  VTD_FRCD_LO_FI_MASK		BIT_MASK(63, 12)
 #define VTD_FRCD_HI_REG			0x8
@@ -178,6 +193,12 @@ struct vtd_emulation {
 	u32 fault_event_regs[4];
 };
 
+/* Invalidation requests to be submitted to all DMAR units at once. */
+struct vtd_inv_batch {
+	unsigned int count;
+	struct vtd_entry requests[VTD_INV_BATCH_SIZE];
+};
+
 static const struct vtd_entry inv_global_context = {
 	.lo_word = VTD_REQ_INV_CONTEXT | VTD_INV_CONTEXT_GLOBAL,
 };
@@ -200,6 +221,9 @@ static void *unit_inv_queue;
 static unsigned int dmar_units;
 static unsigned int dmar_pt_levels;
 static unsigned int dmar_num_did = ~0U;
+static bool dmar_psi_supported = true;
+static unsigned int dmar_psi_max_am = ~0U;
+static bool dmar_ept_shareable = true;
 static spinlock_t inv_queue_lock;
 static struct vtd_emulation root_cell_units[JAILHOUSE_MAX_IOMMU_UNITS];
 static bool dmar_units_initialized;
@@ -220,18 +244,25 @@ static unsigned int inv_queue_write(void *inv_queue, unsigned int index,
 	return (index + 1) % (PAGE_SIZE / sizeof(*entry));
 }
 
-static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
-				  const struct vtd_entry *inv_request)
+static struct vtd_entry vtd_inv_wait_request(unsigned int slot)
 {
+	struct per_cpu *cpu_data = this_cpu_data();
 	struct vtd_entry inv_wait = {
 		.lo_word = VTD_REQ_INV_WAIT | VTD_INV_WAIT_SW |
 			VTD_INV_WAIT_FN | (1UL << VTD_INV_WAIT_SDATA_SHIFT),
-		.hi_word = paging_hvirt2phys(
-				&per_cpu(this_cpu_id())->vtd_iq_completed),
+		.hi_word = paging_hvirt2phys(&cpu_data->vtd_iq_completed[slot]),
 	};
-	unsigned int index;
 
-	this_cpu_data()->vtd_iq_completed = 0;
+	cpu_data->vtd_iq_completed[slot] = 0;
+
+	return inv_wait;
+}
+
+static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
+				  const struct vtd_entry *inv_request)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	unsigned int index;
 
 	spin_lock(&inv_queue_lock);
 
@@ -239,17 +270,76 @@ static void vtd_submit_iq_request(void *reg_base, void *inv_queue,
 
 	if (inv_request)
 		index = inv_queue_write(inv_queue, index, *inv_request);
-	index = inv_queue_write(inv_queue, index, inv_wait);
+	index = inv_queue_write(inv_queue, index, vtd_inv_wait_request(0));
 
 	mmio_write64_field(reg_base + VTD_IQT_REG, VTD_IQT_QT_MASK, index);
 
-	while (!this_cpu_data()->vtd_iq_completed)
+	while (!cpu_data->vtd_iq_completed[0])
 		cpu_relax();
 
 	spin_unlock(&inv_queue_lock);
+
+	if (inv_request)
+		cpu_data->public.stats[JAILHOUSE_CPU_STAT_IOMMU_INV_REQUESTS]++;
+	cpu_data->public.stats[JAILHOUSE_CPU_STAT_IOMMU_INV_WAITS]++;
 }
 
-static void vtd_flush_domain_caches(unsigned int did)
+/*
+ * Submit all collected requests to every DMAR unit, each followed by a single
+ * wait descriptor. All units are started before waiting for any of them so
+ * that they process the requests in parallel.
+ */
+static void vtd_submit_iq_batch(struct vtd_inv_batch *batch)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	void *inv_queue = unit_inv_queue;
+	void *reg_base = dmar_reg_base;
+	unsigned int index, n, u;
+
+	if (batch->count == 0)
+		return;
+
+	spin_lock(&inv_queue_lock);
+
+	for (u = 0; u < dmar_units; u++) {
+		index = mmio_read64_field(reg_base + VTD_IQT_REG,
+					  VTD_IQT_QT_MASK);
+		for (n = 0; n < batch->count; n++)
+			index = inv_queue_write(inv_queue, index,
+						batch->requests[n]);
+		index = inv_queue_write(inv_queue, index,
+					vtd_inv_wait_request(u));
+		mmio_write64_field(reg_base + VTD_IQT_REG, VTD_IQT_QT_MASK,
+				   index);
+
+		reg_base += DMAR_MMIO_SIZE;
+		inv_queue += PAGE_SIZE;
+	}
+
+	for (u = 0; u < dmar_units; u++)
+		while (!cpu_data->vtd_iq_completed[u])
+			cpu_relax();
+
+	spin_unlock(&inv_queue_lock);
+
+	cpu_data->public.stats[JAILHOUSE_CPU_STAT_IOMMU_INV_REQUESTS] +=
+		batch->count * dmar_units;
+	cpu_data->public.stats[JAILHOUSE_CPU_STAT_IOMMU_INV_WAITS] +=
+		dmar_units;
+
+	batch->count = 0;
+}
+
+static void vtd_queue_inv_request(struct vtd_inv_batch *batch,
+				  const struct vtd_entry *inv_request)
+{
+	if (batch->count == VTD_INV_BATCH_SIZE)
+		vtd_submit_iq_batch(batch);
+	batch->requests[batch->count++] = *inv_request;
+}
+
+static void vtd_flush_domain_caches(struct vtd_inv_batch *batch,
+				    unsigned int did)
 {
 	const struct vtd_entry inv_context = {
 		.lo_word = VTD_REQ_INV_CONTEXT | VTD_INV_CONTEXT_DOMAIN |
@@ -260,16 +350,72 @@ static void vtd_flush_domain_caches(unsigned int did)
 			VTD_INV_IOTLB_DW | VTD_INV_IOTLB_DR |
 			(did << VTD_INV_IOTLB_DOMAIN_SHIFT),
 	};
-	void *inv_queue = unit_inv_queue;
-	void *reg_base = dmar_reg_base;
-	unsigned int n;
 
-	for (n = 0; n < dmar_units; n++) {
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_context);
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_iotlb);
-		reg_base += DMAR_MMIO_SIZE;
-		inv_queue += PAGE_SIZE;
+	vtd_queue_inv_request(batch, &inv_context);
+	vtd_queue_inv_request(batch, &inv_iotlb);
+}
+
+static unsigned int vtd_psi_address_mask(unsigned long start,
+					 unsigned long end)
+{
+	unsigned int am = 0;
+
+	while (am < dmar_psi_max_am &&
+	       (start & ((PAGE_SIZE << (am + 1)) - 1)) == 0 &&
+	       start + (PAGE_SIZE << (am + 1)) <= end)
+		am++;
+	return am;
+}
+
+static unsigned int vtd_count_psi_requests(struct cell *cell)
+{
+	const struct cell_dirty_range *range;
+	unsigned long start, end;
+	unsigned int n, count = 0;
+
+	for (n = 0; n < cell->num_dirty_ranges; n++) {
+		range = &cell->dirty_ranges[n];
+		end = range->start + range->size;
+		for (start = range->start; start < end;
+		     start += PAGE_SIZE << vtd_psi_address_mask(start, end))
+			if (++count > VTD_MAX_PSI_REQUESTS)
+				return count;
 	}
+	return count;
+}
+
+/*
+ * Invalidate the IOTLB and paging-structure caches of the given cell for the
+ * ranges recorded via cell_mark_dirty. Returns false if the caller has to
+ * fall back to a domain-selective flush.
+ */
+static bool vtd_flush_dirty_ranges(struct vtd_inv_batch *batch,
+				   struct cell *cell)
+{
+	struct vtd_entry inv_iotlb = {
+		.lo_word = VTD_REQ_INV_IOTLB | VTD_INV_IOTLB_PAGE |
+			VTD_INV_IOTLB_DW | VTD_INV_IOTLB_DR |
+			(cell->config->id << VTD_INV_IOTLB_DOMAIN_SHIFT),
+	};
+	const struct cell_dirty_range *range;
+	unsigned long start, end;
+	unsigned int am, n;
+
+	if (!dmar_psi_supported || cell->dirty_overflow ||
+	    vtd_count_psi_requests(cell) > VTD_MAX_PSI_REQUESTS)
+		return false;
+
+	for (n = 0; n < cell->num_dirty_ranges; n++) {
+		range = &cell->dirty_ranges[n];
+		end = range->start + range->size;
+		for (start = range->start; start < end;
+		     start += PAGE_SIZE << am) {
+			am = vtd_psi_address_mask(start, end);
+			inv_iotlb.hi_word = start | am;
+			vtd_queue_inv_request(batch, &inv_iotlb);
+		}
+	}
+	return true;
 }
 
 static void vtd_update_gcmd_reg(void *reg_base, u32 mask, unsigned int set)
@@ -563,9 +709,7 @@ static void vtd_update_irte(unsigned int index, union vtd_irte content)
 			((u64)index << VTD_INV_INT_IIDX_SHIFT),
 	};
 	union vtd_irte *irte = &int_remap_table[index];
-	void *inv_queue = unit_inv_queue;
-	void *reg_base = dmar_reg_base;
-	unsigned int n;
+	struct vtd_inv_batch batch = { .count = 0 };
 
 	if (content.field.p) {
 		/*
@@ -586,11 +730,8 @@ static void vtd_update_irte(unsigned int index, union vtd_irte content)
 	}
 	arch_paging_flush_cpu_caches(irte, sizeof(*irte));
 
-	for (n = 0; n < dmar_units; n++) {
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_int);
-		reg_base += DMAR_MMIO_SIZE;
-		inv_queue += PAGE_SIZE;
-	}
+	vtd_queue_inv_request(&batch, &inv_int);
+	vtd_submit_iq_batch(&batch);
 }
 
 static int vtd_find_int_remap_region(u16 device_id)
@@ -677,9 +818,11 @@ int iommu_add_pci_device(struct cell *cell, struct pci_device *device)
 	context_entry->lo_word = VTD_CTX_PRESENT | VTD_CTX_TTYPE_MLP_UNTRANS |
 		paging_hvirt2phys(cell->arch.vtd.pg_structs.root_table);
 	context_entry->hi_word =
-		(dmar_pt_levels == 3 ? VTD_CTX_AGAW_39 : VTD_CTX_AGAW_48) |
+		(dmar_pt_levels == 3 && !cell->arch.vtd.ept_shared ?
+		 VTD_CTX_AGAW_39 : VTD_CTX_AGAW_48) |
 		(cell->config->id << VTD_CTX_DID_SHIFT);
 	arch_paging_flush_cpu_caches(context_entry, sizeof(*context_entry));
+	cell->arch.vtd.contexts_changed = true;
 
 	return 0;
 
@@ -704,6 +847,7 @@ void iommu_remove_pci_device(struct pci_device *device)
 
 	context_entry->lo_word &= ~VTD_CTX_PRESENT;
 	arch_paging_flush_cpu_caches(&context_entry->lo_word, sizeof(u64));
+	device->cell->arch.vtd.contexts_changed = true;
 
 	for (n = 0; n < 256; n++)
 		if (context_entry_table[n].lo_word & VTD_CTX_PRESENT)
@@ -716,6 +860,28 @@ void iommu_remove_pci_device(struct pci_device *device)
 
 static void vtd_cell_exit(struct cell *cell);
 
+/*
+ * A shared table grants devices the same access as the cell's CPUs, and VT-d
+ * has no separate permission bits to restrict that. Only share if this does
+ * not expose RAM to DMA that the configuration keeps away from devices. DMA
+ * into MMIO or the communication region can only affect the cell itself.
+ */
+static bool vtd_cell_can_share_ept(struct cell *cell)
+{
+	const struct jailhouse_memory *mem;
+	unsigned int n;
+
+	if (!dmar_ept_shareable)
+		return false;
+
+	for_each_mem_region(mem, cell->config, n)
+		if (!(mem->flags & (JAILHOUSE_MEM_DMA | JAILHOUSE_MEM_IO |
+				    JAILHOUSE_MEM_COMM_REGION)))
+			return false;
+
+	return true;
+}
+
 static int vtd_cell_init(struct cell *cell)
 {
 	const struct jailhouse_irqchip *irqchip =
@@ -727,10 +893,18 @@ static int vtd_cell_init(struct cell *cell)
 	if (cell->config->id >= dmar_num_did)
 		return trace_error(-ERANGE);
 
-	cell->arch.vtd.pg_structs.root_paging = vtd_paging;
-	cell->arch.vtd.pg_structs.root_table = page_alloc(&mem_pool, 1);
-	if (!cell->arch.vtd.pg_structs.root_table)
-		return -ENOMEM;
+	cell->arch.vtd.ept_shared = vtd_cell_can_share_ept(cell);
+	if (cell->arch.vtd.ept_shared) {
+		/* DMA mappings follow the EPT, see iommu_map_memory_region */
+		cell->arch.vtd.pg_structs = cell->arch.vmx.ept_structs;
+	} else {
+		cell->arch.vtd.pg_structs.root_paging = vtd_paging;
+		cell->arch.vtd.pg_structs.root_table =
+			page_alloc(&mem_pool, 1);
+		cell->arch.vtd.pg_structs.cell = cell;
+		if (!cell->arch.vtd.pg_structs.root_table)
+			return -ENOMEM;
+	}
 
 	/* reserve regions for IRQ chips (if not done already) */
 	for (n = 0; n < cell->config->num_irqchips; n++, irqchip++) {
@@ -751,9 +925,10 @@ int iommu_map_memory_region(struct cell *cell,
 			    const struct jailhouse_memory *mem)
 {
 	unsigned long access_flags = 0;
-	unsigned long paging_flags = PAGING_COHERENT | PAGING_HUGE;
+	unsigned long paging_flags =
+		PAGING_COHERENT | PAGING_HUGE | PAGING_FOLD;
 
-	if (!(mem->flags & JAILHOUSE_MEM_DMA))
+	if (!(mem->flags & JAILHOUSE_MEM_DMA) || cell->arch.vtd.ept_shared)
 		return 0;
 
 	if (mem->virt_start & BIT_MASK(63, 12 + 9 * dmar_pt_levels))
@@ -774,7 +949,7 @@ int iommu_map_memory_region(struct cell *cell,
 int iommu_unmap_memory_region(struct cell *cell,
 			      const struct jailhouse_memory *mem)
 {
-	if (!(mem->flags & JAILHOUSE_MEM_DMA))
+	if (!(mem->flags & JAILHOUSE_MEM_DMA) || cell->arch.vtd.ept_shared)
 		return 0;
 
 	return paging_destroy(&cell->arch.vtd.pg_structs, mem->virt_start,
@@ -877,7 +1052,8 @@ update_irte:
 
 static void vtd_cell_exit(struct cell *cell)
 {
-	page_free(&mem_pool, cell->arch.vtd.pg_structs.root_table, 1);
+	if (!cell->arch.vtd.ept_shared)
+		page_free(&mem_pool, cell->arch.vtd.pg_structs.root_table, 1);
 
 	/*
 	 * Note that reservation regions of IOAPICs won't be released because
@@ -887,6 +1063,7 @@ static void vtd_cell_exit(struct cell *cell)
 
 void iommu_config_commit(struct cell *cell_added_removed)
 {
+	struct vtd_inv_batch batch = { .count = 0 };
 	void *inv_queue = unit_inv_queue;
 	void *reg_base = dmar_reg_base;
 	unsigned int n;
@@ -903,9 +1080,20 @@ void iommu_config_commit(struct cell *cell_added_removed)
 		dmar_units_initialized = true;
 	} else {
 		if (cell_added_removed)
-			vtd_flush_domain_caches(cell_added_removed->config->id);
-		vtd_flush_domain_caches(root_cell.config->id);
+			vtd_flush_domain_caches(&batch,
+						cell_added_removed->config->id);
+		/*
+		 * Unless context entries of the root cell were modified, only
+		 * the changed ranges of its mappings need to be invalidated.
+		 */
+		if (root_cell.arch.vtd.contexts_changed ||
+		    !vtd_flush_dirty_ranges(&batch, &root_cell))
+			vtd_flush_domain_caches(&batch, root_cell.config->id);
+		vtd_submit_iq_batch(&batch);
 	}
+	root_cell.arch.vtd.contexts_changed = false;
+	if (cell_added_removed)
+		cell_added_removed->arch.vtd.contexts_changed = false;
 }
 
 static void vtd_restore_ir(unsigned int unit_no, void *reg_base)
@@ -989,7 +1177,8 @@ static int vtd_init_ir_emulation(unsigned int unit_no, void *reg_base)
 static int vtd_init(void)
 {
 	unsigned long version, caps, ecaps, ctrls, sllps_caps = ~0UL;
-	unsigned int units, pt_levels, num_did, n;
+	unsigned int units, pt_levels, num_did, mamv, n;
+	const struct paging *ept_paging;
 	struct jailhouse_iommu *unit;
 	void *reg_base;
 	int err;
@@ -1057,6 +1246,13 @@ static int vtd_init(void)
 		    (using_x2apic && !(ecaps & VTD_ECAP_EIM)))
 			return trace_error(-EIO);
 
+		/*
+		 * EPT changes are not flushed from the CPU caches, so sharing
+		 * requires coherent page walks and 4-level tables on all units.
+		 */
+		if (!(caps & VTD_CAP_SAGAW48) || !(ecaps & VTD_ECAP_C))
+			dmar_ept_shareable = false;
+
 		ctrls = mmio_read32(reg_base + VTD_GSTS_REG) &
 			VTD_GSTS_USED_CTRLS;
 		if (ctrls != 0) {
@@ -1073,6 +1269,12 @@ static int vtd_init(void)
 		num_did = 1 << (4 + (caps & VTD_CAP_NUM_DID_MASK) * 2);
 		if (num_did < dmar_num_did)
 			dmar_num_did = num_did;
+
+		if (!(caps & VTD_CAP_PSI))
+			dmar_psi_supported = false;
+		mamv = (caps & VTD_CAP_MAMV_MASK) >> VTD_CAP_MAMV_SHIFT;
+		if (mamv < dmar_psi_max_am)
+			dmar_psi_max_am = mamv;
 	}
 
 	dmar_units = units;
@@ -1090,6 +1292,12 @@ static int vtd_init(void)
 	if (!(sllps_caps & VTD_CAP_SLLPS2M))
 		vtd_paging[dmar_pt_levels - 2].page_size = 0;
 
+	/* the EPT must not use page sizes the DMAR units cannot walk */
+	ept_paging = root_cell.arch.vmx.ept_structs.root_paging;
+	if ((ept_paging[1].page_size && !(sllps_caps & VTD_CAP_SLLPS1G)) ||
+	    (ept_paging[2].page_size && !(sllps_caps & VTD_CAP_SLLPS2M)))
+		dmar_ept_shareable = false;
+
 	return vtd_cell_init(&root_cell);
 }
 
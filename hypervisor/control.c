@@ -17,6 +17,7 @@
 #include <jailhouse/paging.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/string.h>
+#include <jailhouse/tracing.h>
 #include <jailhouse/unit.h>
 #include <jailhouse/utils.h>
 #include <asm/control.h>
@@ -31,8 +32,14 @@ struct jailhouse_system *system_config;
 /** State structure of the root cell. @ingroup Control */
 struct cell root_cell;
 
+#if JAILHOUSE_NUM_CPU_STATS > JAILHOUSE_MAX_CPU_STATS
+#error JAILHOUSE_MAX_CPU_STATS too small
+#endif
+
 static spinlock_t shutdown_lock;
 static unsigned int num_cells = 1;
+/* Statistic counters of all CPUs, readable by the root cell. */
+static struct jailhouse_cpu_stats *cpu_stats_area;
 
 volatile unsigned long panic_in_progress;
 unsigned long panic_cpu = -1;
@@ -267,19 +274,88 @@ int cell_init(struct cell *cell)
 	return err;
 }
 
+static void cell_release_folded_tables(struct cell *cell)
+{
+	while (cell->num_folded_tables > 0)
+		page_free(&mem_pool,
+			  cell->folded_tables[--cell->num_folded_tables], 1);
+}
+
 static void cell_exit(struct cell *cell)
 {
+	/* Only left over if the cell creation failed before its commit. */
+	cell_release_folded_tables(cell);
+
 	mmio_cell_exit(cell);
 
 	if (cell->cpu_set != &cell->small_cpu_set)
 		page_free(&mem_pool, cell->cpu_set, 1);
 }
 
+/**
+ * Record a guest-physical range of a cell whose mappings were changed.
+ * @param cell		Cell the range belongs to.
+ * @param start		Start address of the range.
+ * @param size		Size of the range.
+ *
+ * The range will be invalidated in TLBs and IOMMUs on the next
+ * config_commit(). Overlapping or adjacent ranges are merged. If the range
+ * cannot be tracked anymore, the whole cell will be invalidated instead.
+ *
+ * @see config_commit
+ */
+void cell_mark_dirty(struct cell *cell, unsigned long start,
+		     unsigned long size)
+{
+	unsigned long end = PAGE_ALIGN(start + size);
+	struct cell_dirty_range *range;
+	unsigned int n;
+
+	start &= PAGE_MASK;
+
+	if (cell->dirty_overflow || start == end)
+		return;
+
+	for (n = 0; n < cell->num_dirty_ranges; n++) {
+		range = &cell->dirty_ranges[n];
+		if (start <= range->start + range->size &&
+		    end >= range->start) {
+			if (end < range->start + range->size)
+				end = range->start + range->size;
+			if (start > range->start)
+				start = range->start;
+			range->start = start;
+			range->size = end - start;
+			return;
+		}
+	}
+
+	if (cell->num_dirty_ranges == CELL_MAX_DIRTY_RANGES) {
+		cell->dirty_overflow = true;
+		return;
+	}
+
+	range = &cell->dirty_ranges[cell->num_dirty_ranges++];
+	range->start = start;
+	range->size = end - start;
+}
+
+static void cell_clear_dirty(struct cell *cell)
+{
+	cell->num_dirty_ranges = 0;
+	cell->dirty_overflow = false;
+}
+
 /**
  * Apply system configuration changes.
  * @param cell_added_removed	Cell that was added or removed to/from the
  * 				system or NULL.
  *
+ * Architecture code may restrict TLB and IOMMU invalidations to the ranges
+ * recorded via cell_mark_dirty(). They are reset afterwards. Page tables
+ * that were folded into huge pages are released once the invalidations are
+ * done.
+ *
  * @see arch_config_commit
  * @see pci_config_commit
  */
@@ -291,6 +367,13 @@ void config_commit(struct cell *cell_added_removed)
 
 	arch_config_commit(cell_added_removed);
 	pci_config_commit(cell_added_removed);
+
+	cell_clear_dirty(&root_cell);
+	cell_release_folded_tables(&root_cell);
+	if (cell_added_removed) {
+		cell_clear_dirty(cell_added_removed);
+		cell_release_folded_tables(cell_added_removed);
+	}
 }
 
 static bool address_in_region(unsigned long addr,
@@ -316,6 +399,8 @@ static int unmap_from_root_cell(const struct jailhouse_memory *mem)
 		return 0;
 	}
 
+	cell_mark_dirty(&root_cell, tmp.virt_start, tmp.size);
+
 	return arch_unmap_memory_region(&root_cell, &tmp);
 }
 
@@ -347,10 +432,13 @@ static int remap_to_root_cell(const struct jailhouse_memory *mem,
 			overlap.phys_start - root_mem->phys_start;
 		overlap.flags = root_mem->flags;
 
-		if (JAILHOUSE_MEMORY_IS_SUBPAGE(&overlap))
+		if (JAILHOUSE_MEMORY_IS_SUBPAGE(&overlap)) {
 			err = mmio_subpage_register(&root_cell, &overlap);
-		else
+		} else {
+			cell_mark_dirty(&root_cell, overlap.virt_start,
+					overlap.size);
 			err = arch_map_memory_region(&root_cell, &overlap);
+		}
 		if (err) {
 			if (mode == ABORT_ON_ERROR)
 				break;
@@ -361,6 +449,155 @@ static int remap_to_root_cell(const struct jailhouse_memory *mem,
 	return err;
 }
 
+/**
+ * Grant the root cell read access to hypervisor pages.
+ * @param addr	Page-aligned virtual address of the pages in the hypervisor.
+ * @param size	Size of the region.
+ *
+ * The pages replace the empty pages that back the hypervisor memory region in
+ * the root cell. Only for use during setup, use root_cell_share_pages_live()
+ * once the root cell runs.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int root_cell_share_pages(const void *addr, unsigned long size)
+{
+	struct jailhouse_memory mem = {
+		.phys_start = paging_hvirt2phys(addr),
+		.virt_start = paging_hvirt2phys(addr),
+		.size = PAGES(size) * PAGE_SIZE,
+		.flags = JAILHOUSE_MEM_READ,
+	};
+
+	cell_mark_dirty(&root_cell, mem.virt_start, mem.size);
+
+	return arch_map_memory_region(&root_cell, &mem);
+}
+
+/**
+ * Grant the running root cell read access to hypervisor pages.
+ * @param addr	Page-aligned virtual address of the pages in the hypervisor.
+ * @param size	Size of the region.
+ *
+ * Like root_cell_share_pages(), but suspends the root cell and replaces the
+ * empty pages break-before-make: they are unmapped and invalidated first, as
+ * ARM does not permit changing the output address of a live translation.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int root_cell_share_pages_live(const void *addr, unsigned long size)
+{
+	struct jailhouse_memory mem = {
+		.phys_start = paging_hvirt2phys(addr),
+		.virt_start = paging_hvirt2phys(addr),
+		.size = PAGES(size) * PAGE_SIZE,
+		.flags = JAILHOUSE_MEM_READ,
+	};
+	int err;
+
+	cell_suspend(&root_cell);
+
+	cell_mark_dirty(&root_cell, mem.virt_start, mem.size);
+	err = arch_unmap_memory_region(&root_cell, &mem);
+	config_commit(NULL);
+
+	if (!err) {
+		err = root_cell_share_pages(addr, size);
+		config_commit(NULL);
+	}
+
+	cell_resume(&root_cell);
+
+	return err;
+}
+
+/**
+ * Allocate the area that publishes the statistic counters of all CPUs and
+ * make it readable for the root cell.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int cpu_stats_init(void)
+{
+	unsigned long size =
+		hypervisor_header.max_cpus * sizeof(struct jailhouse_cpu_stats);
+	unsigned int cpu;
+
+	cpu_stats_area = page_alloc(&mem_pool, PAGES(size));
+	if (!cpu_stats_area)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+		cpu_stats_area[cpu].num_stats = JAILHOUSE_NUM_CPU_STATS;
+
+	return root_cell_share_pages(cpu_stats_area, size);
+}
+
+static void cpu_latency_account(struct jailhouse_cpu_latency *histogram,
+				unsigned int bucket, u32 latency)
+{
+	histogram->buckets[bucket]++;
+	if (latency > histogram->max)
+		histogram->max = latency;
+}
+
+/**
+ * Publish those statistic counters of a CPU that changed since their last
+ * publication and account the latency of the exit that changed them.
+ * @param cpu		ID of the CPU. Must be the caller or a suspended CPU.
+ * @param latency	Duration of the exit in timestamp ticks, or NULL if it
+ * 			was not measured.
+ *
+ * Counters incremented by exits that bypass this path, like the SMCCC
+ * workaround fast path on arm64, are published with the next exit.
+ */
+void cpu_stats_publish(unsigned int cpu, const u64 *latency)
+{
+	struct jailhouse_cpu_stats *published = &cpu_stats_area[cpu];
+	const u64 *stats = public_per_cpu(cpu)->stats;
+	unsigned int bucket = 0, stat;
+	u32 ticks = 0;
+
+	if (latency) {
+		ticks = MIN(*latency, 0xffffffff);
+		if (ticks)
+			bucket = MIN(32 - __builtin_clz(ticks),
+				     JAILHOUSE_CPU_LATENCY_BUCKETS - 1);
+	}
+
+	published->seq++;
+	memory_store_barrier();
+	if (latency)
+		cpu_latency_account(
+			&published->latency[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL],
+			bucket, ticks);
+	for (stat = 0; stat < JAILHOUSE_NUM_CPU_STATS; stat++) {
+		if (stats[stat] == published->stats[stat])
+			continue;
+		published->stats[stat] = stats[stat];
+		if (latency && stat != JAILHOUSE_CPU_STAT_VMEXITS_TOTAL)
+			cpu_latency_account(&published->latency[stat], bucket,
+					    ticks);
+	}
+	memory_store_barrier();
+	published->seq++;
+}
+
+static void clear_cpu_stats(unsigned int cpu)
+{
+	struct jailhouse_cpu_stats *published = &cpu_stats_area[cpu];
+
+	memset(public_per_cpu(cpu)->stats, 0,
+	       sizeof(public_per_cpu(cpu)->stats));
+
+	published->seq++;
+	memory_store_barrier();
+	memset(published->stats, 0, sizeof(published->stats));
+	memset(published->latency, 0, sizeof(published->latency));
+	memory_store_barrier();
+	published->seq++;
+}
+
 static void cell_destroy_internal(struct cell *cell)
 {
 	const struct jailhouse_memory *mem;
@@ -375,8 +612,7 @@ static void cell_destroy_internal(struct cell *cell)
 		set_bit(cpu, root_cell.cpu_set->bitmap);
 		public_per_cpu(cpu)->cell = &root_cell;
 		public_per_cpu(cpu)->failed = false;
-		memset(public_per_cpu(cpu)->stats, 0,
-		       sizeof(public_per_cpu(cpu)->stats));
+		clear_cpu_stats(cpu);
 	}
 
 	for_each_mem_region(mem, cell->config, n) {
@@ -510,8 +746,7 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 
 		clear_bit(cpu, root_cell.cpu_set->bitmap);
 		public_per_cpu(cpu)->cell = cell;
-		memset(public_per_cpu(cpu)->stats, 0,
-		       sizeof(public_per_cpu(cpu)->stats));
+		clear_cpu_stats(cpu);
 	}
 
 	/*
@@ -896,6 +1131,18 @@ static long hypervisor_get_info(struct per_cpu *cpu_data, unsigned long type)
 		return remap_pool.used_pages;
 	case JAILHOUSE_INFO_NUM_CELLS:
 		return num_cells;
+	case JAILHOUSE_INFO_MEM_POOL_FREE_BLOCKS:
+		return page_pool_free_blocks(&mem_pool);
+	case JAILHOUSE_INFO_MEM_POOL_LARGEST_FREE:
+		return page_pool_largest_free(&mem_pool);
+	case JAILHOUSE_INFO_REMAP_POOL_FREE_BLOCKS:
+		return page_pool_free_blocks(&remap_pool);
+	case JAILHOUSE_INFO_REMAP_POOL_LARGEST_FREE:
+		return page_pool_largest_free(&remap_pool);
+	case JAILHOUSE_INFO_CPU_STATS_AREA:
+		return (void *)cpu_stats_area - (void *)&hypervisor_header;
+	case JAILHOUSE_INFO_CONSOLE_DROPPED:
+		return printk_dropped_bytes() & BIT_MASK(30, 0);
 	default:
 		return -EINVAL;
 	}
@@ -923,10 +1170,58 @@ static int cpu_get_info(struct per_cpu *cpu_data, unsigned long cpu_id,
 		type - JAILHOUSE_CPU_INFO_STAT_BASE < JAILHOUSE_NUM_CPU_STATS) {
 		type -= JAILHOUSE_CPU_INFO_STAT_BASE;
 		return public_per_cpu(cpu_id)->stats[type] & BIT_MASK(30, 0);
+	} else if (type >= JAILHOUSE_CPU_INFO_LATENCY_BASE &&
+		type - JAILHOUSE_CPU_INFO_LATENCY_BASE <
+		JAILHOUSE_NUM_CPU_STATS * JAILHOUSE_CPU_LATENCY_BUCKETS) {
+		type -= JAILHOUSE_CPU_INFO_LATENCY_BASE;
+		return cpu_stats_area[cpu_id].latency
+			[type / JAILHOUSE_CPU_LATENCY_BUCKETS]
+			.buckets[type % JAILHOUSE_CPU_LATENCY_BUCKETS] &
+			BIT_MASK(30, 0);
+	} else if (type >= JAILHOUSE_CPU_INFO_LATENCY_MAX_BASE &&
+		type - JAILHOUSE_CPU_INFO_LATENCY_MAX_BASE <
+		JAILHOUSE_NUM_CPU_STATS) {
+		type -= JAILHOUSE_CPU_INFO_LATENCY_MAX_BASE;
+		return MIN(cpu_stats_area[cpu_id].latency[type].max,
+			   BIT_MASK(30, 0));
 	} else
 		return -EINVAL;
 }
 
+static int debug_console_write(struct per_cpu *cpu_data, unsigned long address,
+			       unsigned long size)
+{
+	unsigned long offs = address & PAGE_OFFS_MASK;
+	char chunk[JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX + 1];
+	const char *src;
+	unsigned int n, len = 0;
+
+	if (!CELL_FLAGS_VIRTUAL_CONSOLE_PERMITTED(
+		cpu_data->public.cell->config->flags))
+		return trace_error(-EPERM);
+
+	if (size > JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX)
+		return trace_error(-EINVAL);
+	if (size == 0)
+		return 0;
+
+	src = paging_get_guest_pages(NULL, address, PAGES(offs + size),
+				     PAGE_READONLY_FLAGS);
+	if (!src)
+		return trace_error(-EINVAL);
+	src += offs;
+
+	/* NUL bytes would truncate the output, drop them */
+	for (n = 0; n < size; n++)
+		if (src[n] != 0)
+			chunk[len++] = src[n];
+	chunk[len] = 0;
+
+	printk("%s", chunk);
+
+	return 0;
+}
+
 /**
  * Handle hypercall invoked by a cell.
  * @param code		Hypercall code.
@@ -966,6 +1261,10 @@ long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2)
 			return trace_error(-EPERM);
 		printk("%c", (char)arg1);
 		return 0;
+	case JAILHOUSE_HC_TRACE_CONTROL:
+		return trace_control(cpu_data, arg1);
+	case JAILHOUSE_HC_DEBUG_CONSOLE_WRITE:
+		return debug_console_write(cpu_data, arg1, arg2);
 	default:
 		return -ENOSYS;
 	}
@@ -22,6 +22,22 @@
 #include <jailhouse/cell-config.h>
 #include <jailhouse/hypercall.h>
 
+/** Maximum number of guest-physical ranges tracked per cell for deferred
+ * invalidation. Further changes fall back to a cell-wide flush. */
+#define CELL_MAX_DIRTY_RANGES		16
+
+/** Maximum number of folded page tables per cell awaiting their release. If
+ * exceeded, page tables are no longer folded until the next commit. */
+#define CELL_MAX_FOLDED_TABLES		64
+
+/** Guest-physical range whose mappings were changed. */
+struct cell_dirty_range {
+	/** Start address, page-aligned. */
+	unsigned long start;
+	/** Size in bytes, page-aligned. */
+	unsigned long size;
+};
+
 /** Cell-related states. */
 struct cell {
 	union {
@@ -54,21 +70,46 @@ struct cell {
 
 	/** List of PCI devices assigned to this cell. */
 	struct pci_device *pci_devices;
+	/** Open-addressing hash table mapping BDFs to pci_devices indexes
+	 * plus one, 0 marks free slots. */
+	u32 *pci_device_hash;
+	/** Number of bits of a pci_device_hash index. */
+	unsigned int pci_device_hash_bits;
 
-	/** Lock protecting changes to mmio_locations, mmio_handlers, and
-	 * num_mmio_regions. */
+	/** Lock protecting changes to the MMIO region slots and the dispatch
+	 * tables. */
 	spinlock_t mmio_region_lock;
-	/** Generation counter of mmio_locations, mmio_handlers, and
-	 * num_mmio_regions. */
-	volatile unsigned long mmio_generation;
-	/** MMIO region description table. */
+	/** Double-buffered page-indexed MMIO dispatch tables. */
+	struct mmio_dispatch_table mmio_tables[2];
+	/** Dispatch table currently used for lookups, one of mmio_tables. */
+	struct mmio_dispatch_table *volatile mmio_dispatch;
+	/** MMIO region description slots. */
 	struct mmio_region_location *mmio_locations;
-	/** MMIO region handler table. */
+	/** MMIO region handler slots. */
 	struct mmio_region_handler *mmio_handlers;
 	/** Number of MMIO regions in use. */
 	unsigned int num_mmio_regions;
 	/** Maximum number of MMIO regions. */
 	unsigned int max_mmio_regions;
+
+	/** Number of guest-physical mappings per page size, see
+	 * @ref PAGING_MAPPING_SIZES. */
+	unsigned long mappings[PAGING_MAPPING_SIZES];
+
+	/** Guest-physical ranges changed since the last config_commit(),
+	 * pending TLB and IOMMU invalidation. */
+	struct cell_dirty_range dirty_ranges[CELL_MAX_DIRTY_RANGES];
+	/** Number of valid entries in dirty_ranges. */
+	unsigned int num_dirty_ranges;
+	/** True if the changes exceeded dirty_ranges and the whole cell has to
+	 * be invalidated. */
+	bool dirty_overflow;
+
+	/** Page tables replaced by huge pages since the last config_commit().
+	 * TLBs and IOMMUs may still walk them until then. */
+	page_table_t folded_tables[CELL_MAX_FOLDED_TABLES];
+	/** Number of valid entries in folded_tables. */
+	unsigned int num_folded_tables;
 };
 
 extern struct cell root_cell;
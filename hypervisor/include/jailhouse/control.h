@@ -125,6 +125,15 @@ int cell_init(struct cell *cell);
 
 void config_commit(struct cell *cell_added_removed);
 
+void cell_mark_dirty(struct cell *cell, unsigned long start,
+		     unsigned long size);
+
+int root_cell_share_pages(const void *addr, unsigned long size);
+int root_cell_share_pages_live(const void *addr, unsigned long size);
+
+int cpu_stats_init(void);
+void cpu_stats_publish(unsigned int cpu, const u64 *latency);
+
 long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2);
 
 void shutdown(void);
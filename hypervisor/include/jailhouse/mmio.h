@@ -174,6 +174,14 @@ struct mmio_region_handler {
 	void *arg;
 };
 
+/** Page-indexed MMIO dispatch table. */
+struct mmio_dispatch_table {
+	/** Root node of the lookup tree, indexed by guest-physical page. */
+	unsigned long *root;
+	/** Bitmap of the region slots that are referenced by this table. */
+	unsigned long *slots;
+};
+
 int mmio_cell_init(struct cell *cell);
 
 void mmio_region_register(struct cell *cell, unsigned long start,
@@ -56,7 +56,16 @@
 /** Global page pool */
 extern u8 __page_pool[];
 
-/** Page pool state. */
+/** Maximum number of buddy block orders tracked per page pool. */
+#define PAGE_POOL_ORDERS	20
+
+/**
+ * Page pool state.
+ *
+ * Free pages are managed as naturally aligned blocks of 2^order pages (buddy
+ * allocator). Per order, a bitmap marks the first page of each free block,
+ * and a summary bitmap marks the non-zero words of that bitmap.
+ */
 struct page_pool {
 	/** Base address of the pool. */
 	void *base_address;
@@ -68,6 +77,14 @@ struct page_pool {
 	unsigned long *used_bitmap;
 	/** Set @c PAGE_SCRUB_ON_FREE to zero-out pages on release. */
 	unsigned long flags;
+	/** Highest block order that fits into the pool. */
+	unsigned int max_order;
+	/** Number of free blocks per order. */
+	unsigned long free_blocks[PAGE_POOL_ORDERS];
+	/** Bitmaps of free blocks per order. */
+	unsigned long *free_bitmap[PAGE_POOL_ORDERS];
+	/** Bitmaps of non-zero free_bitmap words per order. */
+	unsigned long *free_summary[PAGE_POOL_ORDERS];
 };
 
 /**
@@ -84,6 +101,27 @@ struct page_pool {
 #define PAGING_NO_HUGE		0
 /** When possible, use huge pages for creating a mapping. */
 #define PAGING_HUGE		0x2
+
+/** Do not fold page tables into huge pages. */
+#define PAGING_NO_FOLD		0
+/**
+ * Fold fully populated page tables back into huge pages, requires
+ * @c PAGING_HUGE and paging_structures::cell. Only ranges within a single
+ * memory region of that cell that permits huge pages are folded. Only valid
+ * if a table can be replaced by a huge page without invalidating it first,
+ * i.e. not for ARM stage-2 tables which require break-before-make.
+ */
+#define PAGING_FOLD		0x4
+/** @} */
+
+/**
+ * @defgroup PAGING_MAPPING_SIZES Page sizes tracked in mapping statistics
+ * @{
+ */
+#define PAGING_MAPPING_4K	0
+#define PAGING_MAPPING_2M	1
+#define PAGING_MAPPING_1G	2
+#define PAGING_MAPPING_SIZES	3
 /** @} */
 
 /** Page table reference. */
@@ -185,6 +223,13 @@ struct paging_structures {
 	/** Reference to root-level page table, ignored if root_paging is NULL.
 	 */
 	page_table_t root_table;
+	/** Counters of terminal mappings per page size, indexed by
+	 * @ref PAGING_MAPPING_SIZES, or NULL if not tracked. */
+	unsigned long *mappings;
+	/** Cell whose guest-physical address space is described, receives
+	 * folded ranges via cell_mark_dirty() and keeps folded tables until
+	 * their release, or NULL. */
+	struct cell *cell;
 };
 
 /**
@@ -215,6 +260,9 @@ void *page_alloc(struct page_pool *pool, unsigned int num);
 void *page_alloc_aligned(struct page_pool *pool, unsigned int num);
 void page_free(struct page_pool *pool, void *first_page, unsigned int num);
 
+unsigned long page_pool_free_blocks(struct page_pool *pool);
+unsigned long page_pool_largest_free(struct page_pool *pool);
+
 /**
  * Translate virtual hypervisor address to physical address.
  * @param hvirt		Virtual address in hypervisor address space.
@@ -16,19 +16,28 @@
 
 #include <asm/cell.h>
 
+#define PCI_CFG_VENDOR_ID	0x00
 #define PCI_CFG_COMMAND		0x04
 # define PCI_CMD_MEM		(1 << 1)
 # define PCI_CMD_MASTER		(1 << 2)
 # define PCI_CMD_INTX_OFF	(1 << 10)
 #define PCI_CFG_STATUS		0x06
 # define PCI_STS_CAPS		(1 << 4)
+#define PCI_CFG_REVISION	0x08
+#define PCI_CFG_HEADER_TYPE	0x0e
 #define PCI_CFG_BAR		0x10
 #define PCI_CFG_BAR_END		0x27
+#define PCI_CFG_SUBSYS_VENDOR_ID 0x2c
 #define PCI_CFG_ROMBAR		0x30
 #define PCI_CFG_CAPS		0x34
 #define PCI_CFG_INT		0x3c
+#define PCI_CFG_INT_PIN		0x3d
+#define PCI_CFG_MIN_GNT		0x3e
 
 #define PCI_CONFIG_HEADER_SIZE	0x40
+#define PCI_STD_CONFIG_SIZE	0x100
+
+#define PCI_SRIOV_CTRL		0x08
 
 #define PCI_NUM_BARS		6
 
@@ -141,6 +150,16 @@ struct pci_device {
 	union pci_msix_vector *msix_vectors;
 	/** Buffer for shadow table of up to PCI_EMBEDDED_MSIX_VECTS vectors. */
 	union pci_msix_vector msix_vector_array[PCI_EMBEDDED_MSIX_VECTS];
+	/** Shadow of read-only registers in the standard config space. */
+	u8 cfg_shadow[PCI_STD_CONFIG_SIZE];
+	/** Bitmap of valid bytes in cfg_shadow. */
+	u32 cfg_shadow_valid[PCI_STD_CONFIG_SIZE / 32];
+	/** True if cfg_shadow was filled from a present function. */
+	bool cfg_shadow_filled;
+	/** Value of the global shadow generation when cfg_shadow was filled. */
+	unsigned int cfg_shadow_generation;
+	/** Sequence count of cfg_shadow updates, odd while being refilled. */
+	volatile unsigned int cfg_shadow_seq;
 };
 
 u32 pci_read_config(u16 bdf, u16 address, unsigned int size);
@@ -21,8 +21,11 @@
 
 #include <jailhouse/paging.h>
 #include <jailhouse/cell.h>
+#include <jailhouse/printk.h>
 #include <asm/percpu.h>
 
+struct jailhouse_trace_buffer;
+
 /**
  * @ingroup Per-CPU
  * @{
@@ -40,7 +43,7 @@ struct public_per_cpu {
 	struct cell *cell;
 
 	/** Statistic counters. */
-	u32 stats[JAILHOUSE_NUM_CPU_STATS];
+	u64 stats[JAILHOUSE_NUM_CPU_STATS];
 
 	/** State of the shutdown process. Possible values:
 	 * @li SHUTDOWN_NONE: no shutdown in progress
@@ -59,6 +62,15 @@ struct public_per_cpu {
 	/** Set to true for a pending TLB flush for the paging layer that does
 	 *  host physical <-> guest physical memory mappings. */
 	bool flush_vcpu_caches;
+	/** True while the CPU looks up an MMIO region in the dispatch table of
+	 *  its cell. */
+	volatile bool mmio_dispatching;
+
+	/** Console output of this CPU waiting to be written out. */
+	struct printk_ring printk_ring;
+
+	/** Exit trace buffer of this CPU, NULL while tracing is disabled. */
+	struct jailhouse_trace_buffer *trace_buffer;
 
 	ARCH_PUBLIC_PERCPU_FIELDS;
 } __attribute__((aligned(PAGE_SIZE)));
@@ -79,6 +91,13 @@ struct per_cpu {
 	/** Per-CPU paging structures. */
 	struct paging_structures pg_structs;
 
+	/** Trace buffer recording the exit currently handled, if any. */
+	struct jailhouse_trace_buffer *trace_exit_buffer;
+	/** True if the exit currently handled is timed. */
+	bool exit_timed;
+	/** Timestamp when the exit currently handled was entered. */
+	u64 exit_entry_time;
+
 	ARCH_PERCPU_FIELDS;
 
 	/* Must be last field! */
@@ -10,12 +10,42 @@
  * the COPYING file in the top-level directory.
  */
 
+#ifndef _JAILHOUSE_PRINTK_H
+#define _JAILHOUSE_PRINTK_H
+
 #include <jailhouse/types.h>
 
+#define PRINTK_RING_SIZE	1024
+
+/**
+ * Per-CPU buffer of console output that was not yet written out.
+ *
+ * Only the owning CPU produces, only the CPU draining the console output
+ * consumes.
+ */
+struct printk_ring {
+	char buf[PRINTK_RING_SIZE];
+	/** End of the complete messages in the ring. */
+	volatile unsigned int head;
+	/** Start of the data not yet written out. */
+	volatile unsigned int tail;
+	/** Write position of the message under construction. */
+	unsigned int pos;
+	/** Bytes that were dropped because the ring was full. */
+	volatile unsigned int dropped;
+	/** Dropped bytes already reported on the console. */
+	unsigned int dropped_reported;
+};
+
 void __attribute__((format(printf, 1, 2))) printk(const char *fmt, ...);
 
 void __attribute__((format(printf, 1, 2))) panic_printk(const char *fmt, ...);
 
+void printk_defer_output(void);
+void printk_flush(void);
+void printk_flush_deferred(void);
+unsigned int printk_dropped_bytes(void);
+
 #ifdef CONFIG_TRACE_ERROR
 #define trace_error(code) ({						  \
 	printk("%s:%d: returning error %s\n", __FILE__, __LINE__, #code); \
@@ -30,3 +60,5 @@ extern void (*arch_dbg_write)(const char *msg);
 
 extern bool virtual_console;
 extern volatile struct jailhouse_virt_console console;
+
+#endif /* !_JAILHOUSE_PRINTK_H */
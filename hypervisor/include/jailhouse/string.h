@@ -14,9 +14,27 @@
  */
 #include <jailhouse/types.h>
 
+/** Architecture-optimized implementations of memset() and memcpy(). */
+struct string_ops {
+	/** Replacement for memset(), same semantics. */
+	void *(*memset)(void *s, int c, size_t n);
+	/** Replacement for memcpy(), same semantics. */
+	void *(*memcpy)(void *d, const void *s, size_t n);
+};
+
+extern const struct string_ops *arch_string_ops;
+
 void *memcpy(void *d, const void *s, size_t n);
 void *memset(void *s, int c, size_t n);
 
+/**
+ * Select architecture-optimized string operations based on CPU features.
+ *
+ * Sets arch_string_ops if the architecture can do better than the generic
+ * word-sized implementations. Called early by paging_init().
+ */
+void arch_string_init(void);
+
 int strcmp(const char *s1, const char *s2);
 
 /*
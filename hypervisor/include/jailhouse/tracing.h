@@ -0,0 +1,70 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_TRACING_H
+#define _JAILHOUSE_TRACING_H
+
+#include <jailhouse/percpu.h>
+#include <jailhouse/trace.h>
+
+/**
+ * @defgroup Tracing Exit Tracing
+ *
+ * Records VM exits into per-CPU ring buffers that the root cell can read.
+ * Independently, the latency of the exits is accounted in per-CPU histograms
+ * unless disabled.
+ *
+ * @{
+ */
+
+extern bool trace_latency;
+
+long trace_control(struct per_cpu *cpu_data, unsigned long command);
+
+void __trace_exit_begin(unsigned int reason, unsigned long pc);
+void trace_exit_end(void);
+
+/**
+ * Start accounting an exit from guest mode on the calling CPU.
+ * @param reason	Architecture-specific exit reason.
+ * @param pc		Guest program counter.
+ *
+ * The arguments are only evaluated if tracing or latency accounting is
+ * enabled.
+ *
+ * @see trace_exit_end
+ */
+#define trace_exit_begin(reason, pc)					\
+	do {								\
+		if (trace_latency || this_cpu_public()->trace_buffer)	\
+			__trace_exit_begin(reason, pc);			\
+	} while (0)
+
+/**
+ * Attach the accessed guest-physical address to the current exit record.
+ * @param address	MMIO address.
+ */
+static inline void trace_exit_mmio(unsigned long address)
+{
+	struct jailhouse_trace_buffer *buffer =
+		this_cpu_data()->trace_exit_buffer;
+	struct jailhouse_trace_entry *entry;
+
+	if (buffer) {
+		entry = &buffer->entries[buffer->head % buffer->num_entries];
+		entry->mmio_address = address;
+		entry->flags |= JAILHOUSE_TRACE_FLAG_MMIO;
+	}
+}
+
+/** @} */
+#endif /* !_JAILHOUSE_TRACING_H */
@@ -12,10 +12,29 @@
 
 #include <jailhouse/string.h>
 
+#define WORD_ALIGNED(p)	(((unsigned long)(p) & (sizeof(long) - 1)) == 0)
+
+/** Optimized string operations, selected by arch_string_init() if any. */
+const struct string_ops *arch_string_ops;
+
 void *memset(void *s, int c, size_t n)
 {
+	unsigned long *w, pattern;
 	u8 *p = s;
 
+	if (arch_string_ops)
+		return arch_string_ops->memset(s, c, n);
+
+	while (n > 0 && !WORD_ALIGNED(p)) {
+		*p++ = c;
+		n--;
+	}
+
+	pattern = (u8)c * (~0UL / 0xff);
+	for (w = (unsigned long *)p; n >= sizeof(long); n -= sizeof(long))
+		*w++ = pattern;
+
+	p = (u8 *)w;
 	while (n-- > 0)
 		*p++ = c;
 	return s;
@@ -37,6 +56,25 @@ void *memcpy(void *dest, const void *src, size_t n)
 	const u8 *s = src;
 	u8 *d = dest;
 
+	if (arch_string_ops)
+		return arch_string_ops->memcpy(dest, src, n);
+
+	/* Word-wise copying requires equal alignment of source and dest. */
+	if (((unsigned long)s ^ (unsigned long)d) & (sizeof(long) - 1))
+		goto copy_bytes;
+
+	while (n > 0 && !WORD_ALIGNED(d)) {
+		*d++ = *s++;
+		n--;
+	}
+
+	for (; n >= sizeof(long); n -= sizeof(long)) {
+		*(unsigned long *)d = *(const unsigned long *)s;
+		d += sizeof(long);
+		s += sizeof(long);
+	}
+
+copy_bytes:
 	while (n-- > 0)
 		*d++ = *s++;
 	return dest;
@@ -10,13 +10,82 @@
  * the COPYING file in the top-level directory.
  */
 
+#include <jailhouse/bitops.h>
 #include <jailhouse/cell.h>
 #include <jailhouse/control.h>
 #include <jailhouse/mmio.h>
 #include <jailhouse/paging.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/tracing.h>
 #include <jailhouse/unit.h>
 #include <jailhouse/percpu.h>
+#include <jailhouse/utils.h>
+
+/*
+ * MMIO regions are kept in stable slots and dispatched via a page-indexed
+ * lookup tree per cell. Each tree node is a page of entries that either point
+ * to the node of the next level, refer to the single region slot intersecting
+ * the covered range, or mark the range as shared by multiple regions. Shared
+ * ranges (e.g. subpage regions) and addresses beyond the tree are resolved by
+ * scanning the slots referenced by the table.
+ *
+ * Two copies of the table are maintained. Updates are applied to the inactive
+ * copy first, which is then published. After all CPUs of the cell left the
+ * previous copy, that one is brought up to date as well. Thus, readers never
+ * observe a table under modification and never have to restart.
+ */
+#define MMIO_DISPATCH_BITS	(PAGE_SHIFT - (BITS_PER_LONG == 64 ? 3 : 2))
+#define MMIO_DISPATCH_ENTRIES	(1UL << MMIO_DISPATCH_BITS)
+#if BITS_PER_LONG == 64
+#define MMIO_DISPATCH_LEVELS	4
+#else
+#define MMIO_DISPATCH_LEVELS	2
+#endif
+#define MMIO_DISPATCH_SHIFT(level) \
+	(PAGE_SHIFT + (MMIO_DISPATCH_LEVELS - 1 - (level)) * MMIO_DISPATCH_BITS)
+/* last address covered by the lookup tree */
+#define MMIO_DISPATCH_LIMIT \
+	((1UL << MMIO_DISPATCH_SHIFT(0) << MMIO_DISPATCH_BITS) - 1)
+
+#define MMIO_ENTRY_REGION	0x1UL
+#define MMIO_ENTRY_SHARED	0x2UL
+#define MMIO_ENTRY_SLOT_SHIFT	2
+
+#define MMIO_SLOT_BITMAP_SIZE(slots) \
+	(((slots) + BITS_PER_LONG - 1) / BITS_PER_LONG * sizeof(unsigned long))
+
+static inline unsigned long dispatch_region_entry(unsigned int slot)
+{
+	return ((unsigned long)slot << MMIO_ENTRY_SLOT_SHIFT) |
+		MMIO_ENTRY_REGION;
+}
+
+static inline bool dispatch_is_node(unsigned long entry)
+{
+	return entry != 0 &&
+		!(entry & (MMIO_ENTRY_REGION | MMIO_ENTRY_SHARED));
+}
+
+static inline unsigned int dispatch_index(unsigned long address,
+					  unsigned int level)
+{
+	return (address >> MMIO_DISPATCH_SHIFT(level)) &
+		(MMIO_DISPATCH_ENTRIES - 1);
+}
+
+static inline bool dispatch_covers(unsigned long address)
+{
+	return (address >> MMIO_DISPATCH_SHIFT(0) >> MMIO_DISPATCH_BITS) == 0;
+}
+
+static unsigned int mmio_data_pages(struct cell *cell)
+{
+	return PAGES(cell->max_mmio_regions *
+		     (sizeof(struct mmio_region_location) +
+		      sizeof(struct mmio_region_handler)) +
+		     ARRAY_SIZE(cell->mmio_tables) *
+		     MMIO_SLOT_BITMAP_SIZE(cell->max_mmio_regions));
+}
 
 /**
  * Perform MMIO-specific initialization for a new cell.
@@ -41,24 +110,231 @@ int mmio_cell_init(struct cell *cell)
 		if (JAILHOUSE_MEMORY_IS_SUBPAGE(mem))
 			cell->max_mmio_regions++;
 
-	pages = page_alloc(&mem_pool,
-			   PAGES(cell->max_mmio_regions *
-				 (sizeof(struct mmio_region_location) +
-				  sizeof(struct mmio_region_handler))));
+	pages = page_alloc(&mem_pool, mmio_data_pages(cell));
 	if (!pages)
 		return -ENOMEM;
 
 	cell->mmio_locations = pages;
-	cell->mmio_handlers = pages +
-		cell->max_mmio_regions * sizeof(struct mmio_region_location);
+	pages += cell->max_mmio_regions * sizeof(struct mmio_region_location);
+	cell->mmio_handlers = pages;
+	pages += cell->max_mmio_regions * sizeof(struct mmio_region_handler);
+
+	for (n = 0; n < ARRAY_SIZE(cell->mmio_tables); n++) {
+		cell->mmio_tables[n].slots = pages;
+		pages += MMIO_SLOT_BITMAP_SIZE(cell->max_mmio_regions);
+
+		cell->mmio_tables[n].root = page_alloc(&mem_pool, 1);
+		if (!cell->mmio_tables[n].root) {
+			mmio_cell_exit(cell);
+			return -ENOMEM;
+		}
+	}
+
+	cell->mmio_dispatch = &cell->mmio_tables[0];
 
 	return 0;
 }
 
-static void copy_region(struct cell *cell, unsigned int src, unsigned dst)
+static bool region_contains(const struct mmio_region_location *region,
+			    unsigned long address, unsigned int size)
+{
+	return address >= region->start &&
+		address + size <= region->start + region->size;
+}
+
+static bool region_intersects(const struct mmio_region_location *region,
+			      unsigned long first, unsigned long last)
+{
+	return region->size > 0 && region->start <= last &&
+		region->start + region->size - 1 >= first;
+}
+
+static bool region_covers(const struct mmio_region_location *region,
+			  unsigned long first, unsigned long last)
+{
+	return region->start <= first &&
+		region->start + region->size - 1 >= last;
+}
+
+/*
+ * Compute the entry for a range that was shared by multiple regions before
+ * one of them was removed from the table.
+ */
+static unsigned long dispatch_span_entry(struct cell *cell,
+					 const struct mmio_dispatch_table *table,
+					 unsigned long first, unsigned long last,
+					 bool leaf)
+{
+	const struct mmio_region_location *region;
+	unsigned long entry = 0;
+	unsigned int slot;
+
+	for (slot = 0; slot < cell->max_mmio_regions; slot++) {
+		region = &cell->mmio_locations[slot];
+		if (!test_bit(slot, table->slots) ||
+		    !region_intersects(region, first, last))
+			continue;
+		if (entry || !(leaf || region_covers(region, first, last)))
+			return MMIO_ENTRY_SHARED;
+		entry = dispatch_region_entry(slot);
+	}
+	return entry;
+}
+
+static unsigned long *dispatch_split(unsigned long entry)
+{
+	unsigned long *node = page_alloc(&mem_pool, 1);
+	unsigned int idx;
+
+	if (node && entry)
+		for (idx = 0; idx < MMIO_DISPATCH_ENTRIES; idx++)
+			node[idx] = entry;
+	return node;
+}
+
+static void dispatch_insert(unsigned long *node, unsigned int level,
+			    unsigned long first, unsigned long last,
+			    unsigned int slot)
+{
+	unsigned long span_mask = (1UL << MMIO_DISPATCH_SHIFT(level)) - 1;
+	bool leaf = level == MMIO_DISPATCH_LEVELS - 1;
+	unsigned long entry, entry_first, entry_last;
+	unsigned long *child;
+	unsigned int idx;
+
+	while (1) {
+		idx = dispatch_index(first, level);
+		entry = node[idx];
+		entry_first = first & ~span_mask;
+		entry_last = entry_first | span_mask;
+
+		if (entry == 0 &&
+		    (leaf || (first == entry_first && last >= entry_last))) {
+			node[idx] = dispatch_region_entry(slot);
+		} else if (leaf || entry == MMIO_ENTRY_SHARED ||
+			   (!dispatch_is_node(entry) && first == entry_first &&
+			    last >= entry_last)) {
+			/* overlapping regions, resolve by scanning the slots */
+			node[idx] = MMIO_ENTRY_SHARED;
+		} else {
+			if (!dispatch_is_node(entry)) {
+				child = dispatch_split(entry);
+				/* fall back to scanning the slots */
+				if (!child) {
+					node[idx] = MMIO_ENTRY_SHARED;
+					goto next;
+				}
+				node[idx] = (unsigned long)child;
+			}
+			dispatch_insert((unsigned long *)node[idx], level + 1,
+					first, MIN(last, entry_last), slot);
+		}
+next:
+		if (entry_last >= last)
+			break;
+		first = entry_last + 1;
+	}
+}
+
+static void dispatch_remove(struct cell *cell,
+			    const struct mmio_dispatch_table *table,
+			    unsigned long *node, unsigned int level,
+			    unsigned long first, unsigned long last,
+			    unsigned int slot)
+{
+	unsigned long span_mask = (1UL << MMIO_DISPATCH_SHIFT(level)) - 1;
+	bool leaf = level == MMIO_DISPATCH_LEVELS - 1;
+	unsigned long entry, entry_first, entry_last;
+	unsigned int idx;
+
+	while (1) {
+		idx = dispatch_index(first, level);
+		entry = node[idx];
+		entry_first = first & ~span_mask;
+		entry_last = entry_first | span_mask;
+
+		if (entry == dispatch_region_entry(slot))
+			node[idx] = 0;
+		else if (dispatch_is_node(entry))
+			dispatch_remove(cell, table, (unsigned long *)entry,
+					level + 1, first, MIN(last, entry_last),
+					slot);
+		else if (entry == MMIO_ENTRY_SHARED)
+			node[idx] = dispatch_span_entry(cell, table,
+							entry_first, entry_last,
+							leaf);
+
+		if (entry_last >= last)
+			break;
+		first = entry_last + 1;
+	}
+}
+
+static void dispatch_free(unsigned long *node, unsigned int level)
+{
+	unsigned int idx;
+
+	if (!node)
+		return;
+
+	if (level < MMIO_DISPATCH_LEVELS - 1)
+		for (idx = 0; idx < MMIO_DISPATCH_ENTRIES; idx++)
+			if (dispatch_is_node(node[idx]))
+				dispatch_free((unsigned long *)node[idx],
+					      level + 1);
+	page_free(&mem_pool, node, 1);
+}
+
+static void update_table(struct cell *cell, struct mmio_dispatch_table *table,
+			 unsigned int slot, bool add)
 {
-	cell->mmio_locations[dst] = cell->mmio_locations[src];
-	cell->mmio_handlers[dst] = cell->mmio_handlers[src];
+	const struct mmio_region_location *region =
+		&cell->mmio_locations[slot];
+	unsigned long last;
+
+	if (add)
+		set_bit(slot, table->slots);
+	else
+		clear_bit(slot, table->slots);
+
+	/* Parts beyond the tree are found by scanning the slots. */
+	if (region->size == 0 || !dispatch_covers(region->start))
+		return;
+
+	last = region->start + region->size - 1;
+	if (!dispatch_covers(last))
+		last = MMIO_DISPATCH_LIMIT;
+
+	if (add)
+		dispatch_insert(table->root, 0, region->start, last, slot);
+	else
+		dispatch_remove(cell, table, table->root, 0, region->start,
+				last, slot);
+}
+
+static void update_dispatch(struct cell *cell, unsigned int slot, bool add)
+{
+	struct mmio_dispatch_table *prev = cell->mmio_dispatch;
+	struct mmio_dispatch_table *next = prev == &cell->mmio_tables[0] ?
+		&cell->mmio_tables[1] : &cell->mmio_tables[0];
+	unsigned int cpu;
+
+	update_table(cell, next, slot, add);
+
+	/*
+	 * Commit all modifications of the inactive table before publishing it.
+	 * The second barrier orders the switch against reading the CPU states.
+	 */
+	memory_barrier();
+	cell->mmio_dispatch = next;
+	memory_barrier();
+
+	/* Wait for all lookups that may still use the previous table. */
+	for_each_cpu(cpu, cell->cpu_set)
+		while (public_per_cpu(cpu)->mmio_dispatching)
+			cpu_relax();
+
+	update_table(cell, prev, slot, add);
 }
 
 /**
@@ -75,112 +351,60 @@ void mmio_region_register(struct cell *cell, unsigned long start,
 			  unsigned long size, mmio_handler handler,
 			  void *handler_arg)
 {
-	unsigned int index, n;
+	unsigned int slot;
 
 	spin_lock(&cell->mmio_region_lock);
 
-	if (cell->num_mmio_regions >= cell->max_mmio_regions) {
+	/* Slots that are not referenced by the active table are unused. */
+	for (slot = 0; slot < cell->max_mmio_regions; slot++)
+		if (!test_bit(slot, cell->mmio_dispatch->slots))
+			break;
+
+	if (slot >= cell->max_mmio_regions) {
 		spin_unlock(&cell->mmio_region_lock);
 
 		printk("WARNING: Overflow during MMIO region registration!\n");
 		return;
 	}
 
-	for (index = 0; index < cell->num_mmio_regions; index++)
-		if (cell->mmio_locations[index].start > start)
-			break;
-
-	/*
-	 * Advance the generation to odd value, indicating that modifications
-	 * are ongoing. Commit this change via a barrier so that other CPUs
-	 * will see this before we start changing any field.
-	 */
-	cell->mmio_generation++;
-	memory_barrier();
-
-	for (n = cell->num_mmio_regions; n > index; n--)
-		copy_region(cell, n - 1, n);
-
-	cell->mmio_locations[index].start = start;
-	cell->mmio_locations[index].size = size;
-	cell->mmio_handlers[index].function = handler;
-	cell->mmio_handlers[index].arg = handler_arg;
+	cell->mmio_locations[slot].start = start;
+	cell->mmio_locations[slot].size = size;
+	cell->mmio_handlers[slot].function = handler;
+	cell->mmio_handlers[slot].arg = handler_arg;
 
+	update_dispatch(cell, slot, true);
 	cell->num_mmio_regions++;
 
-	/* Ensure all fields are committed before advancing the generation. */
-	memory_barrier();
-	cell->mmio_generation++;
-
 	spin_unlock(&cell->mmio_region_lock);
 }
 
-static int find_region(struct cell *cell, unsigned long address,
-		       unsigned int size, unsigned long *region_base,
-		       struct mmio_region_handler *handler)
+static int find_region(struct cell *cell,
+		       const struct mmio_dispatch_table *table,
+		       unsigned long address, unsigned int size)
 {
-	unsigned int range_start, range_size, index;
-	struct mmio_region_location region;
-	unsigned long generation;
-
-restart:
-	generation = cell->mmio_generation;
-
-	/*
-	 * Ensure that the generation value was read prior to reading any other
-	 * field.
-	 */
-	memory_load_barrier();
-
-	/* Odd number? Then we have an ongoing modification and must restart. */
-	if (generation & 1) {
-		cpu_relax();
-		goto restart;
-	}
-
-	range_start = 0;
-	range_size = cell->num_mmio_regions;
-
-	while (range_size > 0) {
-		index = range_start + range_size / 2;
-		region = cell->mmio_locations[index];
-
-		/*
-		 * Ensure the region location was read prior to checking the
-		 * generation again.
-		 */
-		memory_load_barrier();
-
-		/*
-		 * If the generation changed meanwhile, the fields we read
-		 * could have been inconsistent.
-		 */
-		if (cell->mmio_generation != generation)
-			goto restart;
-
-		if (address < region.start) {
-			range_size = index - range_start;
-		} else if (region.start + region.size < address + size) {
-			range_size -= index + 1 - range_start;
-			range_start = index + 1;
-		} else {
-			if (region_base != NULL) {
-				*region_base = region.start;
-				*handler = cell->mmio_handlers[index];
-			}
-
-			/*
-			 * Ensure everything was read prior to checking the
-			 * generation for the last time.
-			 */
-			memory_load_barrier();
-
-			/* final check of consistency */
-			if (cell->mmio_generation != generation)
-				goto restart;
-
-			return index;
+	const unsigned long *node = table->root;
+	unsigned long entry = MMIO_ENTRY_SHARED;
+	unsigned int level, slot;
+
+	if (dispatch_covers(address))
+		for (level = 0; level < MMIO_DISPATCH_LEVELS; level++) {
+			entry = node[dispatch_index(address, level)];
+			if (!dispatch_is_node(entry))
+				break;
+			node = (const unsigned long *)entry;
 		}
+
+	if (entry & MMIO_ENTRY_REGION) {
+		slot = entry >> MMIO_ENTRY_SLOT_SHIFT;
+		if (region_contains(&cell->mmio_locations[slot], address,
+				    size))
+			return slot;
+	} else if (entry == MMIO_ENTRY_SHARED) {
+		for (slot = 0; slot < cell->max_mmio_regions; slot++)
+			if (test_bit(slot, table->slots) &&
+			    region_contains(&cell->mmio_locations[slot],
+					    address, size))
+				return slot;
 	}
 	return -1;
 }
@@ -195,32 +419,16 @@ restart:
  */
 void mmio_region_unregister(struct cell *cell, unsigned long start)
 {
-	int index;
+	int slot;
 
 	spin_lock(&cell->mmio_region_lock);
 
-	index = find_region(cell, start, 1, NULL, NULL);
-	if (index >= 0) {
-		/*
-		 * Advance the generation to odd value, indicating that
-		 * modifications are ongoing. Commit this change via a barrier
-		 * so that other CPUs will see it before we start.
-		 */
-		cell->mmio_generation++;
-		memory_barrier();
-
-		for (/* empty */; (u32)index < cell->num_mmio_regions; index++)
-			copy_region(cell, index + 1, index);
-
+	slot = find_region(cell, cell->mmio_dispatch, start, 1);
+	if (slot >= 0) {
+		update_dispatch(cell, slot, false);
 		cell->num_mmio_regions--;
-
-		/*
-		 * Ensure all regions and their number are committed before
-		 * advancing the generation.
-		 */
-		memory_barrier();
-		cell->mmio_generation++;
 	}
+
 	spin_unlock(&cell->mmio_region_lock);
 }
 
@@ -239,11 +447,33 @@ void mmio_region_unregister(struct cell *cell, unsigned long start)
  */
 enum mmio_result mmio_handle_access(struct mmio_access *mmio)
 {
+	struct public_per_cpu *cpu_public = this_cpu_public();
+	struct cell *cell = cpu_public->cell;
 	struct mmio_region_handler handler;
-	unsigned long region_base;
+	unsigned long region_base = 0;
+	int slot;
+
+	trace_exit_mmio(mmio->address);
+
+	/*
+	 * Announce the lookup before picking the table so that an updater
+	 * waits for us in case we obtain the previous one.
+	 */
+	cpu_public->mmio_dispatching = true;
+	memory_barrier();
 
-	if (find_region(this_cell(), mmio->address, mmio->size, &region_base,
-			&handler) < 0)
+	slot = find_region(cell, cell->mmio_dispatch, mmio->address,
+			   mmio->size);
+	if (slot >= 0) {
+		region_base = cell->mmio_locations[slot].start;
+		handler = cell->mmio_handlers[slot];
+	}
+
+	/* Complete reading the slot before releasing the table. */
+	memory_barrier();
+	cpu_public->mmio_dispatching = false;
+
+	if (slot < 0)
 		return MMIO_UNHANDLED;
 
 	mmio->address -= region_base;
@@ -258,10 +488,12 @@ enum mmio_result mmio_handle_access(struct mmio_access *mmio)
  */
 void mmio_cell_exit(struct cell *cell)
 {
-	page_free(&mem_pool, cell->mmio_locations,
-		  PAGES(cell->max_mmio_regions *
-			(sizeof(struct mmio_region_location) +
-			 sizeof(struct mmio_region_handler))));
+	unsigned int n;
+
+	for (n = 0; n < ARRAY_SIZE(cell->mmio_tables); n++)
+		dispatch_free(cell->mmio_tables[n].root, 0);
+
+	page_free(&mem_pool, cell->mmio_locations, mmio_data_pages(cell));
 }
 
 void mmio_perform_access(void *base, struct mmio_access *mmio)
@@ -16,6 +16,7 @@
 #include <jailhouse/control.h>
 
 #define BITS_PER_PAGE		(PAGE_SIZE * 8)
+#define BITS_TO_LONGS(bits)	(((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
 #define INVALID_PAGE_NR		(~0UL)
 
@@ -58,6 +59,160 @@ unsigned long paging_get_phys_invalid(pt_entry_t pte, unsigned long virt)
 	return INVALID_PHYS_ADDR;
 }
 
+static inline unsigned long pool_first_page(struct page_pool *pool)
+{
+	return (unsigned long)pool->base_address >> PAGE_SHIFT;
+}
+
+/* Number of potential blocks of the given order that touch the pool. */
+static unsigned long pool_order_blocks(struct page_pool *pool,
+				       unsigned int order)
+{
+	unsigned long first = pool_first_page(pool);
+
+	return ((first + pool->pages - 1) >> order) - (first >> order) + 1;
+}
+
+static unsigned long pool_metadata_size(struct page_pool *pool)
+{
+	unsigned long longs = BITS_TO_LONGS(pool->pages);
+	unsigned int order;
+
+	for (order = 0; order <= pool->max_order; order++) {
+		longs += BITS_TO_LONGS(pool_order_blocks(pool, order));
+		longs += BITS_TO_LONGS(BITS_TO_LONGS(
+				pool_order_blocks(pool, order)));
+	}
+
+	return longs * sizeof(unsigned long);
+}
+
+static inline unsigned long block_index(struct page_pool *pool,
+					unsigned long page, unsigned int order)
+{
+	return (page >> order) - (pool_first_page(pool) >> order);
+}
+
+static inline bool block_is_free(struct page_pool *pool, unsigned long page,
+				 unsigned int order)
+{
+	return test_bit(block_index(pool, page, order),
+			pool->free_bitmap[order]);
+}
+
+static void block_set_free(struct page_pool *pool, unsigned long page,
+			   unsigned int order)
+{
+	unsigned long idx = block_index(pool, page, order);
+
+	set_bit(idx, pool->free_bitmap[order]);
+	set_bit(idx / BITS_PER_LONG, pool->free_summary[order]);
+	pool->free_blocks[order]++;
+}
+
+static void block_set_used(struct page_pool *pool, unsigned long page,
+			   unsigned int order)
+{
+	unsigned long idx = block_index(pool, page, order);
+
+	clear_bit(idx, pool->free_bitmap[order]);
+	if (pool->free_bitmap[order][idx / BITS_PER_LONG] == 0)
+		clear_bit(idx / BITS_PER_LONG, pool->free_summary[order]);
+	pool->free_blocks[order]--;
+}
+
+/* Returns the lowest free block of the given order, which must exist. */
+static unsigned long find_free_block(struct page_pool *pool,
+				     unsigned int order)
+{
+	unsigned long *summary = pool->free_summary[order];
+	unsigned long pos = 0, word;
+
+	while (summary[pos] == 0)
+		pos++;
+	word = ffsl(summary[pos]) + pos * BITS_PER_LONG;
+	pos = ffsl(pool->free_bitmap[order][word]) + word * BITS_PER_LONG;
+
+	return ((pool_first_page(pool) >> order) + pos) << order;
+}
+
+/*
+ * Returns the order of the free block containing the given page and stores
+ * its start in @c head, or returns a negative value if the page is in use.
+ */
+static int find_containing_block(struct page_pool *pool, unsigned long page,
+				 unsigned long *head)
+{
+	unsigned long first = pool_first_page(pool);
+	unsigned int order;
+
+	for (order = 0; order <= pool->max_order; order++) {
+		*head = page & ~((1UL << order) - 1);
+		if (*head < first)
+			break;
+		if (block_is_free(pool, *head, order))
+			return order;
+	}
+	return -1;
+}
+
+static void free_block(struct page_pool *pool, unsigned long page,
+		       unsigned int order)
+{
+	unsigned long first = pool_first_page(pool);
+	unsigned long buddy;
+
+	/* Merge with the buddy block as long as that one is free as well. */
+	while (order < pool->max_order) {
+		buddy = page ^ (1UL << order);
+		if (buddy < first ||
+		    buddy + (1UL << order) > first + pool->pages ||
+		    !block_is_free(pool, buddy, order))
+			break;
+		block_set_used(pool, buddy, order);
+		page &= ~(1UL << order);
+		order++;
+	}
+	block_set_free(pool, page, order);
+}
+
+/* Release the pages [start, end) as the largest possible aligned blocks. */
+static void free_range(struct page_pool *pool, unsigned long start,
+		       unsigned long end)
+{
+	unsigned int order;
+
+	while (start < end) {
+		for (order = 0; order < pool->max_order; order++)
+			if (start & (1UL << order) ||
+			    start + (2UL << order) > end)
+				break;
+		free_block(pool, start, order);
+		start += 1UL << order;
+	}
+}
+
+/* Claim the free pages [start, end), returning surplus block parts. */
+static void claim_range(struct page_pool *pool, unsigned long start,
+			unsigned long end)
+{
+	unsigned long head, block_end;
+	int order;
+
+	while (start < end) {
+		order = find_containing_block(pool, start, &head);
+		block_end = head + (1UL << order);
+
+		block_set_used(pool, head, order);
+		free_range(pool, head, start);
+		if (block_end > end) {
+			free_range(pool, end, block_end);
+			block_end = end;
+		}
+		start = block_end;
+	}
+}
+
 static unsigned long find_next_free_page(struct page_pool *pool,
 					 unsigned long start)
 {
@@ -75,7 +230,7 @@ static unsigned long find_next_free_page(struct page_pool *pool,
 		start_mask = ~0UL >> (BITS_PER_LONG - (start % BITS_PER_LONG));
 
 	for (bmp_pos = start / BITS_PER_LONG;
-	     bmp_pos < pool->pages / BITS_PER_LONG; bmp_pos++) {
+	     bmp_pos < BITS_TO_LONGS(pool->pages); bmp_pos++) {
 		bmp_val = pool->used_bitmap[bmp_pos] | start_mask;
 		start_mask = 0;
 		if (bmp_val != ~0UL) {
@@ -89,56 +244,77 @@ static unsigned long find_next_free_page(struct page_pool *pool,
 	return INVALID_PAGE_NR;
 }
 
+/*
+ * Slow path for unaligned requests that do not fit into a free buddy block
+ * but may still find enough consecutive free pages.
+ */
+static unsigned long find_free_run(struct page_pool *pool, unsigned int num)
+{
+	unsigned long start, next, last;
+	unsigned int found;
+
+	start = find_next_free_page(pool, 0);
+	while (start != INVALID_PAGE_NR) {
+		for (found = 1, last = start; found < num;
+		     found++, last = next) {
+			next = find_next_free_page(pool, last + 1);
+			if (next != last + 1)
+				break;
+		}
+		if (found == num)
+			return start;
+		start = find_next_free_page(pool, last + 1);
+	}
+
+	return INVALID_PAGE_NR;
+}
+
 /**
  * Allocate consecutive pages from the specified pool.
  * @param pool		Page pool to allocate from.
  * @param num		Number of pages.
- * @param align_mask	Choose start so that start_page_no & align_mask == 0.
+ * @param aligned	Align the first page to the next power of 2 of @c num.
  *
  * @return Pointer to first page or NULL if allocation failed.
  *
  * @see page_free
  */
 static void *page_alloc_internal(struct page_pool *pool, unsigned int num,
-				 unsigned long align_mask)
+				 bool aligned)
 {
-	unsigned long aligned_start, pool_start, next, start, last;
-	unsigned int allocated;
-
-	pool_start = (unsigned long)pool->base_address >> PAGE_SHIFT;
-
-	/* The pool itself might not be aligned as required. */
-	aligned_start = ((pool_start + align_mask) & ~align_mask) - pool_start;
-	next = aligned_start;
+	unsigned long first = pool_first_page(pool);
+	unsigned int order, min_order = 0;
+	unsigned long start, n;
 
-restart:
-	/* Forward the search start to the next aligned page. */
-	if ((next - aligned_start) & align_mask)
-		next += num - ((next - aligned_start) & align_mask);
-
-	start = next = find_next_free_page(pool, next);
-	if (start == INVALID_PAGE_NR || num == 0)
+	if (num == 0)
 		return NULL;
 
-	/* Enforce alignment (none of align_mask is 0). */
-	if ((start - aligned_start) & align_mask)
-		goto restart;
+	while ((1UL << min_order) < num)
+		min_order++;
 
-	for (allocated = 1, last = start; allocated < num;
-	     allocated++, last = next) {
-		next = find_next_free_page(pool, last + 1);
-		if (next == INVALID_PAGE_NR)
+	/* Take the lowest block of the smallest order that fits. */
+	for (order = min_order; order <= pool->max_order; order++)
+		if (pool->free_blocks[order] > 0)
+			break;
+
+	if (order <= pool->max_order) {
+		start = find_free_block(pool, order);
+	} else {
+		if (aligned)
+			return NULL;
+		start = find_free_run(pool, num);
+		if (start == INVALID_PAGE_NR)
 			return NULL;
-		if (next != last + 1)
-			goto restart;	/* not consecutive */
+		start += first;
 	}
 
-	for (allocated = 0; allocated < num; allocated++)
-		set_bit(start + allocated, pool->used_bitmap);
+	claim_range(pool, start, start + num);
 
+	for (n = start - first; n < start - first + num; n++)
+		set_bit(n, pool->used_bitmap);
 	pool->used_pages += num;
 
-	return pool->base_address + start * PAGE_SIZE;
+	return pool->base_address + (start - first) * PAGE_SIZE;
 }
 
 /**
@@ -152,7 +328,7 @@ restart:
  */
 void *page_alloc(struct page_pool *pool, unsigned int num)
 {
-	return page_alloc_internal(pool, num, 0);
+	return page_alloc_internal(pool, num, false);
 }
 
 /**
@@ -166,7 +342,7 @@ void *page_alloc(struct page_pool *pool, unsigned int num)
  */
 void *page_alloc_aligned(struct page_pool *pool, unsigned int num)
 {
-	return page_alloc_internal(pool, num, num - 1);
+	return page_alloc_internal(pool, num, true);
 }
 
 /**
@@ -179,19 +355,92 @@ void *page_alloc_aligned(struct page_pool *pool, unsigned int num)
  */
 void page_free(struct page_pool *pool, void *page, unsigned int num)
 {
-	unsigned long page_nr;
+	unsigned long page_nr, n;
 
-	if (!page)
+	if (!page || num == 0)
 		return;
 
-	while (num-- > 0) {
-		if (pool->flags & PAGE_SCRUB_ON_FREE)
-			memset(page, 0, PAGE_SIZE);
-		page_nr = (page - pool->base_address) / PAGE_SIZE;
-		clear_bit(page_nr, pool->used_bitmap);
-		pool->used_pages--;
-		page += PAGE_SIZE;
+	if (pool->flags & PAGE_SCRUB_ON_FREE)
+		memset(page, 0, num * PAGE_SIZE);
+
+	page_nr = (page - pool->base_address) / PAGE_SIZE;
+	for (n = page_nr; n < page_nr + num; n++)
+		clear_bit(n, pool->used_bitmap);
+	pool->used_pages -= num;
+
+	page_nr += pool_first_page(pool);
+	free_range(pool, page_nr, page_nr + num);
+}
+
+/**
+ * Set up the allocator state of a page pool.
+ * @param pool		Page pool with initialized base address and size.
+ * @param metadata	Zero-initialized memory of pool_metadata_size() bytes.
+ * @param reserved	Number of leading pages that shall be marked as used.
+ */
+static void page_pool_init(struct page_pool *pool, unsigned long *metadata,
+			   unsigned long reserved)
+{
+	unsigned long first = pool_first_page(pool);
+	unsigned int order;
+	unsigned long n;
+
+	pool->used_bitmap = metadata;
+	metadata += BITS_TO_LONGS(pool->pages);
+	for (order = 0; order <= pool->max_order; order++) {
+		n = pool_order_blocks(pool, order);
+		pool->free_bitmap[order] = metadata;
+		metadata += BITS_TO_LONGS(n);
+		pool->free_summary[order] = metadata;
+		metadata += BITS_TO_LONGS(BITS_TO_LONGS(n));
 	}
+
+	for (n = 0; n < reserved; n++)
+		set_bit(n, pool->used_bitmap);
+	pool->used_pages = reserved;
+
+	free_range(pool, first + reserved, first + pool->pages);
+}
+
+static void page_pool_set_max_order(struct page_pool *pool)
+{
+	pool->max_order = 0;
+	while (pool->max_order < PAGE_POOL_ORDERS - 1 &&
+	       (2UL << pool->max_order) <= pool->pages)
+		pool->max_order++;
+}
+
+/**
+ * Return the number of free blocks of a page pool.
+ * @param pool	Page pool to evaluate.
+ *
+ * @return Number of free buddy blocks. Together with
+ * 	   page_pool_largest_free(), this indicates the pool fragmentation.
+ */
+unsigned long page_pool_free_blocks(struct page_pool *pool)
+{
+	unsigned long blocks = 0;
+	unsigned int order;
+
+	for (order = 0; order <= pool->max_order; order++)
+		blocks += pool->free_blocks[order];
+	return blocks;
+}
+
+/**
+ * Return the size of the largest free block of a page pool.
+ * @param pool	Page pool to evaluate.
+ *
+ * @return Number of pages in the largest free naturally aligned block.
+ */
+unsigned long page_pool_largest_free(struct page_pool *pool)
+{
+	unsigned int order = pool->max_order + 1;
+
+	while (order-- > 0)
+		if (pool->free_blocks[order] > 0)
+			return 1UL << order;
+	return 0;
 }
 
 /**
@@ -235,9 +484,33 @@ static void flush_pt_entry(pt_entry_t pte, unsigned long paging_flags)
 		arch_paging_flush_cpu_caches(pte, sizeof(*pte));
 }
 
-static int split_hugepage(bool hv_paging, const struct paging *paging,
-			  pt_entry_t pte, unsigned long virt,
-			  unsigned long paging_flags)
+static void count_mappings(const struct paging_structures *pg_structs,
+			   const struct paging *paging, long delta)
+{
+	unsigned int index;
+
+	if (!pg_structs->mappings)
+		return;
+
+	switch (paging->page_size) {
+	case PAGE_SIZE:
+		index = PAGING_MAPPING_4K;
+		break;
+	case 2 * 1024 * 1024:
+		index = PAGING_MAPPING_2M;
+		break;
+	case 1024 * 1024 * 1024:
+		index = PAGING_MAPPING_1G;
+		break;
+	default:
+		return;
+	}
+	pg_structs->mappings[index] += delta;
+}
+
+static int split_hugepage(const struct paging_structures *pg_structs,
+			  const struct paging *paging, pt_entry_t pte,
+			  unsigned long virt, unsigned long paging_flags)
 {
 	unsigned long phys = paging->get_phys(pte, virt);
 	struct paging_structures sub_structs;
@@ -252,18 +525,105 @@ static int split_hugepage(bool hv_paging, const struct paging *paging,
 
 	flags = paging->get_flags(pte);
 
-	sub_structs.hv_paging = hv_paging;
+	sub_structs.hv_paging = pg_structs->hv_paging;
 	sub_structs.root_paging = paging + 1;
 	sub_structs.root_table = page_alloc(&mem_pool, 1);
+	sub_structs.mappings = pg_structs->mappings;
+	sub_structs.cell = pg_structs->cell;
 	if (!sub_structs.root_table)
 		return -ENOMEM;
 	paging->set_next_pt(pte, paging_hvirt2phys(sub_structs.root_table));
 	flush_pt_entry(pte, paging_flags);
+	count_mappings(pg_structs, paging, -1);
 
 	return paging_create(&sub_structs, phys, paging->page_size, virt,
 			     flags, paging_flags);
 }
 
+/*
+ * Folding must not merge mappings of different memory regions, e.g. with a
+ * neighbor that was mapped without huge pages on purpose.
+ */
+static bool cell_range_foldable(const struct cell *cell, unsigned long virt,
+				unsigned long size)
+{
+	const struct jailhouse_memory *mem;
+	unsigned int n;
+
+	for_each_mem_region(mem, cell->config, n)
+		if (virt >= mem->virt_start &&
+		    virt - mem->virt_start + size <= mem->size)
+			return !(mem->flags & JAILHOUSE_MEM_NO_HUGEPAGES);
+
+	return false;
+}
+
+/*
+ * Fold the page table pt, referenced by pte of the parent level, into a
+ * single huge page if all its entries map a contiguous, suitably aligned
+ * physical range of the same memory region with identical access flags. This
+ * undoes the effect of split_hugepage() once all holes have been filled
+ * again. The table is released by the next config_commit(), after TLBs and
+ * IOMMUs stopped using it.
+ */
+static bool coalesce_page_table(const struct paging_structures *pg_structs,
+				const struct paging *parent, pt_entry_t pte,
+				page_table_t pt, unsigned long virt,
+				unsigned long paging_flags)
+{
+	const struct paging *paging = parent + 1;
+	unsigned long phys, flags, offs;
+	pt_entry_t entry;
+
+	/*
+	 * Hypervisor page tables are in use by other CPUs while being
+	 * modified, so we cannot release their tables without a shootdown.
+	 */
+	if (parent->page_size == 0 || pg_structs->hv_paging ||
+	    !pg_structs->cell || !(paging_flags & PAGING_HUGE) ||
+	    !(paging_flags & PAGING_FOLD) ||
+	    pg_structs->cell->num_folded_tables == CELL_MAX_FOLDED_TABLES)
+		return false;
+
+	virt &= ~((unsigned long)parent->page_size - 1);
+	if (!cell_range_foldable(pg_structs->cell, virt, parent->page_size))
+		return false;
+
+	entry = paging->get_entry(pt, virt);
+	if (!paging->entry_valid(entry, PAGE_PRESENT_FLAGS))
+		return false;
+	phys = paging->get_phys(entry, virt);
+	if (phys == INVALID_PHYS_ADDR || phys & (parent->page_size - 1))
+		return false;
+	flags = paging->get_flags(entry);
+
+	for (offs = paging->page_size; offs < parent->page_size;
+	     offs += paging->page_size) {
+		entry = paging->get_entry(pt, virt + offs);
+		if (!paging->entry_valid(entry, PAGE_PRESENT_FLAGS) ||
+		    paging->get_phys(entry, virt + offs) != phys + offs ||
+		    paging->get_flags(entry) != flags)
+			return false;
+	}
+
+	parent->set_terminal(pte, phys, flags);
+	flush_pt_entry(pte, paging_flags);
+
+	/*
+	 * TLBs may still hold entries of the released table for the whole
+	 * range, not only for the part that was just mapped.
+	 */
+	cell_mark_dirty(pg_structs->cell, virt, parent->page_size);
+	pg_structs->cell->folded_tables[pg_structs->cell->num_folded_tables++] =
+		pt;
+
+	count_mappings(pg_structs, paging,
+		       -(long)(parent->page_size / paging->page_size));
+	count_mappings(pg_structs, parent, 1);
+
+	return true;
+}
+
 /**
  * Create or modify a page map.
  * @param pg_structs	Descriptor of paging structures to be used.
@@ -277,7 +637,10 @@ static int split_hugepage(bool hv_paging, const struct paging *paging,
  * @return 0 on success, negative error code otherwise.
  *
  * @note The function aims at using the largest possible page size for the
- * mapping but does not consolidate with neighboring mappings.
+ * mapping. With @c PAGING_HUGE and @c PAGING_FOLD, page tables that end up
+ * being filled with mappings of a contiguous region are folded into huge
+ * pages, also merging with neighboring mappings. Hypervisor paging structures
+ * are not folded.
  *
  * @see paging_destroy
  * @see paging_get_guest_pages
@@ -292,13 +655,16 @@ int paging_create(const struct paging_structures *pg_structs,
 
 	while (size > 0) {
 		const struct paging *paging = pg_structs->root_paging;
-		page_table_t pt = pg_structs->root_table;
+		page_table_t pt[MAX_PAGE_TABLE_LEVELS];
+		pt_entry_t pte[MAX_PAGE_TABLE_LEVELS];
 		struct paging_structures sub_structs;
-		pt_entry_t pte;
+		unsigned long page_size;
+		int n = 0;
 		int err;
 
+		pt[0] = pg_structs->root_table;
 		while (1) {
-			pte = paging->get_entry(pt, virt);
+			pte[n] = paging->get_entry(pt[n], virt);
 			if (paging->page_size > 0 &&
 			    paging->page_size <= size &&
 			    ((phys | virt) & (paging->page_size - 1)) == 0 &&
@@ -312,41 +678,68 @@ int paging_create(const struct paging_structures *pg_structs,
 				 */
 				if (paging->page_size > PAGE_SIZE) {
 					sub_structs.root_paging = paging;
-					sub_structs.root_table = pt;
+					sub_structs.root_table = pt[n];
 					sub_structs.hv_paging =
 						pg_structs->hv_paging;
+					sub_structs.mappings =
+						pg_structs->mappings;
+					sub_structs.cell = pg_structs->cell;
 					paging_destroy(&sub_structs, virt,
 						       paging->page_size,
 						       paging_flags);
+				} else if (paging->entry_valid(pte[n],
+							PAGE_PRESENT_FLAGS)) {
+					count_mappings(pg_structs, paging, -1);
 				}
-				paging->set_terminal(pte, phys, access_flags);
-				flush_pt_entry(pte, paging_flags);
+				paging->set_terminal(pte[n], phys,
+						     access_flags);
+				flush_pt_entry(pte[n], paging_flags);
+				count_mappings(pg_structs, paging, 1);
 				break;
 			}
-			if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS)) {
-				err = split_hugepage(pg_structs->hv_paging,
-						     paging, pte, virt,
+			if (paging->entry_valid(pte[n], PAGE_PRESENT_FLAGS)) {
+				err = split_hugepage(pg_structs, paging,
+						     pte[n], virt,
 						     paging_flags);
 				if (err)
 					return err;
-				pt = paging_phys2hvirt(
-						paging->get_next_pt(pte));
+				pt[n + 1] = paging_phys2hvirt(
+						paging->get_next_pt(pte[n]));
 			} else {
-				pt = page_alloc(&mem_pool, 1);
-				if (!pt)
+				pt[n + 1] = page_alloc(&mem_pool, 1);
+				if (!pt[n + 1])
 					return -ENOMEM;
-				paging->set_next_pt(pte,
-						    paging_hvirt2phys(pt));
-				flush_pt_entry(pte, paging_flags);
+				paging->set_next_pt(pte[n],
+						    paging_hvirt2phys(pt[n + 1]));
+				flush_pt_entry(pte[n], paging_flags);
 			}
 			paging++;
+			n++;
 		}
 		if (pg_structs->hv_paging)
 			arch_paging_flush_page_tlbs(virt);
 
-		phys += paging->page_size;
-		virt += paging->page_size;
-		size -= paging->page_size;
+		page_size = paging->page_size;
+
+		/*
+		 * After filling the last entry of a table, or at the end of
+		 * the region, check if the table can be folded into its
+		 * parent. Continue upwards as long as this succeeds.
+		 */
+		if (n > 0 && (size == page_size ||
+			      ((virt + page_size) &
+			       (paging[-1].page_size - 1)) == 0))
+			while (n > 0 &&
+			       coalesce_page_table(pg_structs, paging - 1,
+						   pte[n - 1], pt[n], virt,
+						   paging_flags)) {
+				paging--;
+				n--;
+			}
+
+		phys += page_size;
+		virt += page_size;
+		size -= page_size;
 	}
 	return 0;
 }
@@ -416,9 +809,8 @@ int paging_destroy(const struct paging_structures *pg_structs,
 				    page_start + (page_size - 1))
 					break;
 
-				err = split_hugepage(pg_structs->hv_paging,
-						     paging, pte, virt,
-						     paging_flags);
+				err = split_hugepage(pg_structs, paging, pte,
+						     virt, paging_flags);
 				if (err)
 					return err;
 			}
@@ -428,6 +820,10 @@ int paging_destroy(const struct paging_structures *pg_structs,
 		/* advance by page size of current level paging */
 		page_size = paging->page_size ? paging->page_size : PAGE_SIZE;
 
+		/* a valid entry the walk stopped at is a terminal one */
+		if (paging->entry_valid(pte, PAGE_PRESENT_FLAGS))
+			count_mappings(pg_structs, paging, -1);
+
 		/* walk up again, clearing entries, releasing empty tables */
 		while (1) {
 			paging->clear_entry(pte);
@@ -633,10 +1029,13 @@ int paging_map_all_per_cpu(unsigned int cpu, bool enable)
  */
 int paging_init(void)
 {
-	unsigned long n, per_cpu_pages, config_pages, bitmap_pages;
+	unsigned long n, per_cpu_pages, config_pages, metadata_pages;
 	unsigned long vaddr, flags;
+	void *metadata;
 	int err;
 
+	arch_string_init();
+
 	per_cpu_pages = hypervisor_header.max_cpus *
 		sizeof(struct per_cpu) / PAGE_SIZE;
 
@@ -645,23 +1044,28 @@ int paging_init(void)
 	page_offset = JAILHOUSE_BASE -
 		system_config->hypervisor_memory.phys_start;
 
+	mem_pool.base_address = __page_pool;
 	mem_pool.pages = (system_config->hypervisor_memory.size -
 		(__page_pool - (u8 *)&hypervisor_header)) / PAGE_SIZE;
-	bitmap_pages = (mem_pool.pages + BITS_PER_PAGE - 1) / BITS_PER_PAGE;
+	page_pool_set_max_order(&mem_pool);
+	metadata_pages = PAGES(pool_metadata_size(&mem_pool));
 
-	if (mem_pool.pages <= per_cpu_pages + config_pages + bitmap_pages)
+	if (mem_pool.pages <= per_cpu_pages + config_pages + metadata_pages)
 		return -ENOMEM;
 
-	mem_pool.base_address = __page_pool;
-	mem_pool.used_bitmap =
-		(unsigned long *)(__page_pool + per_cpu_pages * PAGE_SIZE +
-				  config_pages * PAGE_SIZE);
-	mem_pool.used_pages = per_cpu_pages + config_pages + bitmap_pages;
-	for (n = 0; n < mem_pool.used_pages; n++)
-		set_bit(n, mem_pool.used_bitmap);
+	page_pool_init(&mem_pool,
+		       (unsigned long *)(__page_pool +
+					 per_cpu_pages * PAGE_SIZE +
+					 config_pages * PAGE_SIZE),
+		       per_cpu_pages + config_pages + metadata_pages);
 	mem_pool.flags = PAGE_SCRUB_ON_FREE;
 
-	remap_pool.used_bitmap = page_alloc(&mem_pool, NUM_REMAP_BITMAP_PAGES);
+	page_pool_set_max_order(&remap_pool);
+	metadata = page_alloc(&mem_pool,
+			      PAGES(pool_metadata_size(&remap_pool)));
+	if (!metadata)
+		return -ENOMEM;
+	page_pool_init(&remap_pool, metadata, 0);
 
 	hv_paging_structs.hv_paging = true;
 	hv_paging_structs.root_table =
@@ -717,12 +1121,25 @@ int paging_init(void)
 }
 
 /**
- * Dump usage statistic of the page pools.
+ * Dump usage statistic of the page pools and the mappings of all cells.
  * @param when String that characterizes the associated event.
  */
 void paging_dump_stats(const char *when)
 {
-	printk("Page pool usage %s: mem %ld/%ld, remap %ld/%ld\n", when,
+	struct cell *cell;
+
+	printk("Page pool usage %s: mem %ld/%ld (%ld free blocks, largest %ld), "
+	       "remap %ld/%ld (%ld free blocks, largest %ld)\n", when,
 	       mem_pool.used_pages, mem_pool.pages,
-	       remap_pool.used_pages, remap_pool.pages);
+	       page_pool_free_blocks(&mem_pool),
+	       page_pool_largest_free(&mem_pool),
+	       remap_pool.used_pages, remap_pool.pages,
+	       page_pool_free_blocks(&remap_pool),
+	       page_pool_largest_free(&remap_pool));
+
+	for_each_cell(cell)
+		printk("Mappings of cell \"%s\": 4K %lu, 2M %lu, 1G %lu\n",
+		       cell->config->name, cell->mappings[PAGING_MAPPING_4K],
+		       cell->mappings[PAGING_MAPPING_2M],
+		       cell->mappings[PAGING_MAPPING_1G]);
 }
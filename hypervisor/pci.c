@@ -70,6 +70,8 @@ static const struct pci_cfg_control bridge_write[PCI_CONFIG_HEADER_SIZE] = {
 static void *pci_space;
 static u64 mmcfg_start, mmcfg_size;
 static u8 end_bus;
+/* Incremented when SR-IOV VFs may have appeared or disappeared. */
+static volatile unsigned int cfg_shadow_generation;
 
 static unsigned int pci_mmio_count_regions(struct cell *cell)
 {
@@ -143,6 +145,60 @@ void pci_write_config(u16 bdf, u16 address, u32 value, unsigned int size)
 		mmio_write32(mmcfg_addr, value);
 }
 
+static unsigned int pci_device_hash_slot(const struct cell *cell, u16 bdf)
+{
+	/* multiplicative hashing, spreads bus and devfn over all bits */
+	return (u32)(bdf * 0x9e3779b9U) >> (32 - cell->pci_device_hash_bits);
+}
+
+static unsigned int pci_device_hash_pages(const struct cell *cell)
+{
+	return PAGES(sizeof(u32) << cell->pci_device_hash_bits);
+}
+
+/**
+ * Build the BDF lookup hash table of a cell.
+ * @param cell	Cell to be initialized.
+ *
+ * @return 0 on success, negative error code otherwise.
+ *
+ * @private
+ */
+static int pci_device_hash_init(struct cell *cell)
+{
+	const struct jailhouse_pci_device *dev_infos =
+		jailhouse_cell_pci_devices(cell->config);
+	unsigned int mask, slot;
+	u32 n;
+
+	/* keep the load factor at or below 50% */
+	cell->pci_device_hash_bits = 1;
+	while ((1UL << cell->pci_device_hash_bits) <
+	       2UL * cell->config->num_pci_devices)
+		cell->pci_device_hash_bits++;
+	mask = (1U << cell->pci_device_hash_bits) - 1;
+
+	cell->pci_device_hash = page_alloc(&mem_pool,
+					   pci_device_hash_pages(cell));
+	if (!cell->pci_device_hash)
+		return -ENOMEM;
+	memset(cell->pci_device_hash, 0,
+	       sizeof(u32) << cell->pci_device_hash_bits);
+
+	/*
+	 * Insert in configuration order so that, like the former linear
+	 * search, the lookup finds the first entry of duplicate BDFs.
+	 */
+	for (n = 0; n < cell->config->num_pci_devices; n++) {
+		slot = pci_device_hash_slot(cell, dev_infos[n].bdf);
+		while (cell->pci_device_hash[slot] != 0)
+			slot = (slot + 1) & mask;
+		cell->pci_device_hash[slot] = n + 1;
+	}
+
+	return 0;
+}
+
 /**
  * Look up device owned by a cell.
  * @param[in] cell	Owning cell.
@@ -154,14 +210,19 @@ struct pci_device *pci_get_assigned_device(const struct cell *cell, u16 bdf)
 {
 	const struct jailhouse_pci_device *dev_info =
 		jailhouse_cell_pci_devices(cell->config);
+	unsigned int mask, slot;
 	u32 n;
 
-	/* We iterate over the static device information to increase cache
-	 * locality. */
-	for (n = 0; n < cell->config->num_pci_devices; n++)
-		if (dev_info[n].bdf == bdf)
-			return cell->pci_devices[n].cell ?
-				&cell->pci_devices[n] : NULL;
+	if (!cell->pci_device_hash)
+		return NULL;
+
+	mask = (1U << cell->pci_device_hash_bits) - 1;
+	for (slot = pci_device_hash_slot(cell, bdf);
+	     (n = cell->pci_device_hash[slot]) != 0;
+	     slot = (slot + 1) & mask)
+		if (dev_info[n - 1].bdf == bdf)
+			return cell->pci_devices[n - 1].cell ?
+				&cell->pci_devices[n - 1] : NULL;
 
 	return NULL;
 }
@@ -190,6 +251,122 @@ pci_find_capability(struct pci_device *device, u16 address)
 	return NULL;
 }
 
+static void pci_shadow_cfg_bytes(struct pci_device *device, u16 address,
+				 unsigned int size)
+{
+	u32 value = pci_read_config(device->info->bdf, address, size);
+	unsigned int n;
+
+	for (n = 0; n < size; n++)
+		device->cfg_shadow[address + n] = value >> (n * 8);
+	device->cfg_shadow_valid[address / 32] |=
+		((1U << size) - 1) << (address % 32);
+}
+
+/**
+ * Fill the config space shadow of a physical device.
+ * @param device	The device to be initialized.
+ *
+ * Only registers that cannot change while the device is present are
+ * shadowed: IDs, class, header type, interrupt pin, and the headers of the
+ * configured standard capabilities.
+ *
+ * Other CPUs of the cell may read the shadow meanwhile. They detect the
+ * refill via cfg_shadow_seq and go to the hardware instead. If another CPU
+ * is already refilling the shadow, nothing is done.
+ *
+ * @private
+ */
+static void pci_init_cfg_shadow(struct pci_device *device)
+{
+	const struct jailhouse_pci_capability *cap;
+	unsigned int seq = device->cfg_shadow_seq;
+	unsigned int n;
+
+	if (seq & 1 ||
+	    atomic_cmpxchg(&device->cfg_shadow_seq, seq, seq + 1) != seq)
+		return;
+
+	memset(device->cfg_shadow_valid, 0, sizeof(device->cfg_shadow_valid));
+	device->cfg_shadow_filled = false;
+	device->cfg_shadow_generation = cfg_shadow_generation;
+	/* Only read the hardware state after sampling the generation. */
+	memory_barrier();
+
+	/*
+	 * The function may not be present yet, e.g. a disabled SR-IOV VF.
+	 * Leave the shadow empty then. It will be filled when the cell probes
+	 * the vendor ID again. The vendor ID itself cannot tell as VFs always
+	 * report 0xffff, but the class code of a present function is valid.
+	 */
+	if (pci_read_config(device->info->bdf, PCI_CFG_REVISION, 4) ==
+	    0xffffffff)
+		goto out;
+
+	pci_shadow_cfg_bytes(device, PCI_CFG_VENDOR_ID, 4);
+	pci_shadow_cfg_bytes(device, PCI_CFG_REVISION, 4);
+	pci_shadow_cfg_bytes(device, PCI_CFG_HEADER_TYPE, 1);
+	pci_shadow_cfg_bytes(device, PCI_CFG_CAPS, 1);
+	pci_shadow_cfg_bytes(device, PCI_CFG_INT_PIN, 1);
+	if (device->info->type != JAILHOUSE_PCI_TYPE_BRIDGE) {
+		pci_shadow_cfg_bytes(device, PCI_CFG_SUBSYS_VENDOR_ID, 4);
+		/* Min_Gnt, Max_Lat */
+		pci_shadow_cfg_bytes(device, PCI_CFG_MIN_GNT, 2);
+	}
+
+	/* capability ID and next pointer */
+	for_each_pci_cap(cap, device, n)
+		if (!(cap->id & JAILHOUSE_PCI_EXT_CAP) &&
+		    cap->start % 4 == 0 && cap->start < PCI_STD_CONFIG_SIZE)
+			pci_shadow_cfg_bytes(device, cap->start, 2);
+
+	device->cfg_shadow_filled = true;
+
+out:
+	memory_store_barrier();
+	device->cfg_shadow_seq = seq + 2;
+}
+
+static bool pci_cfg_shadow_read(struct pci_device *device, u16 address,
+				unsigned int size, u32 *value)
+{
+	u32 mask = ((1U << size) - 1) << (address % 32);
+	unsigned int seq = device->cfg_shadow_seq;
+	unsigned int n;
+	u32 result = 0;
+
+	if (seq & 1)
+		return false;
+	memory_load_barrier();
+
+	if (!device->cfg_shadow_filled ||
+	    device->cfg_shadow_generation != cfg_shadow_generation ||
+	    address >= PCI_STD_CONFIG_SIZE || address % 4 + size > 4 ||
+	    (device->cfg_shadow_valid[address / 32] & mask) != mask)
+		return false;
+
+	for (n = 0; n < size; n++)
+		result |= (u32)device->cfg_shadow[address + n] << (n * 8);
+
+	/* A refill raced with us, the hardware has the answer then. */
+	memory_load_barrier();
+	if (device->cfg_shadow_seq != seq)
+		return false;
+
+	*value = result;
+	return true;
+}
+
+/* Invalidate the config space shadows of all devices. */
+static void pci_cfg_shadow_invalidate(void)
+{
+	unsigned int old;
+
+	do {
+		old = cfg_shadow_generation;
+	} while (atomic_cmpxchg(&cfg_shadow_generation, old, old + 1) != old);
+}
+
 /**
  * Moderate config space read access.
  * @param device	The device to be accessed. If NULL, access will be
@@ -233,12 +410,18 @@ enum pci_access pci_cfg_read_moderate(struct pci_device *device, u16 address,
 	if (device->info->type == JAILHOUSE_PCI_TYPE_IVSHMEM)
 		return ivshmem_pci_cfg_read(device, address, value);
 
+	/* Serve read-only registers without touching the hardware */
+	if (pci_cfg_shadow_read(device, address, size, value)) {
+		this_cpu_public()->stats[JAILHOUSE_CPU_STAT_PCI_CFG_SHADOW]++;
+		return PCI_ACCESS_DONE;
+	}
+
 	if (address < PCI_CONFIG_HEADER_SIZE)
-		return PCI_ACCESS_PERFORM;
+		goto perform;
 
 	cap = pci_find_capability(device, address);
 	if (!cap)
-		return PCI_ACCESS_PERFORM;
+		goto perform;
 
 	cap_offs = address - cap->start;
 	if (cap->id == PCI_CAP_ID_MSI && cap_offs >= 4 &&
@@ -248,6 +431,13 @@ enum pci_access pci_cfg_read_moderate(struct pci_device *device, u16 address,
 		return PCI_ACCESS_DONE;
 	}
 
+perform:
+	if (address == PCI_CFG_VENDOR_ID &&
+	    (!device->cfg_shadow_filled ||
+	     device->cfg_shadow_generation != cfg_shadow_generation))
+		pci_init_cfg_shadow(device);
+
+	this_cpu_public()->stats[JAILHOUSE_CPU_STAT_PCI_CFG_HARDWARE]++;
 	return PCI_ACCESS_PERFORM;
 }
 
@@ -352,6 +542,19 @@ enum pci_access pci_cfg_write_moderate(struct pci_device *device, u16 address,
 
 		if (pci_update_msix(device, cap) < 0)
 			return PCI_ACCESS_REJECT;
+	} else if (cap->id == (PCI_EXT_CAP_ID_SRIOV | JAILHOUSE_PCI_EXT_CAP) &&
+		   cap_offs >= PCI_SRIOV_CTRL && cap_offs < PCI_SRIOV_CTRL + 2) {
+		/*
+		 * VF Enable may toggle, refill all shadows on next probe. Only
+		 * invalidate them once the write took effect. A refill on
+		 * another CPU could otherwise capture the previous state under
+		 * the new generation.
+		 */
+		pci_write_config(device->info->bdf, address,
+				 value >> bias_shift, size);
+		pci_read_config(device->info->bdf, address, size);
+		pci_cfg_shadow_invalidate();
+		return PCI_ACCESS_DONE;
 	}
 
 	return PCI_ACCESS_PERFORM;
@@ -614,6 +817,7 @@ static int pci_add_physical_device(struct cell *cell, struct pci_device *device)
 	}
 
 	device->cell = cell;
+	pci_init_cfg_shadow(device);
 	if (cell != &root_cell)
 		pci_reset_device(device);
 
@@ -685,6 +889,12 @@ static int pci_cell_init(struct cell *cell)
 	if (!cell->pci_devices)
 		return -ENOMEM;
 
+	err = pci_device_hash_init(cell);
+	if (err) {
+		page_free(&mem_pool, cell->pci_devices, devlist_pages);
+		return err;
+	}
+
 	/*
 	 * We order device states in the same way as the static information
 	 * so that we can use the index of the latter to find the former. For
@@ -783,6 +993,8 @@ static void pci_cell_exit(struct cell *cell)
 		}
 
 	page_free(&mem_pool, cell->pci_devices, devlist_pages);
+	page_free(&mem_pool, cell->pci_device_hash,
+		  pci_device_hash_pages(cell));
 }
 
 /**
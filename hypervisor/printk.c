@@ -12,6 +12,7 @@
 
 #include <stdarg.h>
 #include <jailhouse/control.h>
+#include <jailhouse/percpu.h>
 #include <jailhouse/printk.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/string.h>
@@ -21,8 +22,19 @@ bool virtual_console = false;
 volatile struct jailhouse_virt_console console
 	__attribute__((section(".console")));
 
+#define DROPPED_MSG	" bytes of console output dropped\n"
+
 static spinlock_t printk_lock;
 
+/* Once set, printk() only queues messages in the ring of the calling CPU. */
+static bool printk_deferred;
+/* Set by producers after queuing a message, cleared when draining starts. */
+static volatile bool printk_pending;
+/* Bit 0 is set while a CPU drains the rings. */
+static unsigned long printk_draining;
+/* Bit 0 is set once a root cell CPU was kicked to drain the rings. */
+static unsigned long printk_kicked;
+
 static void console_write(const char *msg)
 {
 	arch_dbg_write(msg);
@@ -147,7 +159,57 @@ static char *align(char *p1, char *p0, unsigned int width, char fill)
 	return p0 + width;
 }
 
-static void __vprintk(const char *fmt, va_list ap)
+static void ring_write(const char *msg)
+{
+	struct printk_ring *ring = &this_cpu_public()->printk_ring;
+
+	while (*msg) {
+		if (ring->pos - ring->tail >= PRINTK_RING_SIZE) {
+			while (*msg++)
+				ring->dropped++;
+			break;
+		}
+		ring->buf[ring->pos++ % PRINTK_RING_SIZE] = *msg++;
+	}
+}
+
+static void drain_ring(struct printk_ring *ring)
+{
+	unsigned int head = ring->head;
+	unsigned int n, dropped;
+	char chunk[64];
+	char *p;
+
+	while (ring->tail != head) {
+		for (n = 0; n < sizeof(chunk) - 1 && ring->tail + n != head;
+		     n++)
+			chunk[n] = ring->buf[(ring->tail + n) % PRINTK_RING_SIZE];
+		chunk[n] = 0;
+		/* the data must be copied before the producer may reuse it */
+		memory_barrier();
+		ring->tail += n;
+		console_write(chunk);
+	}
+
+	dropped = ring->dropped;
+	if (dropped != ring->dropped_reported) {
+		p = uint2str(dropped - ring->dropped_reported, chunk);
+		memcpy(p, DROPPED_MSG, sizeof(DROPPED_MSG));
+		console_write(chunk);
+		ring->dropped_reported = dropped;
+	}
+}
+
+static void drain_rings(void)
+{
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+		drain_ring(&public_per_cpu(cpu)->printk_ring);
+}
+
+static void __vprintk(void (*write)(const char *msg), const char *fmt,
+		      va_list ap)
 {
 	char buf[128];
 	char *p, *p0;
@@ -164,7 +226,7 @@ static void __vprintk(const char *fmt, va_list ap)
 			break;
 		} else if (c == '%') {
 			*p = 0;
-			console_write(buf);
+			write(buf);
 			p = buf;
 
 			c = *fmt++;
@@ -210,7 +272,7 @@ static void __vprintk(const char *fmt, va_list ap)
 				p = hex2str(v, p, (unsigned long)-1);
 				break;
 			case 's':
-				console_write(va_arg(ap, const char *));
+				write(va_arg(ap, const char *));
 				break;
 			case 'u':
 			case 'x':
@@ -236,28 +298,113 @@ static void __vprintk(const char *fmt, va_list ap)
 		}
 		if (p >= &buf[sizeof(buf) - 1]) {
 			*p = 0;
-			console_write(buf);
+			write(buf);
 			p = buf;
 		}
 	}
 
 	*p = 0;
-	console_write(buf);
+	write(buf);
 }
 
 void printk(const char *fmt, ...)
 {
+	struct printk_ring *ring;
 	va_list ap;
 
 	va_start(ap, fmt);
 
-	spin_lock(&printk_lock);
-	__vprintk(fmt, ap);
-	spin_unlock(&printk_lock);
+	if (printk_deferred) {
+		ring = &this_cpu_public()->printk_ring;
+		__vprintk(ring_write, fmt, ap);
+		/* publish the message only after it is complete */
+		memory_barrier();
+		ring->head = ring->pos;
+		printk_pending = true;
+
+		/*
+		 * CPUs of non-root cells must not stall on the console. They
+		 * kick a root cell CPU which drains the rings on its way back
+		 * to the guest.
+		 */
+		if (this_cell() == &root_cell)
+			printk_flush();
+		else if (!atomic_test_and_set_bit(0, &printk_kicked))
+			arch_send_event(public_per_cpu(
+				first_cpu(root_cell.cpu_set)));
+	} else {
+		spin_lock(&printk_lock);
+		__vprintk(console_write, fmt, ap);
+		spin_unlock(&printk_lock);
+	}
 
 	va_end(ap);
 }
 
+/**
+ * Switch printk() to queuing messages in per-CPU rings.
+ *
+ * Must only be called when all CPUs can access their per-CPU data.
+ */
+void printk_defer_output(void)
+{
+	printk_deferred = true;
+}
+
+/**
+ * Write out all queued console output, unless another CPU is already doing
+ * so.
+ */
+void printk_flush(void)
+{
+	do {
+		if (atomic_test_and_set_bit(0, &printk_draining))
+			return;
+
+		printk_pending = false;
+		printk_kicked = 0;
+		memory_barrier();
+
+		spin_lock(&printk_lock);
+		drain_rings();
+		spin_unlock(&printk_lock);
+
+		memory_barrier();
+		printk_draining = 0;
+		memory_barrier();
+	} while (printk_pending);
+}
+
+/**
+ * Write out queued console output on the way back to the guest.
+ *
+ * Only CPUs of the root cell do this, so that output of non-root cells is
+ * written in the background. A non-root cell CPU that queues output sends an
+ * event to the first root cell CPU. Its output therefore starts to be written
+ * after one VM exit of that CPU, unless the root cell is suspended for a cell
+ * management operation.
+ */
+void printk_flush_deferred(void)
+{
+	if (printk_pending && this_cell() == &root_cell)
+		printk_flush();
+}
+
+/**
+ * Get the number of console bytes dropped because a per-CPU ring was full.
+ *
+ * @return Number of dropped bytes.
+ */
+unsigned int printk_dropped_bytes(void)
+{
+	unsigned int cpu, dropped = 0;
+
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+		dropped += public_per_cpu(cpu)->printk_ring.dropped;
+
+	return dropped;
+}
+
 void panic_printk(const char *fmt, ...)
 {
 	unsigned long cpu_id = phys_processor_id();
@@ -268,9 +415,13 @@ void panic_printk(const char *fmt, ...)
 		return;
 	panic_cpu = cpu_id;
 
+	/* Best effort to get queued output out before the panic message. */
+	if (printk_deferred)
+		drain_rings();
+
 	va_start(ap, fmt);
 
-	__vprintk(fmt, ap);
+	__vprintk(console_write, fmt, ap);
 
 	va_end(ap);
 }
@@ -93,6 +93,10 @@ static void init_early(unsigned int cpu_id)
 		hv_page.virt_start += PAGE_SIZE;
 	}
 
+	error = cpu_stats_init();
+	if (error)
+		return;
+
 	paging_dump_stats("after early setup");
 	printk("Initializing processors:\n");
 }
@@ -242,6 +246,12 @@ int entry(unsigned int cpu_id, struct per_cpu *cpu_data)
 	if (!error && master) {
 		init_late();
 		if (!error) {
+			/*
+			 * All CPUs can access their per-CPU data now. From here
+			 * on, console output is queued and written out by the
+			 * root cell CPUs.
+			 */
+			printk_defer_output();
 			/*
 			 * Make sure everything was committed before we signal
 			 * the other CPUs that they can continue.
@@ -0,0 +1,180 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/control.h>
+#include <jailhouse/entry.h>
+#include <jailhouse/paging.h>
+#include <jailhouse/printk.h>
+#include <jailhouse/processor.h>
+#include <jailhouse/string.h>
+#include <jailhouse/tracing.h>
+
+#define TRACE_BUFFER_PAGES	PAGES(JAILHOUSE_TRACE_BUFFER_SIZE)
+
+/*
+ * Allocated on first use and kept until the hypervisor is shut down so that
+ * CPUs still recording an exit never write to released memory.
+ */
+static void *trace_area;
+/* True once the root cell can read the trace area. */
+static bool trace_area_shared;
+
+/** True if exit latencies are accounted in the CPU statistics. */
+bool trace_latency = true;
+
+static struct jailhouse_trace_buffer *trace_buffer_of(unsigned int cpu)
+{
+	return trace_area + cpu * JAILHOUSE_TRACE_BUFFER_SIZE;
+}
+
+static int trace_area_init(void)
+{
+	struct jailhouse_trace_buffer *buffer;
+	unsigned int cpu;
+
+	trace_area = page_alloc(&mem_pool,
+				hypervisor_header.max_cpus * TRACE_BUFFER_PAGES);
+	if (!trace_area)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++) {
+		buffer = trace_buffer_of(cpu);
+		buffer->cpu_id = cpu;
+		buffer->num_entries =
+			(JAILHOUSE_TRACE_BUFFER_SIZE - sizeof(*buffer)) /
+			sizeof(struct jailhouse_trace_entry);
+	}
+	return 0;
+}
+
+/**
+ * Handle the trace control hypercall.
+ * @param cpu_data	Data structure of the calling CPU.
+ * @param command	JAILHOUSE_TRACE_ENABLE, JAILHOUSE_TRACE_DISABLE,
+ * 			JAILHOUSE_TRACE_LATENCY_ENABLE or
+ * 			JAILHOUSE_TRACE_LATENCY_DISABLE.
+ *
+ * @return Offset of the trace buffers in the hypervisor memory region when
+ * enabling tracing, 0 for the other commands, or negative error code.
+ */
+long trace_control(struct per_cpu *cpu_data, unsigned long command)
+{
+	unsigned int cpu;
+	int err;
+
+	if (cpu_data->public.cell != &root_cell)
+		return -EPERM;
+
+	switch (command) {
+	case JAILHOUSE_TRACE_DISABLE:
+		for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+			public_per_cpu(cpu)->trace_buffer = NULL;
+		return 0;
+	case JAILHOUSE_TRACE_ENABLE:
+		if (!trace_area) {
+			err = trace_area_init();
+			if (err)
+				return trace_error(err);
+		}
+		if (!trace_area_shared) {
+			/*
+			 * The root cell only sees empty pages in place of the
+			 * hypervisor memory. Make the buffers visible to it.
+			 */
+			err = root_cell_share_pages_live(trace_area,
+				hypervisor_header.max_cpus *
+				JAILHOUSE_TRACE_BUFFER_SIZE);
+			if (err)
+				return trace_error(err);
+			trace_area_shared = true;
+		}
+		for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++)
+			public_per_cpu(cpu)->trace_buffer =
+				trace_buffer_of(cpu);
+		return trace_area - (void *)&hypervisor_header;
+	case JAILHOUSE_TRACE_LATENCY_DISABLE:
+	case JAILHOUSE_TRACE_LATENCY_ENABLE:
+		trace_latency = command == JAILHOUSE_TRACE_LATENCY_ENABLE;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+void __trace_exit_begin(unsigned int reason, unsigned long pc)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	struct jailhouse_trace_buffer *buffer = cpu_data->public.trace_buffer;
+	struct jailhouse_trace_entry *entry;
+
+	cpu_data->exit_entry_time = read_timestamp();
+	cpu_data->exit_timed = true;
+
+	if (!buffer)
+		return;
+
+	entry = &buffer->entries[buffer->head % buffer->num_entries];
+
+	/* Invalidate the slot for readers before reusing it. */
+	entry->seq = 0;
+	memory_barrier();
+
+	entry->entry_time = cpu_data->exit_entry_time;
+	entry->pc = pc;
+	entry->mmio_address = 0;
+	entry->reason = reason;
+	entry->cell_id = cpu_data->public.cell->config->id;
+	entry->flags = 0;
+
+	cpu_data->trace_exit_buffer = buffer;
+}
+
+static void __trace_exit_end(struct per_cpu *cpu_data, u64 exit_time)
+{
+	struct jailhouse_trace_buffer *buffer = cpu_data->trace_exit_buffer;
+	struct jailhouse_trace_entry *entry =
+		&buffer->entries[buffer->head % buffer->num_entries];
+
+	entry->exit_time = exit_time;
+
+	memory_barrier();
+	entry->seq = buffer->head + 1;
+	memory_barrier();
+	buffer->head++;
+
+	cpu_data->trace_exit_buffer = NULL;
+}
+
+/**
+ * Complete the accounting of the current exit, publish the statistic counters
+ * and write out queued console output before returning to guest mode.
+ */
+void trace_exit_end(void)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	u64 exit_time, latency;
+
+	if (cpu_data->exit_timed) {
+		exit_time = read_timestamp();
+		latency = exit_time - cpu_data->exit_entry_time;
+		cpu_data->exit_timed = false;
+
+		if (cpu_data->trace_exit_buffer)
+			__trace_exit_end(cpu_data, exit_time);
+
+		cpu_stats_publish(cpu_data->public.cpu_id,
+				  trace_latency ? &latency : NULL);
+	} else {
+		cpu_stats_publish(cpu_data->public.cpu_id, NULL);
+	}
+	printk_flush_deferred();
+}
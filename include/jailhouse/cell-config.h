@@ -50,7 +50,7 @@
  * Incremented on any layout or semantic change of system or cell config.
  * Also update formats and HEADER_REVISION in pyjailhouse/config_parser.py.
  */
-#define JAILHOUSE_CONFIG_REVISION	13
+#define JAILHOUSE_CONFIG_REVISION	15
 
 #define JAILHOUSE_CELL_NAME_MAXLEN	31
 
@@ -97,6 +97,7 @@ struct jailhouse_cell_desc {
 	__u32 num_pci_devices;
 	__u32 num_pci_caps;
 	__u32 num_stream_ids;
+	__u32 num_msr_regions;
 
 	__u32 vpci_irq_base;
 
@@ -305,6 +306,27 @@ struct jailhouse_pio {
 		.length = __length,	\
 	}
 
+#define JAILHOUSE_MSR_READ		0x0001
+#define JAILHOUSE_MSR_WRITE		0x0002
+
+/*
+ * Range of MSRs the cell may access directly, without the hypervisor
+ * intercepting them. Only performance monitoring MSRs and IA32_TSC_AUX can be
+ * listed here, see Documentation/configuration-format.md.
+ */
+struct jailhouse_msr {
+	__u32 base;
+	__u32 length;
+	__u32 flags;
+} __attribute__((packed));
+
+#define MSR_RANGE(__base, __length, __flags)	\
+	{					\
+		.base = __base,			\
+		.length = __length,		\
+		.flags = __flags,		\
+	}
+
 #define JAILHOUSE_SYSTEM_SIGNATURE	"JHSYST"
 
 /*
@@ -351,6 +373,7 @@ struct jailhouse_system {
 				u64 gich_base;
 				u64 gicv_base;
 				u64 gicr_base;
+				u64 gits_base;
 			} __attribute__((packed)) arm;
 		} __attribute__((packed));
 	} __attribute__((packed)) platform_info;
@@ -368,7 +391,8 @@ jailhouse_cell_config_size(struct jailhouse_cell_desc *cell)
 		cell->num_pio_regions * sizeof(struct jailhouse_pio) +
 		cell->num_pci_devices * sizeof(struct jailhouse_pci_device) +
 		cell->num_pci_caps * sizeof(struct jailhouse_pci_capability) +
-		cell->num_stream_ids * sizeof(__u32);
+		cell->num_stream_ids * sizeof(__u32) +
+		cell->num_msr_regions * sizeof(struct jailhouse_msr);
 }
 
 static inline __u32
@@ -440,4 +464,12 @@ jailhouse_cell_stream_ids(const struct jailhouse_cell_desc *cell)
 		cell->num_pci_caps * sizeof(struct jailhouse_pci_capability));
 }
 
+static inline const struct jailhouse_msr *
+jailhouse_cell_msr_regions(const struct jailhouse_cell_desc *cell)
+{
+	return (const struct jailhouse_msr *)
+		((void *)jailhouse_cell_stream_ids(cell) +
+		cell->num_stream_ids * sizeof(__u32));
+}
+
 #endif /* !_JAILHOUSE_CELL_CONFIG_H */
@@ -50,6 +50,11 @@
 #define JAILHOUSE_HC_CELL_GET_STATE		6
 #define JAILHOUSE_HC_CPU_GET_INFO		7
 #define JAILHOUSE_HC_DEBUG_CONSOLE_PUTC		8
+#define JAILHOUSE_HC_TRACE_CONTROL		9
+#define JAILHOUSE_HC_DEBUG_CONSOLE_WRITE	10
+
+/* Maximum number of bytes per debug console write hypercall */
+#define JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX	128
 
 /* Hypervisor information type */
 #define JAILHOUSE_INFO_MEM_POOL_SIZE		0
@@ -57,10 +62,18 @@
 #define JAILHOUSE_INFO_REMAP_POOL_SIZE		2
 #define JAILHOUSE_INFO_REMAP_POOL_USED		3
 #define JAILHOUSE_INFO_NUM_CELLS		4
+#define JAILHOUSE_INFO_MEM_POOL_FREE_BLOCKS	5
+#define JAILHOUSE_INFO_MEM_POOL_LARGEST_FREE	6
+#define JAILHOUSE_INFO_REMAP_POOL_FREE_BLOCKS	7
+#define JAILHOUSE_INFO_REMAP_POOL_LARGEST_FREE	8
+#define JAILHOUSE_INFO_CPU_STATS_AREA		9
+#define JAILHOUSE_INFO_CONSOLE_DROPPED		10
 
 /* Hypervisor information type */
 #define JAILHOUSE_CPU_INFO_STATE		0
 #define JAILHOUSE_CPU_INFO_STAT_BASE		1000
+#define JAILHOUSE_CPU_INFO_LATENCY_BASE		2000
+#define JAILHOUSE_CPU_INFO_LATENCY_MAX_BASE	3000
 
 /* CPU state */
 #define JAILHOUSE_CPU_RUNNING			0
@@ -71,7 +84,40 @@
 #define JAILHOUSE_CPU_STAT_VMEXITS_MMIO		1
 #define JAILHOUSE_CPU_STAT_VMEXITS_MANAGEMENT	2
 #define JAILHOUSE_CPU_STAT_VMEXITS_HYPERCALL	3
-#define JAILHOUSE_GENERIC_CPU_STATS		4
+#define JAILHOUSE_CPU_STAT_PCI_CFG_SHADOW	4
+#define JAILHOUSE_CPU_STAT_PCI_CFG_HARDWARE	5
+#define JAILHOUSE_GENERIC_CPU_STATS		6
+
+/* Exit latency histograms, log2-bucketed */
+#define JAILHOUSE_CPU_LATENCY_BUCKETS		32
+
+/* Upper limit of JAILHOUSE_NUM_CPU_STATS on all architectures */
+#define JAILHOUSE_MAX_CPU_STATS			16
+
+/** Exit latency histogram of a statistic counter. */
+struct jailhouse_cpu_latency {
+	/** Bucket n > 0 counts exits that took [2^(n-1), 2^n) ticks. */
+	__u32 buckets[JAILHOUSE_CPU_LATENCY_BUCKETS];
+	/** Maximum latency observed. */
+	__u32 max;
+} __attribute__((packed));
+
+/**
+ * Statistic counters of a CPU as published read-only to the root cell.
+ *
+ * The hypervisor increments @c seq before and after updating the counters.
+ * Readers have to retry while it is odd or if it changed during the read.
+ */
+struct jailhouse_cpu_stats {
+	/** Update sequence counter. */
+	volatile __u32 seq;
+	/** Number of valid entries in @c stats and @c latency. */
+	__u32 num_stats;
+	/** Counters, indexed by JAILHOUSE_CPU_STAT_*. */
+	__u64 stats[JAILHOUSE_MAX_CPU_STATS];
+	/** Exit latency histograms, indexed by JAILHOUSE_CPU_STAT_*. */
+	struct jailhouse_cpu_latency latency[JAILHOUSE_MAX_CPU_STATS];
+} __attribute__((packed));
 
 #define JAILHOUSE_MSG_NONE			0
 
@@ -0,0 +1,102 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Alternatively, you can use or redistribute this file under the following
+ * BSD license:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _JAILHOUSE_TRACE_H
+#define _JAILHOUSE_TRACE_H
+
+/* Commands of JAILHOUSE_HC_TRACE_CONTROL */
+#define JAILHOUSE_TRACE_DISABLE			0
+#define JAILHOUSE_TRACE_ENABLE			1
+#define JAILHOUSE_TRACE_LATENCY_DISABLE		2
+#define JAILHOUSE_TRACE_LATENCY_ENABLE		3
+
+/* Size of the trace buffer of each CPU, including its header */
+#define JAILHOUSE_TRACE_BUFFER_SIZE	(16 * 4096)
+
+/* Set in jailhouse_trace_entry.flags if mmio_address is valid */
+#define JAILHOUSE_TRACE_FLAG_MMIO	0x0001
+
+/* Reason of IRQ exits on arm64, outside of the exception class range */
+#define JAILHOUSE_TRACE_REASON_ARM64_IRQ	0x40
+
+/**
+ * Record of a single exit from guest mode.
+ *
+ * The reason is architecture-specific: basic exit reason on Intel, exit code
+ * on AMD, exit reason on ARM and exception class of ESR_EL2 on arm64.
+ * Timestamps are taken from the TSC on x86 and from CNTPCT on ARM.
+ */
+struct jailhouse_trace_entry {
+	/** Timestamp when the hypervisor started handling the exit. */
+	__u64 entry_time;
+	/** Timestamp when the hypervisor returned to guest mode. */
+	__u64 exit_time;
+	/** Guest program counter at the time of the exit. */
+	__u64 pc;
+	/** Accessed guest-physical address of MMIO exits. */
+	__u64 mmio_address;
+	/** Exit reason. */
+	__u32 reason;
+	/** ID of the cell the CPU belonged to. */
+	__u32 cell_id;
+	/** Flags, see JAILHOUSE_TRACE_FLAG_*. */
+	__u32 flags;
+	__u32 padding;
+	/** Position of the entry in the stream plus one, written last. Zero
+	 * while the entry is being updated. */
+	__u64 seq;
+} __attribute__((packed));
+
+/**
+ * Per-CPU trace ring, written by the hypervisor only.
+ *
+ * Entry n of the stream is stored at entries[n % num_entries]. Readers have
+ * to discard entries whose seq does not match their position as they were
+ * overwritten or are incomplete.
+ */
+struct jailhouse_trace_buffer {
+	/** Number of entries written so far. */
+	volatile __u64 head;
+	/** Logical ID of the CPU owning the buffer. */
+	__u32 cpu_id;
+	/** Capacity of the ring. */
+	__u32 num_entries;
+	struct jailhouse_trace_entry entries[];
+} __attribute__((packed));
+
+#endif /* !_JAILHOUSE_TRACE_H */
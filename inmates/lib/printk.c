@@ -49,7 +49,22 @@
 static struct uart_chip *chip;
 static bool virtual_console;
 
-static void console_write_char(char c)
+struct console_buffer {
+	char data[JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX];
+	unsigned int len;
+};
+
+static void virtual_console_flush(struct console_buffer *cbuf)
+{
+	if (cbuf->len == 0)
+		return;
+
+	jailhouse_call_arg2(JAILHOUSE_HC_DEBUG_CONSOLE_WRITE,
+			    (unsigned long)cbuf->data, cbuf->len);
+	cbuf->len = 0;
+}
+
+static void console_write_char(struct console_buffer *cbuf, char c)
 {
 	if (chip) {
 		while (chip->is_busy(chip))
@@ -57,11 +72,19 @@ static void console_write_char(char c)
 		chip->write(chip, c);
 	}
 
-	if (virtual_console)
-		jailhouse_call_arg1(JAILHOUSE_HC_DEBUG_CONSOLE_PUTC, c);
+	/*
+	 * Collect output for the virtual console so that it costs only one
+	 * hypercall per line or buffer fill. The hypervisor console adds '\r'
+	 * on its own.
+	 */
+	if (virtual_console && c != '\r') {
+		cbuf->data[cbuf->len++] = c;
+		if (c == '\n' || cbuf->len == sizeof(cbuf->data))
+			virtual_console_flush(cbuf);
+	}
 }
 
-static void console_write(const char *msg)
+static void console_write(struct console_buffer *cbuf, const char *msg)
 {
 	char c;
 
@@ -74,9 +97,9 @@ static void console_write(const char *msg)
 			break;
 
 		if (c == '\n')
-			console_write_char('\r');
+			console_write_char(cbuf, '\r');
 
-		console_write_char(c);
+		console_write_char(cbuf, c);
 	}
 }
 
@@ -221,7 +244,8 @@ static char *align(char *p1, char *p0, unsigned int width, char fill)
 	return p0 + width;
 }
 
-static void __vprintk(const char *fmt, va_list ap)
+static void __vprintk(struct console_buffer *cbuf, const char *fmt,
+		      va_list ap)
 {
 	char buf[128];
 	char *p, *p0;
@@ -238,7 +262,7 @@ static void __vprintk(const char *fmt, va_list ap)
 			break;
 		} else if (c == '%') {
 			*p = 0;
-			console_write(buf);
+			console_write(cbuf, buf);
 			p = buf;
 
 			c = *fmt++;
@@ -284,7 +308,7 @@ static void __vprintk(const char *fmt, va_list ap)
 				p = hex2str(v, p, (unsigned long)-1);
 				break;
 			case 's':
-				console_write(va_arg(ap, const char *));
+				console_write(cbuf, va_arg(ap, const char *));
 				break;
 			case 'u':
 			case 'x':
@@ -313,18 +337,19 @@ static void __vprintk(const char *fmt, va_list ap)
 		}
 		if (p >= &buf[sizeof(buf) - 1]) {
 			*p = 0;
-			console_write(buf);
+			console_write(cbuf, buf);
 			p = buf;
 		}
 	}
 
 	*p = 0;
-	console_write(buf);
+	console_write(cbuf, buf);
 }
 
 void printk(const char *fmt, ...)
 {
 	static bool inited = false;
+	struct console_buffer cbuf;
 	va_list ap;
 
 	if (!inited) {
@@ -332,9 +357,13 @@ void printk(const char *fmt, ...)
 		inited = true;
 	}
 
+	cbuf.len = 0;
+
 	va_start(ap, fmt);
 
-	__vprintk(fmt, ap);
+	__vprintk(&cbuf, fmt, ap);
 
 	va_end(ap);
+
+	virtual_console_flush(&cbuf);
 }
@@ -13,8 +13,42 @@
 #include <inmate.h>
 #include <test.h>
 
+#define BENCH_ROUNDS	100000
+
 extern u8 __reset_entry[]; /* assumed to be at 0 */
 
+static inline u64 rdtsc_ordered(void)
+{
+	u32 lo, hi;
+
+	asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi));
+	return (u64)hi << 32 | lo;
+}
+
+/*
+ * Measure the average round-trip of an intercepted MMIO read, covering VM
+ * exit, instruction decoding, region lookup, handler and VM entry. A plain
+ * read from the comm region serves as baseline.
+ */
+static void mmio_benchmark(void *mmio_reg, volatile u64 *comm_page_reg)
+{
+	u64 start, baseline, cycles;
+	unsigned int n;
+
+	start = rdtsc_ordered();
+	for (n = 0; n < BENCH_ROUNDS; n++)
+		(void)*comm_page_reg;
+	baseline = (rdtsc_ordered() - start) / BENCH_ROUNDS;
+
+	start = rdtsc_ordered();
+	for (n = 0; n < BENCH_ROUNDS; n++)
+		mmio_read64(mmio_reg);
+	cycles = (rdtsc_ordered() - start) / BENCH_ROUNDS;
+
+	printk("MMIO read exit: %llu cycles (%u rounds)\n",
+	       cycles - baseline, BENCH_ROUNDS);
+}
+
 /*
  * mmio-access tests different memory access strategies that are intercepted by
  * the hypervisor. Therefore, it maps a second page right behind the
@@ -304,5 +338,9 @@ void inmate_main(void)
 		: : "a" (pattern));
 	EXPECT_EQUAL(mmio_read32(mmio_reg), (u32)pattern);
 
-	printk("MMIO write test %s\n", all_passed ? "passed" : "FAILED");
+	printk("MMIO write test %s\n\n", all_passed ? "passed" : "FAILED");
+
+	/* --- Benchmark --- */
+
+	mmio_benchmark(mmio_reg, comm_page_reg);
 }
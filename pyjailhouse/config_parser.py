@@ -20,7 +20,7 @@ import struct
 from .extendedenum import ExtendedEnum
 
 # Keep the whole file in sync with include/jailhouse/cell-config.h.
-_CONFIG_REVISION = 13
+_CONFIG_REVISION = 15
 
 
 def flag_str(enum_class, value, separator=' | '):
@@ -135,8 +135,27 @@ class PIORegion:
                                                       pio_struct)
 
 
+class PCIDevice:
+    _DEVICE_FORMAT = '=BBHH6IHHBBHHQIBBH'
+    SIZE = struct.calcsize(_DEVICE_FORMAT)
+
+
+class PCICapability:
+    _CAPABILITY_FORMAT = '=HHHH'
+    SIZE = struct.calcsize(_CAPABILITY_FORMAT)
+
+
+class MSRRegion:
+    _REGION_FORMAT = '=III'
+    SIZE = struct.calcsize(_REGION_FORMAT)
+
+    def __init__(self, msr_struct):
+        (self.base, self.length, self.flags) = \
+            struct.unpack_from(self._REGION_FORMAT, msr_struct)
+
+
 class CellConfig:
-    _HEADER_FORMAT = '=6sH32s4xIIIIIIIIIIQ8x32x'
+    _HEADER_FORMAT = '=6sH32s4xIIIIIIIIIIIQ8x32x'
 
     def __init__(self, data, root_cell=False):
         self.data = data
@@ -154,6 +173,7 @@ class CellConfig:
              self.num_pci_devices,
              self.num_pci_caps,
              self.num_stream_ids,
+             self.num_msr_regions,
              self.vpci_irq_base,
              self.cpu_reset_address) = \
                 struct.unpack_from(CellConfig._HEADER_FORMAT, self.data)
@@ -185,6 +205,15 @@ class CellConfig:
             for n in range(self.num_pio_regions):
                 self.pio_regions.append(PIORegion(self.data[pioregion_offs:]))
                 pioregion_offs += PIORegion.SIZE
+
+            msrregion_offs = pioregion_offs + \
+                self.num_pci_devices * PCIDevice.SIZE + \
+                self.num_pci_caps * PCICapability.SIZE + \
+                self.num_stream_ids * 4
+            self.msr_regions = []
+            for n in range(self.num_msr_regions):
+                self.msr_regions.append(MSRRegion(self.data[msrregion_offs:]))
+                msrregion_offs += MSRRegion.SIZE
         except struct.error:
             raise RuntimeError('Not a %scell configuration' %
                                ('root ' if root_cell else ''))
@@ -239,8 +268,8 @@ class SystemConfig:
     _CONSOLE_FORMAT = '32x'
     _PCI_FORMAT = '=QBBH'
     _NUM_IOMMUS = 8
-    _ARCH_ARM_FORMAT = '=BB2xQQQQQ'
-    _ARCH_X86_FORMAT = '=HBxIII28x'
+    _ARCH_ARM_FORMAT = '=BB2xQQQQQQ'
+    _ARCH_X86_FORMAT = '=HBxIII36x'
 
     def __init__(self, data, arch):
         self.data = data
@@ -281,7 +310,8 @@ class SystemConfig:
                  self.arm_gicc_base,
                  self.arm_gich_base,
                  self.arm_gicv_base,
-                 self.arm_gicr_base) = \
+                 self.arm_gicr_base,
+                 self.arm_gits_base) = \
                      struct.unpack_from(self._ARCH_ARM_FORMAT, self.data[offs:])
             elif arch == 'x86':
                 (self.x86_pm_timer_address,
@@ -0,0 +1,180 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * Authors:
+ *  Jan Kiszka <jan.kiszka@siemens.com>
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Host benchmark of the hypervisor's memset() and memcpy() variants: the
+ * former byte loops, the generic word-sized versions and the architecture-
+ * optimized ones selected by arch_string_init().
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BUFFER_SIZE	(64 * 1024)
+#define PAGE_SIZE	4096
+#define ROUNDS		2000
+
+typedef unsigned char u8;
+typedef unsigned long long u64;
+
+/*
+ * Build the hypervisor sources without their freestanding headers and keep
+ * their memset() and memcpy() apart from the C library.
+ */
+#define _JAILHOUSE_TYPES_H
+#define _JAILHOUSE_STRING_H
+#define _JAILHOUSE_ASM_PROCESSOR_H
+#define _JAILHOUSE_ASM_SYSREGS_H
+
+#define memset		hv_memset
+#define memcpy		hv_memcpy
+#define strcmp		hv_strcmp
+
+struct string_ops {
+	void *(*memset)(void *s, int c, size_t n);
+	void *(*memcpy)(void *d, const void *s, size_t n);
+};
+
+extern const struct string_ops *arch_string_ops;
+
+void *hv_memset(void *s, int c, size_t n);
+void *hv_memcpy(void *d, const void *s, size_t n);
+int hv_strcmp(const char *s1, const char *s2);
+void arch_string_init(void);
+
+#include "../../hypervisor/lib.c"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+
+#define X86_FEATURE_ERMS	(1 << 9)
+
+static inline unsigned int cpuid_ebx(unsigned int leaf, unsigned int subleaf)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	__cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+	return ebx;
+}
+
+#include "../../hypervisor/arch/x86/lib.c"
+#elif defined(__aarch64__)
+#define DCZID_EL0	dczid_el0
+
+#define arm_read_sysreg(sysreg, val) \
+	asm volatile ("mrs	%0, " #sysreg : "=r" ((val)))
+
+#include "../../hypervisor/arch/arm64/lib.c"
+#else
+void arch_string_init(void)
+{
+}
+#endif
+
+static void *byte_memset(void *s, int c, size_t n)
+{
+	u8 *p = s;
+
+	while (n-- > 0)
+		*p++ = c;
+	return s;
+}
+
+static void *byte_memcpy(void *dest, const void *src, size_t n)
+{
+	const u8 *s = src;
+	u8 *d = dest;
+
+	while (n-- > 0)
+		*d++ = *s++;
+	return dest;
+}
+
+static const struct string_ops byte_string_ops = {
+	.memset = byte_memset,
+	.memcpy = byte_memcpy,
+};
+
+static const struct string_ops generic_string_ops = {
+	.memset = hv_memset,
+	.memcpy = hv_memcpy,
+};
+
+static u8 *dst, *src;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double ns_per_page(const struct string_ops *ops, int copy,
+			  size_t offset)
+{
+	size_t len = BUFFER_SIZE - PAGE_SIZE;
+	unsigned int round;
+	u64 start;
+
+	start = now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		if (copy)
+			ops->memcpy(dst + offset, src, len);
+		else
+			ops->memset(dst + offset, 0, len);
+		asm volatile("" : : "r" (dst) : "memory");
+	}
+	return (double)(now_ns() - start) / ROUNDS / (len / PAGE_SIZE);
+}
+
+static void run(const char *name, const struct string_ops *ops)
+{
+	printf("%-8s %12.1f %12.1f %12.1f %12.1f\n", name,
+	       ns_per_page(ops, 0, 0), ns_per_page(ops, 0, 3),
+	       ns_per_page(ops, 1, 0), ns_per_page(ops, 1, 3));
+}
+
+int main(void)
+{
+	const struct string_ops *arch_ops;
+
+	dst = aligned_alloc(PAGE_SIZE, BUFFER_SIZE);
+	src = aligned_alloc(PAGE_SIZE, BUFFER_SIZE);
+	if (!dst || !src) {
+		perror("aligned_alloc");
+		return 1;
+	}
+	byte_memset(src, 0x5a, BUFFER_SIZE);
+	byte_memset(dst, 0, BUFFER_SIZE);
+
+	arch_string_init();
+	arch_ops = arch_string_ops;
+
+	printf("ns per 4K page   memset     memset+3       memcpy     "
+	       "memcpy+3\n");
+
+	arch_string_ops = NULL;
+	run("byte", &byte_string_ops);
+	run("generic", &generic_string_ops);
+
+	if (arch_ops) {
+		arch_string_ops = arch_ops;
+		run("arch", arch_ops);
+	} else {
+		printf("arch     (no optimized variant on this CPU)\n");
+	}
+
+	free(dst);
+	free(src);
+	return 0;
+}
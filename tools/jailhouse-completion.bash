@@ -319,7 +319,7 @@ function _jailhouse() {
 	local command command_cell command_config cur prev subcommand
 
 	# first level
-	command="enable disable console cell config hardware --help"
+	command="enable disable console cell config hardware trace --help"
 
 	# second level
 	command_cell="create load start shutdown destroy linux list stats"
@@ -369,6 +369,10 @@ function _jailhouse() {
 		hardware)
 			COMPREPLY="check"
 			;;
+		trace)
+			COMPREPLY=( $( compgen -W "enable disable show latency" -- \
+					"${cur}") )
+			;;
 		--help|disable)
 			# these first level commands have no further subcommand
 			# or option OR we don't even know it
@@ -419,6 +423,19 @@ function _jailhouse() {
 				return 1;;
 			esac
 			;;
+		trace)
+			case "${subcommand}" in
+			latency)
+				# this command takes only a argument at place 3
+				[ "${COMP_CWORD}" -gt 3 ] && return 1
+
+				COMPREPLY=( $( compgen -W "enable disable" -- \
+						"${cur}") )
+				;;
+			*)
+				return 1;;
+			esac
+			;;
 		*)
 			# no further subsubcommand/option known for this
 			return 1;;
@@ -25,10 +25,12 @@
 #include <sys/stat.h>
 
 #include <jailhouse.h>
+#include <jailhouse/trace.h>
 
 #define JAILHOUSE_EXEC_DIR	LIBEXECDIR "/jailhouse"
 #define JAILHOUSE_DEVICE	"/dev/jailhouse"
 #define JAILHOUSE_CELLS		"/sys/devices/jailhouse/cells/"
+#define JAILHOUSE_TRACE		"/sys/devices/jailhouse/trace"
 
 enum shutdown_load_mode {LOAD, SHUTDOWN};
 
@@ -75,7 +77,9 @@ static void __attribute__((noreturn)) help(char *prog, int exit_status)
 	       "             [-a | --address ADDRESS] ...\n"
 	       "   cell start { ID | [--name] NAME }\n"
 	       "   cell shutdown { ID | [--name] NAME }\n"
-	       "   cell destroy { ID | [--name] NAME }\n",
+	       "   cell destroy { ID | [--name] NAME }\n"
+	       "   trace { enable | disable | show }\n"
+	       "   trace latency { enable | disable }\n",
 	       basename(prog));
 	for (ext = extensions; ext->cmd; ext++)
 		printf("   %s %s %s\n", ext->cmd, ext->subcmd, ext->help);
@@ -553,6 +557,127 @@ out:
 	return ret;
 }
 
+static void *read_trace_buffers(size_t *size)
+{
+	size_t capacity = 0;
+	void *buffer = NULL;
+	ssize_t result;
+	int fd;
+
+	fd = open(JAILHOUSE_TRACE, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "opening %s: %s\n", JAILHOUSE_TRACE,
+			strerror(errno));
+		exit(1);
+	}
+
+	/* sysfs returns binary attributes in page-sized chunks */
+	*size = 0;
+	do {
+		if (*size == capacity) {
+			capacity += JAILHOUSE_TRACE_BUFFER_SIZE;
+			buffer = realloc(buffer, capacity);
+			if (!buffer) {
+				fprintf(stderr, "insufficient memory\n");
+				exit(1);
+			}
+		}
+		result = read(fd, buffer + *size, capacity - *size);
+		if (result < 0) {
+			fprintf(stderr, "reading %s: %s\n", JAILHOUSE_TRACE,
+				strerror(errno));
+			exit(1);
+		}
+		*size += result;
+	} while (result > 0);
+
+	close(fd);
+
+	return buffer;
+}
+
+static void trace_show_cpu(const struct jailhouse_trace_buffer *buffer)
+{
+	const struct jailhouse_trace_entry *entry;
+	__u64 head = buffer->head;
+	__u64 n;
+
+	n = head > buffer->num_entries ? head - buffer->num_entries : 0;
+	for (; n < head; n++) {
+		entry = &buffer->entries[n % buffer->num_entries];
+
+		/* skip entries overwritten or in flight while reading */
+		if (entry->seq != n + 1)
+			continue;
+
+		printf("%3u %20llu %10llu %5u 0x%04x 0x%016llx",
+		       buffer->cpu_id,
+		       (unsigned long long)entry->entry_time,
+		       (unsigned long long)(entry->exit_time -
+					    entry->entry_time),
+		       entry->cell_id, entry->reason,
+		       (unsigned long long)entry->pc);
+		if (entry->flags & JAILHOUSE_TRACE_FLAG_MMIO)
+			printf(" 0x%016llx",
+			       (unsigned long long)entry->mmio_address);
+		printf("\n");
+	}
+}
+
+static int trace_show(void)
+{
+	const struct jailhouse_trace_buffer *buffer;
+	size_t size, offset;
+	void *buffers;
+
+	buffers = read_trace_buffers(&size);
+
+	printf("CPU            TIMESTAMP   DURATION  CELL REASON "
+	       "PC                 MMIO\n");
+	for (offset = 0; offset + JAILHOUSE_TRACE_BUFFER_SIZE <= size;
+	     offset += JAILHOUSE_TRACE_BUFFER_SIZE) {
+		buffer = buffers + offset;
+		if (buffer->num_entries > 0)
+			trace_show_cpu(buffer);
+	}
+
+	free(buffers);
+
+	return 0;
+}
+
+static int trace(int argc, char *argv[])
+{
+	unsigned long command;
+	int err, fd;
+
+	if (argc == 4 && strcmp(argv[2], "latency") == 0) {
+		if (strcmp(argv[3], "enable") == 0)
+			command = JAILHOUSE_TRACE_LATENCY_ENABLE;
+		else if (strcmp(argv[3], "disable") == 0)
+			command = JAILHOUSE_TRACE_LATENCY_DISABLE;
+		else
+			help(argv[0], 1);
+	} else if (argc != 3) {
+		help(argv[0], 1);
+	} else if (strcmp(argv[2], "enable") == 0)
+		command = JAILHOUSE_TRACE_ENABLE;
+	else if (strcmp(argv[2], "disable") == 0)
+		command = JAILHOUSE_TRACE_DISABLE;
+	else if (strcmp(argv[2], "show") == 0)
+		return trace_show();
+	else
+		help(argv[0], 1);
+
+	fd = open_dev();
+	err = ioctl(fd, JAILHOUSE_TRACE_CONTROL, command);
+	if (err)
+		perror("JAILHOUSE_TRACE_CONTROL");
+	close(fd);
+
+	return err;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd;
@@ -573,6 +698,8 @@ int main(int argc, char *argv[])
 		err = cell_management(argc, argv);
 	} else if (strcmp(argv[1], "console") == 0) {
 		err = console(argc, argv);
+	} else if (strcmp(argv[1], "trace") == 0) {
+		err = trace(argc, argv);
 	} else if (strcmp(argv[1], "config") == 0 ||
 		   strcmp(argv[1], "hardware") == 0) {
 		call_extension_script(argv[1], argc, argv);